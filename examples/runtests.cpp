@@ -26,11 +26,35 @@
 #include <stll/layouterCSS.h>
 #include <stll/layouterXHTML.h>
 #include <stll/layouterFont.h>
+#include <stll/output_DrawList.h>
+#include <stll/output_Gray.h>
+#include <stll/internal/spriteCache.h>
+#include <stll/internal/slabAllocator.h>
+#include <stll/internal/gamma.h>
+
+// the vertex preparation for OpenGL only needs the declarations, no context
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <stll/internal/openGL_internal.h>
 #include "layouterXMLSaveLoad.h"
 
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
 #include <pugixml.hpp>
 
 #include <string>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <type_traits>
+#include <cstdio>
+
+#include <unistd.h>
+#include <sys/wait.h>
 
 #if   defined(USE_PUGI_XML)
 #define XMLLIB Pugi
@@ -372,6 +396,192 @@ BOOST_AUTO_TEST_CASE( Faulty_XHTML_Code )
     s, STLL::RectangleShape_c(200*64)), STLL::XhtmlException_c);
 }
 
+BOOST_AUTO_TEST_CASE( XHTML_Buffer_And_File )
+{
+  STLL::TextStyleSheet_c s;
+  STLL::RectangleShape_c r(200*64);
+
+  s.addRule("body", "font-size", "16px");
+  s.addRule("body", "color", "#ffffff");
+  s.addFont("sans", STLL::FontResource_c("tests/FreeSans.ttf"));
+  s.setUseOptimizingLayouter(false);
+  s.setHyphenate(false);
+
+  std::string code = "<html><body><p lang='en'>Some text &amp; <a href='l1'>a link</a></p><p>More text</p></body></html>";
+  auto ref = layoutXHTML(XMLLIB, code, s, r);
+
+  // parsing from a buffer or a file must give the same layout as parsing from a string
+  std::vector<char> buffer(code.begin(), code.end());
+  BOOST_CHECK(layoutXHTMLBuffer(XMLLIB, buffer.data(), buffer.size(), s, r) == ref);
+
+  {
+    std::ofstream f("layout.tmp");
+    f << code;
+  }
+
+  BOOST_CHECK(layoutXHTMLFile(XMLLIB, "layout.tmp", s, r) == ref);
+  std::remove("layout.tmp");
+
+  std::string faulty = "<html><body><p>Text</p></body></htm>";
+  std::vector<char> faultyBuffer(faulty.begin(), faulty.end());
+  BOOST_CHECK_THROW(layoutXHTMLBuffer(XMLLIB, faultyBuffer.data(), faultyBuffer.size(), s, r), STLL::XhtmlException_c);
+  BOOST_CHECK_THROW(layoutXHTMLFile(XMLLIB, "tests/missing.xhtml", s, r), STLL::XhtmlException_c);
+}
+
+BOOST_AUTO_TEST_CASE( XHTML_Batch )
+{
+  STLL::TextStyleSheet_c s;
+  STLL::RectangleShape_c r(200*64);
+
+  s.addRule("body", "font-size", "16px");
+  s.addRule("body", "color", "#ffffff");
+  s.addFont("sans", STLL::FontResource_c("tests/FreeSans.ttf"));
+  s.setUseOptimizingLayouter(false);
+  s.setHyphenate(false);
+
+  s.addRule(".big", "font-size", "24px");
+  s.addRule(".red", "color", "#ff0000");
+  s.addRule("li", "padding", "2px");
+  s.addRule("td", "padding", "3px");
+  s.addRule(".tc", "width", "80px");
+  s.addRule("sup", "font-size", "80%");
+
+  // documents of different kinds, so that the threads need different fonts and sizes
+  std::vector<std::string> docs;
+
+  for (int i = 0; i < 50; i++)
+  {
+    std::string n = std::to_string(i);
+
+    switch (i % 5)
+    {
+      case 0:
+        docs.push_back("<html><body><p lang='en'>Document " + n + std::string(i, 'x') + "</p></body></html>");
+        break;
+      case 1:
+        docs.push_back("<html><body><p lang='en' class='big'>Title " + n + "</p>"
+                       "<p lang='en'>Some <span class='red'>red</span> text that is long enough "
+                       "to wrap into several lines " + n + "</p></body></html>");
+        break;
+      case 2:
+        docs.push_back("<html><body><ul><li>Item " + n + "</li><li class='big'>Big item</li>"
+                       "<li>T<sup>" + n + "</sup></li></ul></body></html>");
+        break;
+      case 3:
+        docs.push_back("<html><body><table><colgroup><col class='tc' /><col class='tc' /></colgroup><tr><td>Cell " + n + "</td><td class='red'>Red</td></tr>"
+                       "<tr><td>A</td><td class='big'>" + n + "</td></tr></table></body></html>");
+        break;
+      case 4:
+        docs.push_back("<html><body><div class='red'><p>Line " + n + "<br />second line</p></div>"
+                       "<p class='big'>" + std::string(i, 'y') + "</p></body></html>");
+        break;
+    }
+  }
+
+  // the layouts must be the same as when done one after the other and in the same order,
+  // no matter how many threads are used
+  std::vector<STLL::TextLayout_c> serial;
+
+  for (auto & d : docs)
+    serial.push_back(layoutXHTML(XMLLIB, d, s, r));
+
+  for (unsigned int threads : { 1, 3, 8 })
+  {
+    auto res = layoutXHTMLBatch(XMLLIB, docs, s, r, threads);
+    BOOST_REQUIRE(res.size() == docs.size());
+
+    for (size_t i = 0; i < docs.size(); i++)
+      BOOST_CHECK(res[i] == serial[i]);
+  }
+
+  BOOST_CHECK(layoutXHTMLBatch(XMLLIB, std::vector<std::string>(), s, r, 4).empty());
+
+  docs[20] = "<html><body><p>Text</p></body></htm>";
+  BOOST_CHECK_THROW(layoutXHTMLBatch(XMLLIB, docs, s, r, 0), STLL::XhtmlException_c);
+}
+
+#ifdef USE_PUGI_XML
+BOOST_AUTO_TEST_CASE( Incremental_XHTML_Layout )
+{
+  STLL::TextStyleSheet_c s;
+  STLL::RectangleShape_c r(200*64);
+
+  s.addRule("body", "font-size", "16px");
+  s.addRule("body", "color", "#ffffff");
+  s.addRule("p", "padding", "2px");
+  s.addRule("body", "border-width", "1px");
+  s.addRule("body", "border-color", "#000000");
+  s.addRule(".big", "font-size", "30px");
+  s.addFont("sans", STLL::FontResource_c("tests/FreeSans.ttf"));
+  s.setUseOptimizingLayouter(false);
+  s.setHyphenate(false);
+
+  pugi::xml_document doc;
+  doc.load_string("<html><body><p lang='en'>First</p><p lang='en'>Second <a href='l'>link</a></p>"
+                  "<ul><li>Item</li></ul><p lang='en'>Last</p></body></html>");
+
+  auto html = doc.document_element();
+  auto p1 = html.child("body").child("p");
+
+  STLL::IncrementalXMLLayout_c<pugi::xml_node> inc(html);
+  BOOST_CHECK(inc.layout(s, r) == STLL::layoutXML(html, s, r));
+
+  // the first paragraph gets more lines, all following blocks need to move down
+  p1.first_child().set_value("First paragraph with enough text to need a few lines in this narrow box");
+  inc.markDirty(p1.first_child());
+  BOOST_CHECK(inc.layout(s, r) == STLL::layoutXML(html, s, r));
+
+  // changing a class changes the size of the element and the margins of the following one
+  p1.append_attribute("class") = "big";
+  inc.markDirty(p1);
+  BOOST_CHECK(inc.layout(s, r) == STLL::layoutXML(html, s, r));
+
+  // a new block within the body, the layout is completely redone
+  html.child("body").append_child("p").append_child(pugi::node_pcdata).set_value("New");
+  inc.markDirty(html.child("body").last_child());
+  BOOST_CHECK(inc.layout(s, r) == STLL::layoutXML(html, s, r));
+}
+#endif
+
+BOOST_AUTO_TEST_CASE( XHTML_Templates )
+{
+  STLL::TextStyleSheet_c s;
+  STLL::RectangleShape_c r(200*64);
+
+  s.addRule("body", "font-size", "16px");
+  s.addRule("body", "color", "#ffffff");
+  s.addRule("p", "padding", "2px");
+  s.addFont("sans", STLL::FontResource_c("tests/FreeSans.ttf"));
+  s.setUseOptimizingLayouter(false);
+  s.setHyphenate(false);
+
+  auto t = STLL::compileXHTML(XMLLIB, "<html><body><p lang='en'>Dear <span data-slot='name'>x</span>,</p>"
+                                      "<p lang='en' data-slot='message'>text</p><p lang='en'>Regards</p></body></html>");
+
+  BOOST_CHECK(t.getSlots() == std::vector<std::string>({"name", "message"}));
+
+  // the slot texts are taken literally
+  auto l = t.instantiate({{"name", "Bob"}, {"message", "Fish & <chips>"}}, s, r);
+  BOOST_CHECK(l == layoutXHTML(XMLLIB, "<html><body><p lang='en'>Dear <span>Bob</span>,</p>"
+                                       "<p lang='en'>Fish &amp; &lt;chips&gt;</p><p lang='en'>Regards</p></body></html>", s, r));
+
+  // a longer message moves the last paragraph, the name stays
+  l = t.instantiate({{"message", "A message that is long enough to wrap into more than one line"}}, s, r);
+  BOOST_CHECK(l == layoutXHTML(XMLLIB, "<html><body><p lang='en'>Dear <span>Bob</span>,</p>"
+                                       "<p lang='en'>A message that is long enough to wrap into more than one line</p>"
+                                       "<p lang='en'>Regards</p></body></html>", s, r));
+
+  // copies would share the document that the template changes, so it can only be moved
+  BOOST_CHECK(!std::is_copy_constructible<decltype(t)>::value);
+  BOOST_CHECK(!std::is_copy_assignable<decltype(t)>::value);
+
+  auto t2 = std::move(t);
+  l = t2.instantiate({{"name", "Alice"}}, s, r);
+  BOOST_CHECK(l == layoutXHTML(XMLLIB, "<html><body><p lang='en'>Dear <span>Alice</span>,</p>"
+                                       "<p lang='en'>A message that is long enough to wrap into more than one line</p>"
+                                       "<p lang='en'>Regards</p></body></html>", s, r));
+}
+
 BOOST_AUTO_TEST_CASE( Simple_Layouts )
 {
   auto c = std::make_shared<STLL::FontCache_c>();
@@ -663,6 +873,101 @@ BOOST_AUTO_TEST_CASE( Simple_Layouts )
   s.addRule("p", "text-decoration", "");
 }
 
+// a vertical strip with fixed edges, the shape the paragraph layouter gets for a list bullet
+class StripShape_c : public STLL::Shape_c
+{
+  private:
+    int32_t l, r;
+
+  public:
+    StripShape_c(int32_t left, int32_t right) : l(left), r(right) { }
+
+    virtual int32_t getLeft(int32_t /*top*/, int32_t /*bottom*/) const { return l; }
+    virtual int32_t getLeft2(int32_t /*top*/, int32_t /*bottom*/) const { return l; }
+    virtual int32_t getRight(int32_t /*top*/, int32_t /*bottom*/) const { return r; }
+    virtual int32_t getRight2(int32_t /*top*/, int32_t /*bottom*/) const { return r; }
+};
+
+BOOST_AUTO_TEST_CASE( List_Bullets )
+{
+  auto c = std::make_shared<STLL::FontCache_c>();
+  STLL::TextStyleSheet_c s(c);
+
+  s.addFont("sans", STLL::FontResource_c("tests/FreeSans.ttf"));
+  s.addRule("body", "font-size", "16px");
+  s.addRule("body", "color", "#ffffff");
+  s.addRule("li", "padding", "3px");
+  s.addRule(".big", "font-size", "24px");
+  s.addRule(".red", "color", "#ff0000");
+  s.addRule(".rtl", "direction", "rtl");
+  s.addRule("sup", "font-size", "90%");
+  s.setUseOptimizingLayouter(false);
+  s.setHyphenate(false);
+
+  // the bullets are laid out once for each font and colour and then moved to their item
+  auto l = STLL::layoutXHTML(XMLLIB,
+    "<html><body>"
+    "<ul><li>One</li><li class='big'>Two</li><li>Three with enough text to wrap the line</li><li>T<sup>2</sup></li></ul>"
+    "<ul class='red'><li>Four</li><li class='big'>Five</li></ul>"
+    "<ul class='rtl'><li>Six</li></ul>"
+    "</body></html>", s, STLL::RectangleShape_c(200*64));
+
+  // lay out a bullet the way it was done for each item before: as paragraph in a strip
+  // of the width of the list indent at the side of the item
+  auto bullet = [&s](uint32_t size, STLL::Color_c col, bool ltr) {
+    auto f = s.findFamily("sans")->getFont(size*64);
+
+    STLL::CodepointAttributes_c a;
+    a.c = col;
+    a.font = f;
+
+    STLL::LayoutProperties_c prop;
+    prop.indent = 0;
+    prop.ltr = true;
+    prop.align = STLL::LayoutProperties_c::ALG_CENTER;
+    prop.optimizeLinebreaks = false;
+    prop.hyphenate = false;
+
+    int32_t left = ltr ? 3*64 : 200*64-3*64-f.getAscender();
+
+    return STLL::layoutParagraph(U"\u2022", STLL::AttributeIndex_c(a), StripShape_c(left, left+f.getAscender()), prop, 0);
+  };
+
+  STLL::Color_c white(255, 255, 255), red(255, 0, 0);
+
+  std::vector<STLL::TextLayout_c> expected {
+    bullet(16, white, true), bullet(24, white, true), bullet(16, white, true), bullet(16, white, true),
+    bullet(16, red, true), bullet(24, red, true), bullet(16, white, false)
+  };
+
+  auto bulletGlyph = expected[0].getData()[0].glyphIndex;
+
+  const auto & dat = l.getData();
+  size_t k = 0;
+
+  for (size_t i = 0; i < dat.size(); i++)
+  {
+    if (dat[i].command != STLL::CommandData_c::CMD_GLYPH || dat[i].glyphIndex != bulletGlyph) continue;
+
+    BOOST_REQUIRE(k < expected.size());
+    BOOST_REQUIRE_EQUAL(expected[k].getData().size(), 1);
+
+    // same glyph, font and colour at the same horizontal position, the baseline is the
+    // one of the first line of the item that follows the bullet
+    auto & e = expected[k].getData()[0];
+    BOOST_CHECK(dat[i].font == e.font);
+    BOOST_CHECK(dat[i].c == e.c);
+    BOOST_CHECK_EQUAL(dat[i].x, e.x);
+
+    BOOST_REQUIRE(i+1 < dat.size());
+    BOOST_CHECK_EQUAL(dat[i].y, dat[i+1].y);
+
+    k++;
+  }
+
+  BOOST_CHECK_EQUAL(k, expected.size());
+}
+
 BOOST_AUTO_TEST_CASE( Table_Layouts )
 {
   auto c = std::make_shared<STLL::FontCache_c>();
@@ -917,3 +1222,1582 @@ BOOST_AUTO_TEST_CASE( Links )
     "<tr><td class='va-mid'><a href='l1'>Test</a></td><td>Table cell with some text to get a linebreak</td></tr><tr><td>T</td><td>Table</td></tr></table></body></html>",
     s, STLL::RectangleShape_c(1000*64)), "tests/link-08.lay"));
 }
+
+BOOST_AUTO_TEST_CASE( Link_Index )
+{
+  // lines of link areas, some overlapping, with different heights
+  STLL::TextLayout_c l;
+  std::mt19937 rng(5);
+
+  for (int i = 0; i < 200; i++)
+  {
+    l.links.emplace_back("link" + std::to_string(i));
+
+    for (int j = rng() % 3; j >= 0; j--)
+    {
+      int line = rng() % 40;
+      l.links.back().areas.emplace_back(rng() % (500*64), line*20*64 + rng() % (5*64), rng() % (80*64), (12 + rng() % 10)*64);
+    }
+  }
+
+  // an empty area that never matches
+  l.links.back().areas.emplace_back(64, 64, 0, 64);
+
+  // the index must give the same results as the search without the index
+  STLL::TextLayout_c indexed(l);
+  indexed.buildLinkIndex();
+
+  auto check = [&](void) {
+    for (int i = 0; i < 2000; i++)
+    {
+      int x = (int)(rng() % (600*64)) - 50*64;
+      int y = (int)(rng() % (850*64)) - 25*64;
+
+      int a = l.linkAt(x, y);
+      int b = indexed.linkAt(x, y);
+
+      // with overlapping areas the returned link might differ, but it must contain the point
+      BOOST_CHECK_EQUAL(a == -1, b == -1);
+
+      if (b != -1)
+        BOOST_CHECK(std::any_of(l.links[b].areas.begin(), l.links[b].areas.end(), [x, y](const STLL::TextLayout_c::Rectangle_c & r) {
+          return x >= r.x && x < r.x+r.w && y >= r.y && y < r.y+r.h; }));
+
+      int w = rng() % (100*64);
+      int h = rng() % (60*64);
+
+      BOOST_CHECK(l.linksInRect(x, y, w, h) == indexed.linksInRect(x, y, w, h));
+    }
+  };
+
+  check();
+
+  // shifting keeps the index valid
+  l.shift(33*64+5, -17*64+3);
+  indexed.shift(33*64+5, -17*64+3);
+  check();
+
+  BOOST_CHECK_EQUAL(indexed.linkAt(64+10, 64+10), l.linkAt(64+10, 64+10));
+  BOOST_CHECK(indexed.linksInRect(0, 0, 0, 100).empty());
+}
+
+BOOST_AUTO_TEST_CASE( Span_Patching )
+{
+  STLL::Color_c red(255, 0, 0), green(0, 255, 0), grey(128, 128, 128);
+
+  {
+    STLL::TextLayout_c l;
+
+    for (int i = 0; i < 100; i++)
+    {
+      l.addCommand(i*64+32, 64+32, 64, 64, grey, 0, i % 5, 1);
+      l.addCommand(i*64, 64, 64, 64, red, 0, i % 5, 0);
+    }
+
+    STLL::TextLayout_c indexed(l);
+    indexed.buildSpanIndex();
+
+    for (auto t : { &l, &indexed })
+    {
+      // only the commands of span 3 are touched, span 0 means no span and is never touched
+      BOOST_CHECK_EQUAL(t->recolor(3, green), 20u);
+      BOOST_CHECK_EQUAL(t->moveShadow(3, 0, -64, 64), 20u);
+      BOOST_CHECK_EQUAL(t->recolor(7, green), 0u);
+      BOOST_CHECK_EQUAL(t->recolor(0, green), 0u);
+      BOOST_CHECK_EQUAL(t->moveShadow(0, 0, -64, 64), 0u);
+
+      for (int i = 0; i < 100; i++)
+      {
+        auto & s = t->getData()[2*i];
+        auto & g = t->getData()[2*i+1];
+
+        BOOST_CHECK(g.c == (i % 5 == 3 ? green : red));
+        BOOST_CHECK(s.c == grey);
+        BOOST_CHECK_EQUAL(g.x, i*64);
+        BOOST_CHECK_EQUAL(s.x, i % 5 == 3 ? i*64-32 : i*64+32);
+        BOOST_CHECK_EQUAL(s.y, i % 5 == 3 ? 2*64+32 : 64+32);
+      }
+    }
+  }
+
+  // spans within XHTML are given by the data-span attribute
+  STLL::TextStyleSheet_c s;
+  STLL::RectangleShape_c r(200*64);
+
+  s.addRule("body", "font-size", "16px");
+  s.addRule("body", "color", "#ffffff");
+  s.addRule("p", "text-shadow", "0px 1px 0px #808080");
+  s.addFont("sans", STLL::FontResource_c("tests/FreeSans.ttf"));
+  s.setUseOptimizingLayouter(false);
+  s.setHyphenate(false);
+
+  auto l = layoutXHTML(XMLLIB, "<html><body><p lang='en'>Some <a data-span='1' href='l'>link <b>text</b></a> here</p></body></html>", s, r);
+  l.buildSpanIndex();
+  BOOST_CHECK(l.recolor(1, STLL::Color_c(255, 0, 0)) > 0);
+  BOOST_CHECK(l.moveShadow(1, 0, 64, 0) > 0);
+
+  // the same as a layout with the changed style
+  s.addRule(".hover", "color", "#ff0000");
+  s.addRule(".hover", "text-shadow", "1px 1px 0px #808080");
+
+  BOOST_CHECK(l == layoutXHTML(XMLLIB, "<html><body><p lang='en'>Some <a class='hover' href='l'>link "
+                                       "<b>text</b></a> here</p></body></html>", s, r));
+
+  // borders and backgrounds of boxes belong to no span
+  s.addRule(".box", "background-color", "#0000ff");
+  s.addRule(".box", "border-width", "2px");
+  s.addRule(".box", "border-color", "#00ff00");
+  s.addRule(".box", "padding", "3px");
+
+  auto box = layoutXHTML(XMLLIB, "<html><body><div class='box'><p lang='en'>Some text</p></div></body></html>", s, r);
+  auto boxCopy = box;
+
+  BOOST_CHECK(box.getData().size() > 0);
+  BOOST_CHECK_EQUAL(box.recolor(0, STLL::Color_c(255, 0, 0)), 0u);
+  BOOST_CHECK_EQUAL(box.moveShadow(0, 0, 64, 0), 0u);
+  BOOST_CHECK(box == boxCopy);
+
+  // spans don't split shaping runs, so the glyphs are placed as without spans
+  auto spanned = layoutXHTML(XMLLIB, "<html><body><p lang='en'>So<span data-span='2'>me</span> te"
+                                     "<span data-span='3'>x</span>t</p></body></html>", s, r);
+  auto plain = layoutXHTML(XMLLIB, "<html><body><p lang='en'>Some text</p></body></html>", s, r);
+
+  BOOST_REQUIRE_EQUAL(spanned.getData().size(), plain.getData().size());
+
+  for (size_t i = 0; i < plain.getData().size(); i++)
+  {
+    BOOST_CHECK_EQUAL(spanned.getData()[i].x, plain.getData()[i].x);
+    BOOST_CHECK_EQUAL(spanned.getData()[i].y, plain.getData()[i].y);
+    BOOST_CHECK_EQUAL(spanned.getData()[i].glyphIndex, plain.getData()[i].glyphIndex);
+  }
+}
+
+#ifdef USE_LIBXML2
+// allocation counting functions for libxml2, they forward to the original functions
+static xmlFreeFunc xmlOrigFree;
+static xmlMallocFunc xmlOrigMalloc;
+static xmlReallocFunc xmlOrigRealloc;
+static xmlStrdupFunc xmlOrigStrdup;
+static int xmlAllocations;
+
+static void * xmlCountMalloc(size_t s) { xmlAllocations++; return xmlOrigMalloc(s); }
+static void * xmlCountRealloc(void * p, size_t s) { xmlAllocations++; return xmlOrigRealloc(p, s); }
+static char * xmlCountStrdup(const char * s) { xmlAllocations++; return xmlOrigStrdup(s); }
+
+BOOST_AUTO_TEST_CASE( LibXML2_Attributes )
+{
+  auto res = STLL::internal::xml_parseStringLibXML2(
+    "<?xml version='1.0'?><!DOCTYPE html [<!ENTITY e 'entity'>]>"
+    "<html><body><p class='c1' lang='en'>Text</p><p title='a&e;b' class='' /></body></html>");
+
+  BOOST_REQUIRE(std::get<1>(res) == "");
+
+  auto body = STLL::internal::xml_getFirstChild(STLL::internal::xml_getHeadNode(std::get<0>(res)));
+  auto p1 = STLL::internal::xml_getFirstChild(body);
+  auto p2 = STLL::internal::xml_getNextSibling(p1);
+
+  // looking up attributes with plain text values must not allocate anything
+  xmlMemGet(&xmlOrigFree, &xmlOrigMalloc, &xmlOrigRealloc, &xmlOrigStrdup);
+  xmlMemSetup(xmlOrigFree, xmlCountMalloc, xmlCountRealloc, xmlCountStrdup);
+  xmlAllocations = 0;
+
+  int found = 0;
+
+  for (int i = 0; i < 100; i++)
+  {
+    BOOST_CHECK_EQUAL(STLL::internal::xml_getAttribute(p1, "class"), "c1");
+    BOOST_CHECK_EQUAL(STLL::internal::xml_getAttribute(p1, "lang"), "en");
+    BOOST_CHECK_EQUAL(STLL::internal::xml_getAttribute(p2, "class"), "");
+    BOOST_CHECK(STLL::internal::xml_getAttribute(p1, "href") == nullptr);
+    BOOST_CHECK(STLL::internal::xml_getAttribute(STLL::internal::xml_getFirstChild(p1), "class") == nullptr);
+
+    STLL::internal::xml_forEachAttribute(p1, [&found](const char *, const char *) { found++; return false; });
+  }
+
+  xmlMemSetup(xmlOrigFree, xmlOrigMalloc, xmlOrigRealloc, xmlOrigStrdup);
+
+  BOOST_CHECK_EQUAL(xmlAllocations, 0);
+  BOOST_CHECK_EQUAL(found, 200);
+
+  // values with entity references are assembled and stay valid until the pool is released
+  auto t1 = STLL::internal::xml_getAttribute(p2, "title");
+  auto t2 = STLL::internal::xml_getAttribute(p2, "title");
+
+  BOOST_CHECK_EQUAL(t1, "aentityb");
+  BOOST_CHECK_EQUAL(t2, "aentityb");
+  BOOST_CHECK(t1 != t2);
+
+  STLL::internal::xml_attributePool().release();
+}
+#endif
+
+// a layout with plain and blurred glyphs and rectangles
+static STLL::TextLayout_c drawListLayout(int glyphs)
+{
+  static STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+  STLL::TextLayout_c l;
+
+  for (int i = 0; i < glyphs; i++)
+    l.addCommand(f, 36+i%60, (i%40)*9*64+i*7, (20+(i/40)*20)*64, STLL::Color_c(200, (i*37)%256, 50), i%7 == 0 ? 3*64 : 0);
+
+  l.addCommand(2*64+10, 30*64+5, 200*64, 64, STLL::Color_c(10, 20, 250), 0);
+  l.addCommand(2*64+10, 40*64+5, 100*64, 64, STLL::Color_c(10, 20, 250), 2*64);
+
+  return l;
+}
+
+// a copy of the atlas pages that only gets updated with the changes reported in the batches, just
+// like textures on the graphics card, all quads must only use up to date areas
+class DrawListTexture_c
+{
+  public:
+    std::vector<std::vector<uint8_t>> pixels;
+    std::vector<uint32_t> ids;
+
+    bool update(const STLL::DrawBatch_c & b)
+    {
+      pixels.resize(b.pages.size());
+      ids.resize(b.pages.size());
+
+      for (size_t p = 0; p < b.pages.size(); p++)
+      {
+        auto & pg = b.pages[p];
+
+        if (pg.resized)
+        {
+          pixels[p].assign(pg.atlas, pg.atlas+pg.width*pg.height);
+        }
+        else
+        {
+          if (pixels[p].size() != pg.width*pg.height) return false;
+
+          for (auto & r : pg.dirty)
+          {
+            if (r.x+r.w > pg.width || r.y+r.h > pg.height) return false;
+
+            for (uint32_t y = r.y; y < r.y+r.h; y++)
+              memcpy(pixels[p].data()+y*pg.width+r.x, pg.atlas+y*pg.width+r.x, r.w);
+          }
+        }
+
+        ids[p] = pg.id;
+      }
+
+      for (auto & q : b.quads)
+      {
+        if (q.page >= b.pages.size()) return false;
+
+        auto & pg = b.pages[q.page];
+
+        if (q.u < 0 || q.v < 0 || q.u+q.tw > pg.width || q.v+q.th > pg.height) return false;
+
+        for (uint32_t y = q.v; y < q.v+q.th; y++)
+          if (memcmp(pixels[q.page].data()+y*pg.width+(uint32_t)q.u, pg.atlas+y*pg.width+(uint32_t)q.u, q.tw) != 0)
+            return false;
+      }
+
+      return true;
+    }
+};
+
+BOOST_AUTO_TEST_CASE( Draw_List )
+{
+  auto l = drawListLayout(30);
+
+  {
+    STLL::showDrawList<> d(64, 1024);
+    DrawListTexture_c t;
+    std::vector<STLL::DrawQuad_c> quads;
+    int batches = 0;
+
+    d.showLayout(l, 100*64, 50*64, STLL::SUBP_NONE, [&](const STLL::DrawBatch_c & b) {
+      BOOST_CHECK_EQUAL(b.pages.size(), 1);
+      BOOST_CHECK(b.pages[0].resized);
+      BOOST_CHECK(t.update(b));
+      quads = b.quads;
+      batches++;
+    });
+
+    // the atlas has to grow, but everything goes into one batch with one quad per command
+    BOOST_CHECK_EQUAL(batches, 1);
+    BOOST_CHECK_EQUAL(quads.size(), l.getData().size());
+    BOOST_CHECK(d.cacheWidth() > 64);
+
+    for (size_t i = 0; i < quads.size(); i++)
+    {
+      BOOST_CHECK_EQUAL(quads[i].subpixel, 0);
+      BOOST_CHECK(quads[i].x > 90 && quads[i].y > 40);
+    }
+
+    // the unblurred rectangle covers exactly its area
+    BOOST_CHECK_EQUAL(quads[30].x, 102);
+    BOOST_CHECK_EQUAL(quads[30].y, 80);
+    BOOST_CHECK_EQUAL(quads[30].w, 200);
+    BOOST_CHECK_EQUAL(quads[30].h, 1);
+
+    // drawing the same layout again doesn't change the atlas
+    d.showLayout(l, 100*64, 50*64, STLL::SUBP_NONE, [&](const STLL::DrawBatch_c & b) {
+      BOOST_CHECK(!b.pages[0].resized);
+      BOOST_CHECK(b.pages[0].dirty.empty());
+      BOOST_CHECK_EQUAL(b.pages[0].id, t.ids[0]);
+      BOOST_CHECK(t.update(b));
+      BOOST_CHECK_EQUAL(b.quads.size(), quads.size());
+    });
+
+    // sub pixel output adds new images, those must be reported as dirty regions
+    d.showLayout(l, 100*64, 50*64, STLL::SUBP_RGB, [&](const STLL::DrawBatch_c & b) {
+      BOOST_CHECK(!b.pages[0].dirty.empty() || b.pages[0].resized);
+      BOOST_CHECK(t.update(b));
+
+      for (auto & q : b.quads)
+        if (q.subpixel)
+          BOOST_CHECK_CLOSE(q.w*3, q.tw, 0.0001);
+    });
+  }
+
+  {
+    // a small atlas with a single page that can not hold all images at once, the layout has to be split
+    auto l2 = drawListLayout(400);
+
+    STLL::showDrawList<> d(128, 128, 1);
+    DrawListTexture_c t;
+    size_t quads = 0;
+    int batches = 0;
+    uint32_t lastId = 0;
+
+    d.showLayout(l2, 0, 0, STLL::SUBP_NONE, [&](const STLL::DrawBatch_c & b) {
+      BOOST_CHECK_EQUAL(b.pages.size(), 1);
+      BOOST_CHECK(b.pages[0].id != lastId);
+      lastId = b.pages[0].id;
+      BOOST_CHECK(t.update(b));
+      quads += b.quads.size();
+      batches++;
+    });
+
+    BOOST_CHECK(batches > 1);
+    BOOST_CHECK_EQUAL(quads, l2.getData().size());
+
+    // with enough pages the same layout goes into one batch and stays in the atlas
+    STLL::showDrawList<> d2(128, 128, 8);
+    DrawListTexture_c t2;
+    batches = 0;
+
+    for (int i = 0; i < 2; i++)
+      d2.showLayout(l2, 0, 0, STLL::SUBP_NONE, [&](const STLL::DrawBatch_c & b) {
+        BOOST_CHECK(b.pages.size() > 1);
+        BOOST_CHECK(t2.update(b));
+        BOOST_CHECK_EQUAL(b.quads.size(), l2.getData().size());
+
+        for (auto & p : b.pages)
+          BOOST_CHECK(i == 0 || (!p.resized && p.dirty.empty()));
+
+        batches++;
+      });
+
+    BOOST_CHECK_EQUAL(batches, 2);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( Paged_Atlas )
+{
+  STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+  STLL::internal::PagedGlyphAtlas_c a(64, 64, 3);
+
+  // a glyph that is used in every batch must never be evicted, while many other
+  // glyphs come and go
+  auto g = a.getGlyph(f, 36, STLL::SUBP_NONE, 0).value();
+  auto id = a.pageId(g.page);
+
+  for (int i = 37; i < 400; i++)
+  {
+    a.nextBatch();
+    BOOST_CHECK(a.getGlyph(f, 36, STLL::SUBP_NONE, 0));
+    BOOST_CHECK(a.getGlyph(f, i, STLL::SUBP_NONE, 3*64));
+  }
+
+  BOOST_CHECK_EQUAL(a.pageCount(), 3);
+  BOOST_CHECK_EQUAL(a.pageId(g.page), id);
+
+  auto g2 = a.getGlyph(f, 36, STLL::SUBP_NONE, 0).value();
+  BOOST_CHECK_EQUAL(g2.page, g.page);
+  BOOST_CHECK_EQUAL(g2.pos_x, g.pos_x);
+  BOOST_CHECK_EQUAL(g2.pos_y, g.pos_y);
+
+  // within one batch nothing is evicted, adding fails once all pages are full and
+  // all glyphs of the batch stay where they are
+  a.nextBatch();
+
+  std::vector<std::tuple<int, STLL::internal::FontAtlasData_c, uint32_t>> batch;
+  std::vector<uint32_t> ids { a.pageId(0), a.pageId(1), a.pageId(2) };
+  int i = 1000;
+
+  while (true)
+  {
+    auto gl = a.getGlyph(f, i, STLL::SUBP_NONE, 3*64);
+    if (!gl) break;
+    batch.push_back(std::make_tuple(i, gl.value(), a.pageId(gl.value().page)));
+    i++;
+  }
+
+  BOOST_CHECK(!batch.empty());
+
+  for (auto & b : batch)
+  {
+    auto gl = a.getGlyph(f, std::get<0>(b), STLL::SUBP_NONE, 3*64).value();
+    BOOST_CHECK_EQUAL(gl.page, std::get<1>(b).page);
+    BOOST_CHECK_EQUAL(gl.pos_x, std::get<1>(b).pos_x);
+    BOOST_CHECK_EQUAL(gl.pos_y, std::get<1>(b).pos_y);
+    BOOST_CHECK_EQUAL(a.pageId(gl.page), std::get<2>(b));
+  }
+
+  // pages that were in use before the batch started have been reused
+  BOOST_CHECK(a.pageId(0) != ids[0] || a.pageId(1) != ids[1] || a.pageId(2) != ids[2]);
+
+  // a pinned page is kept even when it is not used any more, once unpinned it is reused
+  a.nextBatch();
+  g = a.getGlyph(f, 36, STLL::SUBP_NONE, 0).value();
+  id = a.pageId(g.page);
+  a.pin(g.page);
+
+  for (int i = 37; i < 400; i++)
+  {
+    a.nextBatch();
+    a.getGlyph(f, i, STLL::SUBP_NONE, 3*64);
+  }
+
+  BOOST_CHECK_EQUAL(a.pageId(g.page), id);
+
+  a.unpin(g.page, id);
+
+  for (int i = 400; i < 800; i++)
+  {
+    a.nextBatch();
+    a.getGlyph(f, i, STLL::SUBP_NONE, 3*64);
+  }
+
+  BOOST_CHECK(a.pageId(g.page) != id);
+}
+
+BOOST_AUTO_TEST_CASE( Atlas_Snapshot )
+{
+  std::vector<STLL::internal::FontAtlasData_c> pos;
+  std::vector<std::vector<uint8_t>> pixels;
+  uint32_t pages;
+
+  {
+    STLL::FontCache_c fc;
+    auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+    STLL::internal::PagedGlyphAtlas_c a(64, 128, 3);
+
+    for (int i = 36; i < 200; i++)
+      pos.push_back(a.getGlyph(f, i, STLL::SUBP_NONE, i%5 ? 0 : 2*64).value());
+
+    pos.push_back(a.getRect(10*64, 3*64, STLL::SUBP_NONE, 64).value());
+
+    pages = a.pageCount();
+    BOOST_CHECK(pages > 1);
+
+    for (uint32_t p = 0; p < pages; p++)
+      pixels.emplace_back(a.page(p).getData(), a.page(p).getData()+a.width()*a.height());
+
+    BOOST_CHECK(a.save("atlas.tmp"));
+  }
+
+  // load the same font from memory with a new font cache, the font is recognized
+  // by its content and all images are taken from the file without rendering anything
+  std::ifstream in("tests/FreeSans.ttf", std::ios::binary | std::ios::ate);
+  size_t size = in.tellg();
+  std::shared_ptr<uint8_t> data(new uint8_t[size], std::default_delete<uint8_t[]>());
+  in.seekg(0);
+  in.read((char*)data.get(), size);
+
+  STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c(data, size, "FreeSans"), 16*64);
+
+  STLL::internal::PagedGlyphAtlas_c a(64, 128, 3);
+  BOOST_REQUIRE(a.load("atlas.tmp"));
+  BOOST_REQUIRE_EQUAL(a.pageCount(), pages);
+
+  std::vector<uint32_t> versions;
+
+  for (uint32_t p = 0; p < pages; p++)
+  {
+    BOOST_CHECK(a.page(p).isResized());
+    BOOST_CHECK(memcmp(a.page(p).getData(), pixels[p].data(), pixels[p].size()) == 0);
+    versions.push_back(a.page(p).getVersion());
+  }
+
+  for (int i = 36; i < 200; i++)
+  {
+    auto g = a.getGlyph(f, i, STLL::SUBP_NONE, i%5 ? 0 : 2*64).value();
+    BOOST_CHECK_EQUAL(g.page, pos[i-36].page);
+    BOOST_CHECK_EQUAL(g.pos_x, pos[i-36].pos_x);
+    BOOST_CHECK_EQUAL(g.pos_y, pos[i-36].pos_y);
+    BOOST_CHECK_EQUAL(g.left, pos[i-36].left);
+    BOOST_CHECK_EQUAL(g.top, pos[i-36].top);
+  }
+
+  auto r = a.getRect(10*64, 3*64, STLL::SUBP_NONE, 64).value();
+  BOOST_CHECK_EQUAL(r.pos_x, pos.back().pos_x);
+  BOOST_CHECK_EQUAL(r.pos_y, pos.back().pos_y);
+
+  for (uint32_t p = 0; p < pages; p++)
+    BOOST_CHECK_EQUAL(a.page(p).getVersion(), versions[p]);
+
+  // a different size of the same font is not in the file, so it is rendered
+  BOOST_CHECK(a.getGlyph(fc.getFont(STLL::internal::FontFileResource_c(data, size, "FreeSans"), 17*64), 36, STLL::SUBP_NONE, 0));
+
+  bool changed = false;
+  for (uint32_t p = 0; p < pages; p++)
+    changed |= a.page(p).getVersion() != versions[p];
+
+  BOOST_CHECK(changed);
+
+  // the file can not be used for a distance field atlas or an atlas with too few pages
+  STLL::internal::PagedGlyphAtlas_c b(64, 128, 3, 64);
+  BOOST_CHECK(!b.load("atlas.tmp"));
+
+  STLL::internal::PagedGlyphAtlas_c c(64, 128, 1);
+  BOOST_CHECK(!c.load("atlas.tmp"));
+
+  BOOST_CHECK(!a.load("tests/FreeSans.ttf"));
+  BOOST_CHECK(!a.load("atlas.nonexisting"));
+
+  std::remove("atlas.tmp");
+}
+
+BOOST_AUTO_TEST_CASE( Atlas_Dirty_Regions )
+{
+  STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+  STLL::internal::GlyphAtlas_c a(256, 256);
+
+  // a new atlas needs to be uploaded completely
+  BOOST_CHECK(a.isResized());
+  a.getGlyph(f, 40, STLL::SUBP_NONE, 0);
+  a.resetDirty();
+
+  BOOST_CHECK(!a.isResized());
+  BOOST_CHECK(a.getDirtyRegions().empty());
+
+  // a glyph that is already there doesn't change anything
+  a.getGlyph(f, 40, STLL::SUBP_NONE, 0);
+  BOOST_CHECK(a.getDirtyRegions().empty());
+
+  // one new glyph only requires its own area to be uploaded
+  auto g = a.getGlyph(f, 41, STLL::SUBP_NONE, 0).value();
+  BOOST_REQUIRE_EQUAL(a.getDirtyRegions().size(), 1);
+  BOOST_CHECK_EQUAL(a.getDirtyRegions()[0].x, g.pos_x);
+  BOOST_CHECK_EQUAL(a.getDirtyRegions()[0].y, g.pos_y);
+  BOOST_CHECK_EQUAL(a.getDirtyRegions()[0].w, g.width);
+  BOOST_CHECK_EQUAL(a.getDirtyRegions()[0].h, g.rows);
+  BOOST_CHECK(!a.isResized());
+
+  // many glyphs are merged into a few regions that contain all of them
+  std::vector<STLL::internal::FontAtlasData_c> glyphs;
+  for (int i = 50; i < 150; i++)
+    glyphs.push_back(a.getGlyph(f, i, STLL::SUBP_NONE, 0).value());
+
+  BOOST_CHECK(a.getDirtyRegions().size() <= 16);
+
+  for (auto & gl : glyphs)
+    BOOST_CHECK(std::any_of(a.getDirtyRegions().begin(), a.getDirtyRegions().end(),
+                            [&gl](const STLL::internal::AtlasRegion_c & r) {
+      return r.x <= gl.pos_x && r.y <= gl.pos_y && r.x+r.w >= gl.pos_x+gl.width && r.y+r.h >= gl.pos_y+gl.rows;
+    }));
+
+  size_t area = 0;
+  for (auto & r : a.getDirtyRegions())
+    area += r.w*r.h;
+
+  BOOST_CHECK(area < 256*256);
+
+  // growing requires a complete upload
+  a.resetDirty();
+  a.doubleSize();
+  BOOST_CHECK(a.isResized());
+}
+
+// check that the rectangles placed on the area don't overlap and are within the area
+class PackerArea_c
+{
+  public:
+    uint32_t w, h;
+    std::vector<uint8_t> used;
+
+    PackerArea_c(uint32_t width, uint32_t height) : w(width), h(height), used(width*height) { }
+
+    bool mark(uint32_t x, uint32_t y, uint32_t rw, uint32_t rh, uint8_t val)
+    {
+      if (x+rw+1 > w || y+rh+1 > h) return false;
+
+      for (uint32_t yy = y; yy < y+rh; yy++)
+        for (uint32_t xx = x; xx < x+rw; xx++)
+        {
+          if ((used[yy*w+xx] != 0) == (val != 0)) return false;
+          used[yy*w+xx] = val;
+        }
+
+      return true;
+    }
+};
+
+BOOST_AUTO_TEST_CASE( Rectangle_Packer )
+{
+  for (int seed = 1; seed < 4; seed++)
+  {
+    // random sizes as they would appear with glyphs
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> wd(4, 30), hd(8, 40);
+    std::vector<std::array<uint32_t, 2>> sizes;
+
+    for (int i = 0; i < 6000; i++)
+      sizes.push_back(std::array<uint32_t, 2>{(uint32_t)wd(rng), (uint32_t)hd(rng)});
+
+    STLL::internal::RectanglePacker_c sky(1024, 1024);
+    STLL::internal::ShelfPacker_c shelf(1024, 1024);
+    PackerArea_c a(1024, 1024);
+
+    size_t skyArea = 0;
+    size_t shelfArea = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (auto & s : sizes)
+      if (sky.allocate(s[0], s[1]))
+        skyArea += s[0]*s[1];
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::vector<std::array<uint32_t, 4>> placed;
+
+    for (auto & s : sizes)
+    {
+      auto p = shelf.allocate(s[0], s[1]);
+
+      if (p)
+      {
+        placed.push_back(std::array<uint32_t, 4>{p.value()[0], p.value()[1], s[0], s[1]});
+        shelfArea += s[0]*s[1];
+      }
+    }
+
+    auto t2 = std::chrono::steady_clock::now();
+
+    for (auto & p : placed)
+      BOOST_CHECK(a.mark(p[0], p[1], p[2], p[3], 1));
+
+    // the shelf packer fills at least as much of the area as the skyline packer and it
+    // doesn't need to test every position, so it is faster
+    BOOST_CHECK_GE(shelfArea, skyArea);
+    BOOST_CHECK_GT(shelfArea, 1024*1024*9/10);
+    BOOST_CHECK((t2-t1).count() < (t1-t0).count());
+
+    // release random rectangles and allocate new ones for a while, the released space must
+    // be reused and the rectangles must never overlap
+    for (int round = 0; round < 5; round++)
+    {
+      std::shuffle(placed.begin(), placed.end(), rng);
+
+      size_t released = 0;
+
+      for (size_t i = 0; i < placed.size()/3; i++)
+      {
+        auto & p = placed[i];
+        shelf.deallocate(p[0], p[1], p[2], p[3]);
+        BOOST_CHECK(a.mark(p[0], p[1], p[2], p[3], 0));
+        released += p[2]*p[3];
+      }
+
+      placed.erase(placed.begin(), placed.begin()+placed.size()/3);
+
+      size_t refill = 0;
+
+      for (auto & s : sizes)
+      {
+        auto p = shelf.allocate(s[0], s[1]);
+
+        if (p)
+        {
+          BOOST_CHECK(a.mark(p.value()[0], p.value()[1], s[0], s[1], 1));
+          placed.push_back(std::array<uint32_t, 4>{p.value()[0], p.value()[1], s[0], s[1]});
+          refill += s[0]*s[1];
+        }
+      }
+
+      BOOST_CHECK_GT(refill, released*3/4);
+    }
+
+    // once everything is released, the whole area is available again
+    for (auto & p : placed)
+      shelf.deallocate(p[0], p[1], p[2], p[3]);
+
+    BOOST_CHECK(shelf.allocate(1022, 1021));
+  }
+
+  // growing the area makes room on the existing shelves as well as on new ones
+  STLL::internal::ShelfPacker_c shelf(64, 64);
+  int count = 0;
+
+  while (shelf.allocate(20, 10)) count++;
+
+  BOOST_CHECK_EQUAL(count, 18);
+
+  shelf.doubleSize();
+  BOOST_CHECK(shelf.allocate(20, 10));
+  BOOST_CHECK(shelf.allocate(120, 50));
+}
+
+BOOST_AUTO_TEST_CASE( Distance_Field )
+{
+  // an anti aliased disc
+  const int w = 40, h = 40, spread = 4;
+  const double cx = 19.3, cy = 20.6, rad = 12.2;
+
+  std::vector<uint8_t> img(w*h);
+
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+    {
+      int cnt = 0;
+
+      for (int sy = 0; sy < 16; sy++)
+        for (int sx = 0; sx < 16; sx++)
+          if (std::hypot(x+(sx+0.5)/16-cx, y+(sy+0.5)/16-cy) < rad)
+            cnt++;
+
+      img[y*w+x] = (cnt*255+128)/256;
+    }
+
+  const int fw = w+2*spread, fh = h+2*spread;
+  std::vector<uint8_t> field(fw*fh);
+
+  STLL::internal::distanceField(img.data(), w, w, h, field.data(), fw, spread);
+
+  // the field must contain the distance to the circle, clamped to the spread, the
+  // distances are measured from pixel centres, so they are not exact
+  double maxErr = 0;
+
+  for (int y = 0; y < fh; y++)
+    for (int x = 0; x < fw; x++)
+    {
+      double d = rad - std::hypot(x-spread+0.5-cx, y-spread+0.5-cy);
+      double v = STLL::internal::distanceFieldEdge + std::max(-1.0*spread, std::min(1.0*spread, d))*127/spread;
+
+      maxErr = std::max(maxErr, std::abs(field[y*fw+x]-std::max(0.0, std::min(255.0, v)))*spread/127);
+    }
+
+  BOOST_CHECK(maxErr < 0.75);
+
+  // drawing the field at its original size gives back the coverage
+  int maxDiff = 0;
+
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+    {
+      int c = STLL::internal::distanceFieldCoverage(field[(y+spread)*fw+x+spread], spread, 1, 1);
+      maxDiff = std::max(maxDiff, std::abs(c-img[y*w+x]));
+    }
+
+  BOOST_CHECK(maxDiff < 8);
+
+  // in distance field mode all sizes of a font share the same image
+  STLL::FontCache_c fc;
+  auto f16 = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+  auto f40 = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 40*64);
+
+  STLL::internal::PagedGlyphAtlas_c a(256, 256, 1, 64);
+
+  auto g16 = a.getGlyph(f16, 40, STLL::SUBP_NONE, 0).value();
+  auto g40 = a.getGlyph(f40, 40, STLL::SUBP_RGB, 64).value();
+
+  BOOST_CHECK_EQUAL(g16.pos_x, g40.pos_x);
+  BOOST_CHECK_EQUAL(g16.pos_y, g40.pos_y);
+  BOOST_CHECK_EQUAL(a.distanceSpread(), 8);
+  BOOST_CHECK_CLOSE(a.distanceScale(f40), 40.0/64, 0.001);
+
+  // the image covers the glyph at reference size plus the spread
+  auto ref = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 64*64)->renderGlyph(40, STLL::SUBP_NONE);
+
+  BOOST_CHECK_EQUAL(g16.width, ref.w+2*8+1);
+  BOOST_CHECK_EQUAL(g16.rows, ref.h+2*8+1);
+  BOOST_CHECK_EQUAL(g16.left, ref.left-8);
+  BOOST_CHECK_EQUAL(g16.top, ref.top+8);
+
+  // blurr that is too wide for the field at this size gets a normal image
+  BOOST_CHECK(a.isDistanceField(f40, 5*64));
+  BOOST_CHECK(!a.isDistanceField(f16, 3*64));
+
+  auto b16 = a.getGlyph(f16, 40, STLL::SUBP_NONE, 3*64).value();
+  BOOST_CHECK(b16.pos_x != g16.pos_x || b16.pos_y != g16.pos_y);
+
+  // without distance fields each size gets its own image
+  STLL::internal::PagedGlyphAtlas_c n(256, 256, 1);
+
+  auto n16 = n.getGlyph(f16, 40, STLL::SUBP_NONE, 0).value();
+  auto n40 = n.getGlyph(f40, 40, STLL::SUBP_NONE, 0).value();
+
+  BOOST_CHECK(n16.pos_x != n40.pos_x || n16.pos_y != n40.pos_y);
+}
+
+BOOST_AUTO_TEST_CASE( OpenGL_Vertices )
+{
+  STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+  STLL::internal::PagedGlyphAtlas_c a(256, 256, 2);
+  STLL::internal::GammaNone_c g;
+
+  STLL::TextLayout_c l;
+  l.addCommand(10*64, 20*64, 30*64, 5*64, STLL::Color_c(255, 0, 0), 0);
+  l.addCommand(f, 40, 12*64+16, 40*64, STLL::Color_c(0, 0, 255), 0);
+  l.addCommand(std::string("img"), 64, 64, 640, 640);
+
+  const auto & dat = l.getData();
+  BOOST_REQUIRE_EQUAL(a.prepare(dat, 0, STLL::SUBP_NONE), dat.size());
+
+  auto rect = a.getFilledRect().value();
+  auto glyph = a.getGlyph(f, 40, STLL::SUBP_NONE, 0).value();
+  float C = a.width();
+
+  // OpenGL 2, 4 vertices per quad, the page run contains the page number as no textures are given
+  {
+    typedef STLL::internal::VertexPreparation_c<2, STLL::internal::GammaNone_c> Prep_c;
+
+    Prep_c prep(a, g);
+    Prep_c::Buffer_c vb(dat.size());
+    uint32_t page = UINT32_MAX;
+    std::vector<std::pair<uint32_t, uint32_t>> used;
+    std::vector<std::string> images;
+
+    prep.addCommands(vb, dat, 0, dat.size(), STLL::SUBP_NONE, page, nullptr, &used,
+                     [&images](const STLL::CommandData_c & c) { images.push_back(c.imageURL); });
+
+    BOOST_CHECK(images == std::vector<std::string>{ "img" });
+    BOOST_REQUIRE_EQUAL(used.size(), 1);
+    BOOST_CHECK_EQUAL(used[0].first, 0);
+    BOOST_CHECK_EQUAL(used[0].second, a.pageId(0));
+    BOOST_REQUIRE_EQUAL(vb.runs.size(), 1);
+    BOOST_CHECK_EQUAL(vb.runs[0].texture, 0);
+    BOOST_CHECK_EQUAL(vb.runs[0].first, 0);
+    BOOST_REQUIRE_EQUAL(vb.vb.size(), 8);
+
+    // corners in the order top left, top right, bottom right, bottom left
+    auto check = [&vb](size_t q, float x1, float x2, float y1, float y2, float u1, float u2, float v1, float v2) {
+      std::array<float, 4> x { x1, x2, x2, x1 }, y { y1, y1, y2, y2 };
+      std::array<float, 4> u { u1, u2, u2, u1 }, v { v1, v1, v2, v2 };
+
+      for (size_t i = 0; i < 4; i++)
+      {
+        auto & vx = vb.vb[4*q+i];
+        BOOST_CHECK_CLOSE(vx.x, x[i], 1e-4);
+        BOOST_CHECK_CLOSE(vx.y, y[i], 1e-4);
+        BOOST_CHECK_CLOSE(vx.u, u[i], 1e-4);
+        BOOST_CHECK_CLOSE(vx.v, v[i], 1e-4);
+      }
+    };
+
+    // the rectangle samples the inside of the filled rectangle in the atlas
+    check(0, 10, 40, 20, 25, (rect.pos_x+5)/C, (rect.pos_x+rect.width-5)/C, (rect.pos_y+5)/C, (rect.pos_y+rect.rows-5)/C);
+
+    // the glyph is placed at the pen position and maps one texel to one pixel
+    float gx = 12.25+glyph.left;
+    float gy = 40-glyph.top;
+    check(1, gx, gx+glyph.width, gy, gy+glyph.rows,
+          glyph.pos_x/C, (glyph.pos_x+glyph.width)/C, glyph.pos_y/C, (glyph.pos_y+glyph.rows)/C);
+
+    BOOST_CHECK_EQUAL(vb.vb[0].r, 255);
+    BOOST_CHECK_EQUAL(vb.vb[0].b, 0);
+    BOOST_CHECK_EQUAL(vb.vb[4].r, 0);
+    BOOST_CHECK_EQUAL(vb.vb[4].b, 255);
+
+    // with textures the runs get the texture of the page
+    Prep_c::Buffer_c vb2(dat.size());
+    std::vector<GLuint> textures { 17, 18 };
+    page = UINT32_MAX;
+
+    prep.addCommands(vb2, dat, 0, dat.size(), STLL::SUBP_NONE, page, &textures, nullptr, [](const STLL::CommandData_c &) {});
+
+    BOOST_REQUIRE_EQUAL(vb2.runs.size(), 1);
+    BOOST_CHECK_EQUAL(vb2.runs[0].texture, 17);
+  }
+
+  // OpenGL 3, one instance per quad with position, size and texture rectangle
+  {
+    typedef STLL::internal::VertexPreparation_c<3, STLL::internal::GammaNone_c> Prep_c;
+
+    Prep_c prep(a, g);
+    Prep_c::Buffer_c vb(dat.size());
+    uint32_t page = UINT32_MAX;
+
+    prep.addCommands(vb, dat, 0, dat.size(), STLL::SUBP_NONE, page, nullptr, nullptr, [](const STLL::CommandData_c &) {});
+
+    BOOST_REQUIRE_EQUAL(vb.runs.size(), 1);
+    BOOST_REQUIRE_EQUAL(vb.vb.size(), 2);
+
+    auto & r = vb.vb[0];
+    BOOST_CHECK_CLOSE(r.x, 10, 1e-4);
+    BOOST_CHECK_CLOSE(r.y, 20, 1e-4);
+    BOOST_CHECK_CLOSE(r.w, 30, 1e-4);
+    BOOST_CHECK_CLOSE(r.h, 5, 1e-4);
+    BOOST_CHECK_CLOSE(r.u, (rect.pos_x+5)/C, 1e-4);
+    BOOST_CHECK_CLOSE(r.v, (rect.pos_y+5)/C, 1e-4);
+
+    auto & gl = vb.vb[1];
+    BOOST_CHECK_CLOSE(gl.x, 12.25+glyph.left, 1e-4);
+    BOOST_CHECK_CLOSE(gl.y, 40-glyph.top, 1e-4);
+    BOOST_CHECK_CLOSE(gl.w, glyph.width, 1e-4);
+    BOOST_CHECK_CLOSE(gl.h, glyph.rows, 1e-4);
+    BOOST_CHECK_CLOSE(gl.u, glyph.pos_x/C, 1e-4);
+    BOOST_CHECK_CLOSE(gl.v, glyph.pos_y/C, 1e-4);
+    BOOST_CHECK_CLOSE(gl.tw*C, glyph.width, 1e-4);
+    BOOST_CHECK_CLOSE(gl.th*C, glyph.rows, 1e-4);
+    BOOST_CHECK_EQUAL(gl.field, 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( OpenGL_Frame_Clip )
+{
+  STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+  STLL::internal::PagedGlyphAtlas_c a(256, 256, 2);
+  STLL::internal::GammaNone_c g;
+
+  STLL::TextLayout_c l;
+  l.addCommand(10*64, 20*64, 30*64, 5*64, STLL::Color_c(255, 0, 0), 0);
+  l.addCommand(f, 40, 50*64, 40*64, STLL::Color_c(0, 0, 255), 0);
+
+  const auto & dat = l.getData();
+  BOOST_REQUIRE_EQUAL(a.prepare(dat, 0, STLL::SUBP_NONE), dat.size());
+
+  auto rect = a.getFilledRect().value();
+  auto glyph = a.getGlyph(f, 40, STLL::SUBP_NONE, 0).value();
+  float C = a.width();
+
+  // collect the layout three times into one frame buffer the way showOpenGL::addLayout does,
+  // each time with its own offset and clip rectangle
+  typedef STLL::internal::VertexPreparation_c<2, STLL::internal::GammaNone_c> Prep_c;
+
+  Prep_c prep(a, g);
+  Prep_c::Buffer_c frame(3*dat.size());
+  uint32_t page = UINT32_MAX;
+  auto noImages = [](const STLL::CommandData_c &) {};
+
+  // the right part of the rectangle and the whole glyph are cut away
+  Prep_c::setClip(frame, 0, 0, 0, 0, 25, 100);
+  prep.addCommands(frame, dat, 0, dat.size(), STLL::SUBP_NONE, page, nullptr, nullptr, noImages);
+
+  // moved, the top of the rectangle is cut away, the glyph is complete
+  Prep_c::setClip(frame, 100*64, 50*64, 105, 72, 100, 100);
+  prep.addCommands(frame, dat, 0, dat.size(), STLL::SUBP_NONE, page, nullptr, nullptr, noImages);
+
+  // completely outside of the clip rectangle
+  Prep_c::setClip(frame, 0, 200*64, 0, 0, 500, 100);
+  prep.addCommands(frame, dat, 0, dat.size(), STLL::SUBP_NONE, page, nullptr, nullptr, noImages);
+
+  // all quads use the same atlas page, so the frame is one draw call
+  BOOST_REQUIRE_EQUAL(frame.runs.size(), 1);
+  BOOST_CHECK_EQUAL(frame.runs[0].first, 0);
+  BOOST_REQUIRE_EQUAL(frame.vb.size(), 12);
+
+  auto check = [&frame](size_t q, float x1, float x2, float y1, float y2, float u1, float u2, float v1, float v2) {
+    std::array<float, 4> x { x1, x2, x2, x1 }, y { y1, y1, y2, y2 };
+    std::array<float, 4> u { u1, u2, u2, u1 }, v { v1, v1, v2, v2 };
+
+    for (size_t i = 0; i < 4; i++)
+    {
+      auto & vx = frame.vb[4*q+i];
+      BOOST_CHECK_CLOSE(vx.x, x[i], 1e-4);
+      BOOST_CHECK_CLOSE(vx.y, y[i], 1e-4);
+      BOOST_CHECK_CLOSE(vx.u, u[i], 1e-4);
+      BOOST_CHECK_CLOSE(vx.v, v[i], 1e-4);
+    }
+  };
+
+  float u1 = (rect.pos_x+5)/C, u2 = (rect.pos_x+rect.width-5)/C;
+  float v1 = (rect.pos_y+5)/C, v2 = (rect.pos_y+rect.rows-5)/C;
+
+  // the texture coordinates are cut together with the quad: half of the width, two fifth of the height
+  check(0, 10, 25, 20, 25, u1, u1+(u2-u1)/2, v1, v2);
+  check(1, 110, 140, 72, 75, u1, u2, v1+(v2-v1)*2/5, v2);
+
+  float gx = 150+glyph.left;
+  float gy = 90-glyph.top;
+  check(2, gx, gx+glyph.width, gy, gy+glyph.rows,
+        glyph.pos_x/C, (glyph.pos_x+glyph.width)/C, glyph.pos_y/C, (glyph.pos_y+glyph.rows)/C);
+
+  BOOST_CHECK_EQUAL(frame.vb[8].b, 255);
+}
+
+BOOST_AUTO_TEST_CASE( Slab_Allocator )
+{
+  using STLL::internal::SlabAllocator_c;
+
+  // size classes around the first powers of 2
+  BOOST_CHECK_EQUAL(SlabAllocator_c::sizeClass(1), 0);
+  BOOST_CHECK_EQUAL(SlabAllocator_c::sizeClass(64), 0);
+  BOOST_CHECK_EQUAL(SlabAllocator_c::sizeClass(65), 1);
+  BOOST_CHECK_EQUAL(SlabAllocator_c::sizeClass(128), 4);
+  BOOST_CHECK_EQUAL(SlabAllocator_c::sizeClass(129), 5);
+
+  BOOST_CHECK_EQUAL(SlabAllocator_c::classSize(0), 64);
+  BOOST_CHECK_EQUAL(SlabAllocator_c::classSize(1), 80);
+  BOOST_CHECK_EQUAL(SlabAllocator_c::classSize(4), 128);
+  BOOST_CHECK_EQUAL(SlabAllocator_c::classSize(5), 160);
+
+  // each size fits into its class, but not into the class before
+  int wrong = 0;
+  for (size_t s = 1; s < 100000; s++)
+  {
+    uint32_t sc = SlabAllocator_c::sizeClass(s);
+    if (SlabAllocator_c::classSize(sc) < s || (sc > 0 && SlabAllocator_c::classSize(sc-1) >= s))
+      wrong++;
+  }
+  BOOST_CHECK_EQUAL(wrong, 0);
+
+  SlabAllocator_c a;
+
+  // empty blocks don't use a slot
+  auto z = a.allocate(0);
+  BOOST_CHECK(z.first == nullptr);
+  BOOST_CHECK_EQUAL(a.capacity(), 0);
+  a.free(z.first, z.second);
+
+  // freed slots are reused and cleared again
+  auto b1 = a.allocate(100);
+  auto b2 = a.allocate(100);
+  BOOST_CHECK_EQUAL(b1.second, b2.second);
+  BOOST_CHECK_EQUAL(b2.first-b1.first, 112);
+
+  memset(b1.first, 0xAA, 100);
+  a.free(b1.first, b1.second);
+
+  auto b3 = a.allocate(100);
+  BOOST_CHECK(b3.first == b1.first);
+  BOOST_CHECK(std::all_of(b3.first, b3.first+100, [](uint8_t v) { return v == 0; }));
+
+  const size_t slab = a.capacity();
+  BOOST_CHECK_EQUAL(slab, (65536/112)*112);
+
+  // fill a second slab, when everything is freed again the first empty slab
+  // is kept as a spare and the second one is released
+  std::vector<std::pair<uint8_t *, uint32_t>> blocks { b2, b3 };
+  while (blocks.size() < 2*(65536/112))
+    blocks.push_back(a.allocate(100));
+
+  BOOST_CHECK_EQUAL(a.capacity(), 2*slab);
+
+  for (auto & b : blocks)
+    a.free(b.first, b.second);
+
+  BOOST_CHECK_EQUAL(a.capacity(), slab);
+
+  // the spare is used for the next block
+  auto b4 = a.allocate(100);
+  BOOST_CHECK_EQUAL(a.capacity(), slab);
+
+  // big blocks get a slab of their own that is just as big as the block
+  // and that is released, when the block is freed
+  auto big = a.allocate(20000);
+  BOOST_CHECK(big.second != b4.second);
+  BOOST_CHECK_EQUAL(a.capacity(), slab+20000);
+
+  auto big2 = a.allocate(20001);
+  BOOST_CHECK(big2.second != big.second);
+  BOOST_CHECK_EQUAL(a.capacity(), slab+40001);
+
+  a.free(big.first, big.second);
+  a.free(big2.first, big2.second);
+  BOOST_CHECK_EQUAL(a.capacity(), slab);
+
+  a.free(b4.first, b4.second);
+  BOOST_CHECK_EQUAL(a.capacity(), slab);
+}
+
+BOOST_AUTO_TEST_CASE( Compressed_Glyph_Cache )
+{
+  static STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 48*64);
+
+  // big glyphs and rectangles, sharp and blurred, so that many images are big enough
+  // for the span encoding, some of them overlap
+  STLL::TextLayout_c l;
+
+  for (int i = 0; i < 12; i++)
+    l.addCommand(f, 36+i, 3*64+i*25*64+i*9, 50*64+(i%3)*21, STLL::Color_c(i*20, 255-i*20, 128, 255-i*10), (i%3)*3*64);
+
+  l.addCommand(10*64+13, 60*64+5, 120*64, 20*64, STLL::Color_c(40, 80, 200), 4*64);
+  l.addCommand(150*64+40, 55*64, 60*64+17, 30*64, STLL::Color_c(200, 200, 20, 128), 2*64);
+
+  const int w = 320, h = 100;
+
+  STLL::internal::Gamma_c<> g;
+  g.setGamma(22);
+
+  auto bl = [&g](int a1, int a2, int b1, int b2, int c) { return STLL::internal::blend(a1, a2, b1, b2, c, g); };
+  auto get = [](const uint8_t * p) { return std::make_tuple(p[0], p[1], p[2]); };
+  auto put = [](uint8_t * p, uint8_t r, uint8_t g, uint8_t b) { p[0] = r; p[1] = g; p[2] = b; };
+
+  // draw the layout with the colour blitters, with and without a clip rectangle
+  auto draw = [&](STLL::internal::GlyphCache_c & cache, STLL::SubPixelArrangement sp, int cx, int cy, int cw, int ch) {
+    std::vector<uint8_t> rgb(3*w*h, 255);
+
+    for (auto & i : l.getData())
+    {
+      auto & img = i.command == STLL::CommandData_c::CMD_GLYPH ? cache.getGlyph(i.font, i.glyphIndex, sp, i.blurr)
+                                                              : cache.getRect(i.w, i.h, sp, i.blurr);
+      auto c = g.forward(i.c);
+
+      if (sp == STLL::SUBP_NONE)
+        STLL::internal::outputGlyph_NONE(i.x, i.y, img, c, rgb.data(), 3*w, 3, w, h, get, put, bl, cx, cy, cw, ch);
+      else
+        STLL::internal::outputGlyph_HorizontalRGB(i.x, i.y, img, c.r(), c.g(), c.b(), c.a(), rgb.data(), 3*w, 3, w, h,
+                                                  get, put, bl, cx, cy, cw, ch);
+    }
+
+    return rgb;
+  };
+
+  for (auto sp : { STLL::SUBP_NONE, STLL::SUBP_RGB })
+  {
+    STLL::internal::GlyphCache_c plain, compressed;
+    compressed.setCompression(true);
+
+    auto a = draw(plain, sp, 0, 0, w, h);
+    auto b = draw(compressed, sp, 0, 0, w, h);
+
+    BOOST_CHECK(std::count(a.begin(), a.end(), 255) < 3*w*h*3/4);
+    BOOST_CHECK(a == b);
+
+    a = draw(plain, sp, 37, 11, 170, 53);
+    b = draw(compressed, sp, 37, 11, 170, 53);
+
+    BOOST_CHECK(a == b);
+
+    // make sure that the compressed images were actually used
+    int spans = 0;
+    for (auto & i : l.getData())
+      if (i.command == STLL::CommandData_c::CMD_GLYPH)
+        spans += compressed.getGlyph(i.font, i.glyphIndex, sp, i.blurr).spans;
+      else
+        spans += compressed.getRect(i.w, i.h, sp, i.blurr).spans;
+
+    BOOST_CHECK(spans > 0);
+  }
+
+  // the same for the grey output
+  {
+    STLL::showGray<> plain, compressed;
+    compressed.setCacheCompression(true);
+
+    for (int clip = 0; clip < 2; clip++)
+    {
+      if (clip)
+      {
+        plain.setClipRect(37, 11, 170, 53);
+        compressed.setClipRect(37, 11, 170, 53);
+      }
+
+      std::vector<uint8_t> a(w*h, 255), b(w*h, 255);
+      plain.showLayout(l, 0, 0, a.data(), w, w, h);
+      compressed.showLayout(l, 0, 0, b.data(), w, w, h);
+
+      BOOST_CHECK(std::count(a.begin(), a.end(), 255) < w*h);
+      BOOST_CHECK(a == b);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( Gray_Output )
+{
+  static STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+  // grey glyphs, far enough apart to not overlap, and a grey rectangle
+  STLL::TextLayout_c l;
+
+  for (int i = 0; i < 20; i++)
+    l.addCommand(f, 36+i, 3*64+i*15*64+i*7, 20*64+(i%5)*13, STLL::Color_c(i*11, i*11, i*11), i%7 == 0 ? 2*64 : 0);
+
+  l.addCommand(4*64, 40*64, 64*64, 8*64, STLL::Color_c(128, 128, 128), 0);
+
+  const int w = 320, h = 50;
+
+  STLL::showGray<> out;
+  std::vector<uint8_t> gray(w*h, 255);
+  out.showLayout(l, 0, 0, gray.data(), w, w, h);
+
+  BOOST_CHECK(std::count(gray.begin(), gray.end(), 255) < w*h);
+
+  // for grey colours the result must be the same as the colour output
+  {
+    STLL::internal::Gamma_c<> g;
+    g.setGamma(22);
+    STLL::internal::GlyphCache_c cache;
+    std::vector<uint8_t> rgb(3*w*h, 255);
+
+    auto bl = [&g](int a1, int a2, int b1, int b2, int c) { return STLL::internal::blend(a1, a2, b1, b2, c, g); };
+    auto get = [](const uint8_t * p) { return std::make_tuple(p[0], p[1], p[2]); };
+    auto put = [](uint8_t * p, uint8_t r, uint8_t g, uint8_t b) { p[0] = r; p[1] = g; p[2] = b; };
+
+    for (auto & i : l.getData())
+      if (i.command == STLL::CommandData_c::CMD_GLYPH)
+        STLL::internal::outputGlyph_NONE(i.x, i.y, cache.getGlyph(i.font, i.glyphIndex, STLL::SUBP_NONE, i.blurr),
+                                         g.forward(i.c), rgb.data(), 3*w, 3, w, h, get, put, bl);
+
+    for (int y = 0; y < 40; y++)
+      for (int x = 0; x < w; x++)
+        BOOST_CHECK_EQUAL(gray[y*w+x], rgb[3*(y*w+x)]);
+  }
+
+  // one bit output with a threshold is the same as the thresholded grey output
+  std::vector<uint8_t> mono(w/8*h, 0xFF);
+  out.showLayout(l, 0, 0, mono.data(), w/8, w, h, STLL::GRAY_1);
+
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+      BOOST_CHECK_EQUAL((mono[y*w/8+x/8] >> (7-x%8)) & 1, gray[y*w+x] >= 128 ? 1 : 0);
+
+  // dithering the 50% grey rectangle sets half of the pixels in each 4x4 block
+  std::fill(mono.begin(), mono.end(), 0xFF);
+  out.showLayout(l, 0, 0, mono.data(), w/8, w, h, STLL::GRAY_1_DITHER);
+
+  for (int by = 40; by < 48; by += 4)
+    for (int bx = 8; bx < 64; bx += 4)
+    {
+      int set = 0;
+
+      for (int y = by; y < by+4; y++)
+        for (int x = bx; x < bx+4; x++)
+          set += (mono[y*w/8+x/8] >> (7-x%8)) & 1;
+
+      BOOST_CHECK_EQUAL(set, 8);
+    }
+
+  // nothing is drawn outside of the clip rectangle
+  std::vector<uint8_t> clipped(w*h, 255);
+  out.setClipRect(50, 10, 100, 20);
+  out.showLayout(l, 0, 0, clipped.data(), w, w, h);
+
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+      if (x >= 50 && x < 150 && y >= 10 && y < 30)
+        BOOST_CHECK_EQUAL(clipped[y*w+x], gray[y*w+x]);
+      else
+        BOOST_CHECK_EQUAL(clipped[y*w+x], 255);
+}
+
+BOOST_AUTO_TEST_CASE( Sprite_Cache )
+{
+  static STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+  auto build = [](std::shared_ptr<STLL::FontFace_c> font, STLL::Color_c c) {
+    STLL::TextLayout_c l;
+    for (int i = 0; i < 10; i++)
+      l.addCommand(font, 36+i, 3*64+i*15*64+i*7, 20*64, c, 0);
+    return l;
+  };
+
+  auto l = build(f, STLL::Color_c(200, 40, 10));
+
+  STLL::internal::Gamma_c<> g;
+  g.setGamma(22);
+  STLL::internal::GlyphCache_c cache;
+  STLL::internal::SpriteCache_c sprites;
+  sprites.setBudget(1024*1024);
+
+  auto k = sprites.key(l, 70, 20, STLL::SUBP_NONE);
+  BOOST_REQUIRE(k);
+  BOOST_CHECK_EQUAL(k->fx, 6);
+  BOOST_CHECK_EQUAL(k->fy, 20);
+
+  // a new layout is not found, after inserting it is
+  BOOST_CHECK(!sprites.find(*k, l));
+  auto spr = sprites.insert(*k, l, STLL::internal::createSprite(l, k->fx, k->fy, STLL::SUBP_NONE, cache, g, 1024*1024));
+  BOOST_REQUIRE(spr);
+  BOOST_CHECK(spr->width > 0 && spr->rows > 0);
+  BOOST_CHECK_EQUAL(sprites.find(*k, l), spr);
+
+  // the sprite looks the same as the glyphs drawn directly
+  {
+    const int w = 170, h = 30;
+    std::vector<uint8_t> direct(3*w*h, 255), cached(3*w*h, 255);
+
+    auto bl = [&g](int a1, int a2, int b1, int b2, int c) { return STLL::internal::blend(a1, a2, b1, b2, c, g); };
+    auto get = [](const uint8_t * p) { return std::make_tuple(p[0], p[1], p[2]); };
+    auto put = [](uint8_t * p, uint8_t r, uint8_t g, uint8_t b) { p[0] = r; p[1] = g; p[2] = b; };
+
+    for (auto & i : l.getData())
+      STLL::internal::outputGlyph_NONE(70+i.x, 20+i.y, cache.getGlyph(i.font, i.glyphIndex, STLL::SUBP_NONE, i.blurr),
+                                       g.forward(i.c), direct.data(), 3*w, 3, w, h, get, put, bl);
+
+    STLL::internal::outputSprite(1+spr->left, spr->top, *spr, cached.data(), 3*w, 3, w, h, get, put, g);
+
+    int maxDiff = 0;
+    for (size_t i = 0; i < direct.size(); i++)
+      maxDiff = std::max(maxDiff, std::abs(direct[i]-cached[i]));
+
+    BOOST_CHECK(maxDiff <= 1);
+    BOOST_CHECK(std::count(cached.begin(), cached.end(), 255) < 3*w*h);
+  }
+
+  // an identical layout built separately, even with a different face of the
+  // same font, finds the same sprite
+  {
+    static STLL::FontCache_c fc2;
+    auto f2 = fc2.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+    BOOST_CHECK(f2 != f);
+
+    auto l2 = build(f2, STLL::Color_c(200, 40, 10));
+    BOOST_CHECK(l2.getVersion() != l.getVersion());
+
+    auto k2 = sprites.key(l2, 6, 84, STLL::SUBP_NONE);
+    BOOST_REQUIRE(k2);
+    BOOST_CHECK(*k2 == *k);
+    BOOST_CHECK_EQUAL(sprites.find(*k2, l2), spr);
+  }
+
+  // copies keep the version, changes create a new one
+  {
+    auto l2 = l;
+    BOOST_CHECK_EQUAL(l2.getVersion(), l.getVersion());
+    BOOST_CHECK_EQUAL(sprites.find(*sprites.key(l2, 70, 20, STLL::SUBP_NONE), l2), spr);
+
+    l2.shift(64, 0);
+    BOOST_CHECK(l2.getVersion() != l.getVersion());
+    BOOST_CHECK(!(*sprites.key(l2, 70, 20, STLL::SUBP_NONE) == *k));
+  }
+
+  // a moved from layout doesn't keep the version, so it doesn't find the sprite of the moved to layout
+  {
+    auto l2 = l;
+    auto l3 = std::move(l2);
+    BOOST_CHECK_EQUAL(l3.getVersion(), l.getVersion());
+    BOOST_CHECK(l2.getData().empty());
+    BOOST_CHECK(l2.getVersion() != l3.getVersion());
+    BOOST_CHECK(!sprites.find(*k, l2));
+    BOOST_CHECK_EQUAL(sprites.find(*k, l3), spr);
+
+    // move assignment swaps the commands together with their version
+    auto l4 = build(f, STLL::Color_c(10, 40, 200));
+    l4 = std::move(l3);
+    BOOST_CHECK_EQUAL(l4.getVersion(), l.getVersion());
+    BOOST_CHECK(l3.getVersion() != l4.getVersion());
+    BOOST_CHECK(!sprites.find(*k, l3));
+    BOOST_CHECK_EQUAL(sprites.find(*k, l4), spr);
+  }
+
+  // other sizes, sub pixel positions and arrangements give other keys
+  BOOST_CHECK(!(*sprites.key(build(fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 17*64),
+                                   STLL::Color_c(200, 40, 10)), 70, 20, STLL::SUBP_NONE) == *k));
+  BOOST_CHECK(!(*sprites.key(l, 71, 20, STLL::SUBP_NONE) == *k));
+  BOOST_CHECK(!(*sprites.key(l, 70, 20, STLL::SUBP_RGB) == *k));
+
+  // a layout with a colliding key doesn't get the sprite of the other layout, inserting
+  // its own sprite replaces the old one
+  {
+    auto l3 = build(f, STLL::Color_c(10, 40, 200));
+
+    BOOST_CHECK(!sprites.find(*k, l3));
+
+    auto spr3 = sprites.insert(*k, l3, STLL::internal::createSprite(l3, k->fx, k->fy, STLL::SUBP_NONE, cache, g, 1024*1024));
+    BOOST_REQUIRE(spr3);
+    BOOST_CHECK_EQUAL(sprites.find(*k, l3), spr3);
+    BOOST_CHECK(!sprites.find(*k, l));
+  }
+
+  // layouts with images can not be cached
+  {
+    auto l4 = l;
+    l4.addCommand(std::string("img"), 10*64, 10*64, 64, 64);
+    BOOST_CHECK(!sprites.key(l4, 0, 0, STLL::SUBP_NONE));
+  }
+
+  // sprites that don't fit into the budget are not inserted
+  sprites.setBudget(100);
+  BOOST_CHECK(!sprites.find(*k, l));
+  BOOST_CHECK(!sprites.insert(*k, l, STLL::internal::createSprite(l, k->fx, k->fy, STLL::SUBP_NONE, cache, g, 1024*1024)));
+}
+
+BOOST_AUTO_TEST_CASE( Shared_Glyph_Cache )
+{
+  static STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+  STLL::TextLayout_c l;
+
+  for (int i = 0; i < 20; i++)
+    l.addCommand(f, 36+i, 3*64+i*15*64, 20*64, STLL::Color_c(0, 0, 0), i%7 == 0 ? 2*64 : 0);
+
+  l.addCommand(4*64, 30*64, 64*64, 8*64, STLL::Color_c(128, 128, 128), 3*64);
+
+  const int w = 320, h = 50;
+
+  STLL::showGray<> ref;
+  std::vector<uint8_t> expected(w*h, 255);
+  ref.showLayout(l, 0, 0, expected.data(), w, w, h);
+
+  const std::string name = "/stll-test-" + std::to_string(getpid());
+  STLL::showGray<>::removeSharedCache(name);
+
+  // several processes draw the same layout at the same time, they all look up
+  // and add the glyphs in the same segment
+  std::vector<pid_t> children;
+
+  for (int p = 0; p < 4; p++)
+  {
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+      STLL::showGray<> out;
+      bool ok = out.useSharedCache(name, 1024*1024);
+      std::vector<uint8_t> gray(w*h, 255);
+      out.showLayout(l, 0, 0, gray.data(), w, w, h);
+      _exit(ok && gray == expected ? 0 : 1);
+    }
+
+    children.push_back(pid);
+  }
+
+  for (auto pid : children)
+  {
+    int status;
+    BOOST_CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  // the glyphs are now in the segment, even for fonts loaded again from a different place
+  auto s = STLL::internal::SharedGlyphCache_c::open(name, 1024*1024);
+  BOOST_REQUIRE(s);
+
+  std::ifstream in("tests/FreeSans.ttf", std::ios::binary);
+  std::vector<char> font((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  std::shared_ptr<uint8_t> data(new uint8_t[font.size()], std::default_delete<uint8_t[]>());
+  std::copy(font.begin(), font.end(), data.get());
+
+  STLL::FontCache_c fc2;
+  auto f2 = fc2.getFont(STLL::internal::FontFileResource_c(data, font.size(), "mem"), 16*64);
+
+  STLL::internal::PaintData_c d;
+  BOOST_CHECK(s->find(STLL::internal::SharedGlyphKey_c(f2, 37, STLL::SUBP_NONE, 0), d));
+  BOOST_CHECK(s->contains(d.buffer));
+  BOOST_CHECK(!s->find(STLL::internal::SharedGlyphKey_c(fc2.getFont(STLL::internal::FontFileResource_c(data, font.size(), "mem"), 20*64),
+                                                        37, STLL::SUBP_NONE, 0), d));
+
+  // drawing from the segment gives the same result
+  STLL::showGray<> out;
+  BOOST_CHECK(out.useSharedCache(name));
+  std::vector<uint8_t> gray(w*h, 255);
+  out.showLayout(l, 0, 0, gray.data(), w, w, h);
+  BOOST_CHECK(gray == expected);
+
+  // when the segment is full the glyphs are kept in the own memory
+  const std::string small = name + "-small";
+  STLL::showGray<> tiny;
+  BOOST_CHECK(tiny.useSharedCache(small, 8*1024));
+  std::fill(gray.begin(), gray.end(), 255);
+  tiny.showLayout(l, 0, 0, gray.data(), w, w, h);
+  BOOST_CHECK(gray == expected);
+
+  BOOST_CHECK(STLL::showGray<>::removeSharedCache(small));
+  BOOST_CHECK(STLL::showGray<>::removeSharedCache(name));
+  BOOST_CHECK(!STLL::showGray<>::removeSharedCache(name));
+
+  // all sizes of a font file share the hash, so the file is read only once
+  const std::string copy = "/tmp" + name + ".ttf";
+  std::ofstream(copy, std::ios::binary).write(font.data(), font.size());
+
+  STLL::FontCache_c fc3;
+  auto c16 = fc3.getFont(STLL::internal::FontFileResource_c(copy), 16*64);
+  auto c20 = fc3.getFont(STLL::internal::FontFileResource_c(copy), 20*64);
+
+  BOOST_CHECK_EQUAL(c16->getContentHash(), f2->getContentHash());
+  std::remove(copy.c_str());
+  BOOST_CHECK_EQUAL(c20->getContentHash(), f2->getContentHash());
+}
+
+BOOST_AUTO_TEST_CASE( Outline_Rasterizer )
+{
+  static STLL::FontCache_c fc;
+  STLL::internal::FontFileResource_c res("tests/FreeSans.ttf");
+
+  // the internal rasterizer creates nearly the same images as FreeType without hinting
+  for (auto sp : { STLL::SUBP_NONE, STLL::SUBP_RGB })
+    for (int size : { 8, 16, 40 })
+    {
+      auto f = fc.getFont(res, size*64);
+      int same = 0;
+
+      for (STLL::glyphIndex_t g = 4; g < 200; g++)
+      {
+        auto o = f->renderOutline(g, sp);
+        std::vector<uint8_t> img(o.data, o.data + o.w*o.h);
+        int w = o.w, h = o.h, left = o.left, top = o.top;
+
+        FT_Load_Glyph(f->getFace(), g, FT_LOAD_NO_HINTING);
+        FT_Render_Glyph(f->getFace()->glyph, sp == STLL::SUBP_NONE ? FT_RENDER_MODE_NORMAL : FT_RENDER_MODE_LCD);
+        STLL::FontFace_c::GlyphSlot_c r(f->getFace()->glyph);
+
+        // the parts of composite glyphs may be placed on whole pixels by FreeType
+        if (r.w != w || r.h != h || r.left != left || r.top != top) continue;
+
+        same++;
+        int diff = 0;
+
+        for (int y = 0; y < h; y++)
+          for (int x = 0; x < w; x++)
+            diff = std::max(diff, std::abs(img[y*w+x] - r.data[y*r.pitch+x]));
+
+        BOOST_CHECK_LE(diff, 40);
+      }
+
+      BOOST_CHECK_GE(same, 190);
+    }
+
+  // the outlines are kept once for all sizes and can be rendered at any size from any of them
+  auto f16 = fc.getFont(res, 16*64);
+  auto f40 = fc.getFont(res, 40*64);
+
+  BOOST_CHECK(f16->getOutlines() == f40->getOutlines());
+
+  auto a = f40->renderOutline(40, STLL::SUBP_NONE);
+  std::vector<uint8_t> a40(a.data, a.data + a.w*a.h);
+  auto b = f16->renderOutline(40, STLL::SUBP_NONE, 40*64);
+
+  BOOST_CHECK(a.w == b.w && a.h == b.h && a.left == b.left && a.top == b.top);
+  BOOST_CHECK(a40 == std::vector<uint8_t>(b.data, b.data + b.w*b.h));
+
+  // shifting by a whole pixel only changes the position
+  auto c = f16->renderOutline(40, STLL::SUBP_NONE, 40*64, 64);
+
+  BOOST_CHECK(a.w == c.w && a.h == c.h && a.left+1 == c.left && a.top == c.top);
+  BOOST_CHECK(a40 == std::vector<uint8_t>(c.data, c.data + c.w*c.h));
+
+  // half a pixel spreads the glyph over one more column
+  auto d = f16->renderOutline(40, STLL::SUBP_NONE, 40*64, 32);
+  BOOST_CHECK(d.w >= a.w && d.w <= a.w+1);
+
+  // outputs can use the rasterizer for their glyphs
+  STLL::TextLayout_c l;
+  l.addCommand(f16, 40, 2*64, 20*64, STLL::Color_c(0, 0, 0), 0);
+
+  const int w = 32, h = 32;
+  std::vector<uint8_t> gray(w*h, 255), outline(w*h, 255);
+
+  STLL::showGray<> out;
+  out.showLayout(l, 0, 0, gray.data(), w, w, h);
+  out.setOutlineRendering(true);
+  out.showLayout(l, 0, 0, outline.data(), w, w, h);
+
+  // the glyphs are not hinted, so they are a bit different
+  BOOST_CHECK(std::count(outline.begin(), outline.end(), 255) < w*h);
+  BOOST_CHECK(gray != outline);
+}
@@ -0,0 +1,165 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE STLL SDL2 Tests
+#include <boost/test/unit_test.hpp>
+
+#include <stll/output_SDL2.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+// the tests run with the dummy video driver, so no display is required
+class SDL_Fixture_c
+{
+  public:
+    SDL_Fixture_c(void)
+    {
+      SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+      SDL_Init(SDL_INIT_VIDEO);
+    }
+
+    ~SDL_Fixture_c(void)
+    {
+      SDL_Quit();
+    }
+};
+
+BOOST_GLOBAL_FIXTURE(SDL_Fixture_c);
+
+// a layout with normal, transparent and blurred glyphs and a rectangle
+static STLL::TextLayout_c testLayout(void)
+{
+  static STLL::FontCache_c fc;
+  auto f = fc.getFont(STLL::internal::FontFileResource_c("tests/FreeSans.ttf"), 16*64);
+
+  STLL::TextLayout_c l;
+
+  for (int i = 0; i < 30; i++)
+    l.addCommand(f, 36+i, 3*64+i*9*64+i*7, 20*64+(i%5)*13, STLL::Color_c(200, (i*37)%256, 50, i%3 ? 255 : 128),
+                 i%7 == 0 ? 3*64 : 0);
+
+  l.addCommand(2*64+10, 30*64+5, 200*64, 64, STLL::Color_c(10, 20, 250), 0);
+
+  return l;
+}
+
+// render the layout onto a surface of the given format and return the rgb values of all pixels
+static std::vector<uint8_t> render(Uint32 format, STLL::SubPixelArrangement sp)
+{
+  SDL_Surface * s = SDL_CreateRGBSurfaceWithFormat(0, 300, 50, 32, format);
+  BOOST_REQUIRE(s);
+
+  SDL_FillRect(s, nullptr, SDL_MapRGB(s->format, 77, 77, 77));
+
+  STLL::showSDL2<> out;
+  out.showLayout(testLayout(), 100, 100, s, sp);
+
+  std::vector<uint8_t> res;
+
+  SDL_LockSurface(s);
+
+  for (int y = 0; y < s->h; y++)
+    for (int x = 0; x < s->w; x++)
+    {
+      Uint32 v = 0;
+      memcpy(&v, (uint8_t*)s->pixels + y*s->pitch + x*s->format->BytesPerPixel, s->format->BytesPerPixel);
+
+      Uint8 r, g, b;
+      SDL_GetRGB(v, s->format, &r, &g, &b);
+
+      res.push_back(r);
+      res.push_back(g);
+      res.push_back(b);
+    }
+
+  SDL_UnlockSurface(s);
+  SDL_FreeSurface(s);
+
+  return res;
+}
+
+BOOST_AUTO_TEST_CASE( SDL2_Surface_Formats )
+{
+  for (auto sp : { STLL::SUBP_NONE, STLL::SUBP_RGB, STLL::SUBP_BGR })
+  {
+    auto ref = render(SDL_PIXELFORMAT_ARGB8888, sp);
+
+    // something must have been drawn
+    BOOST_CHECK(std::count(ref.begin(), ref.end(), 77) < (int)ref.size());
+
+    // all fast formats must give exactly the same result
+    BOOST_CHECK(render(SDL_PIXELFORMAT_RGB888, sp) == ref);
+    BOOST_CHECK(render(SDL_PIXELFORMAT_ABGR8888, sp) == ref);
+    BOOST_CHECK(render(SDL_PIXELFORMAT_RGBA8888, sp) == ref);
+    BOOST_CHECK(render(SDL_PIXELFORMAT_BGRA8888, sp) == ref);
+    BOOST_CHECK(render(SDL_PIXELFORMAT_RGB24, sp) == ref);
+    BOOST_CHECK(render(SDL_PIXELFORMAT_BGR24, sp) == ref);
+
+    // the fallback goes through a format with only 5 or 6 bits per channel, so
+    // it will differ, but not too much
+    auto r565 = render(SDL_PIXELFORMAT_RGB565, sp);
+    BOOST_REQUIRE(r565.size() == ref.size());
+
+    int maxDiff = 0;
+    for (size_t i = 0; i < ref.size(); i++)
+      maxDiff = std::max(maxDiff, std::abs(r565[i]-ref[i]));
+
+    BOOST_CHECK(maxDiff < 24);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( SDL2_Streaming_Texture )
+{
+  auto ref = render(SDL_PIXELFORMAT_ARGB8888, STLL::SUBP_NONE);
+
+  SDL_Surface * target = SDL_CreateRGBSurfaceWithFormat(0, 300, 50, 32, SDL_PIXELFORMAT_ARGB8888);
+  SDL_Renderer * renderer = SDL_CreateSoftwareRenderer(target);
+  BOOST_REQUIRE(renderer);
+
+  SDL_Texture * t = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 300, 50);
+  BOOST_REQUIRE(t);
+
+  STLL::showSDL2<> out;
+  out.showLayout(testLayout(), 100, 100, t, STLL::Color_c(77, 77, 77));
+
+  SDL_RenderCopy(renderer, t, nullptr, nullptr);
+
+  std::vector<Uint32> pixels(300*50);
+  SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_ARGB8888, pixels.data(), 300*4);
+
+  std::vector<uint8_t> res;
+
+  for (auto p : pixels)
+  {
+    res.push_back((p >> 16) & 0xFF);
+    res.push_back((p >> 8) & 0xFF);
+    res.push_back(p & 0xFF);
+  }
+
+  BOOST_CHECK(res == ref);
+
+  SDL_DestroyTexture(t);
+  SDL_DestroyRenderer(renderer);
+  SDL_FreeSurface(target);
+}
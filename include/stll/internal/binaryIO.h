@@ -0,0 +1,61 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#ifndef STLL_BINARY_IO_H
+#define STLL_BINARY_IO_H
+
+#include <istream>
+#include <ostream>
+
+namespace STLL { namespace internal {
+
+// helpers to write plain values into binary files and read them back, the values are
+// stored in the byte order of the machine, so the files are only meant to be read back
+// on the same kind of machine, e.g. as caches
+
+template <class T>
+void writeBinary(std::ostream & out, const T & v)
+{
+  out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <class T>
+void writeBinary(std::ostream & out, const T * v, size_t count)
+{
+  out.write(reinterpret_cast<const char *>(v), sizeof(T)*count);
+}
+
+// returns false when the stream doesn't contain enough data
+template <class T>
+bool readBinary(std::istream & in, T & v)
+{
+  return (bool)in.read(reinterpret_cast<char *>(&v), sizeof(T));
+}
+
+template <class T>
+bool readBinary(std::istream & in, T * v, size_t count)
+{
+  return (bool)in.read(reinterpret_cast<char *>(v), sizeof(T)*count);
+}
+
+} }
+
+#endif
@@ -28,6 +28,8 @@
 #include "glyphCache.h"
 
 #include <limits>
+#include <tuple>
+#include <algorithm>
 
 // blitting routines to output the generated glyphs, template code, should be pretty good for
 // most purposes
@@ -73,6 +75,71 @@ int blend(int a1, int a2, int b1, int b2, int c, const G & g)
   return g.inverse(out);
 }
 
+// sequential reader for one row of a span encoded image, see PaintData_c
+class SpanReader_c
+{
+  private:
+    const uint8_t * run;     // header of the next run
+    const uint8_t * lit;     // next value of the current literal run
+    int kind;                // kind of the current run
+    int left;                // values left in the current run
+
+    void fetch(void)
+    {
+      while (left == 0)
+      {
+        kind = run[1] >> 6;
+        left = ((run[1] & 0x3F) << 8) | run[0];
+        run += 2;
+
+        if (kind == SPAN_LITERAL)
+        {
+          lit = run;
+          run += left;
+        }
+      }
+    }
+
+  public:
+
+    SpanReader_c(const uint8_t * r) : run(r), lit(nullptr), kind(SPAN_EMPTY), left(0) { }
+
+    // get the next value
+    uint8_t next(void)
+    {
+      fetch();
+      left--;
+
+      switch (kind)
+      {
+        case SPAN_EMPTY: return 0;
+        case SPAN_FULL: return 255;
+        default: return *lit++;
+      }
+    }
+
+    // skip n values
+    void skip(int n)
+    {
+      while (n > 0)
+      {
+        fetch();
+        int k = std::min(n, left);
+        left -= k;
+        n -= k;
+        if (kind == SPAN_LITERAL) lit += k;
+      }
+    }
+
+    // how many of the next values belong to a run of the given kind, 0 when the next value
+    // is part of a different run
+    int inRun(int k)
+    {
+      fetch();
+      return kind == k ? left : 0;
+    }
+};
+
 /**
  * Blitting function to paint glyphs
  *
@@ -140,6 +207,71 @@ void outputGlyph_NONE(int sx, int sy, const internal::PaintData_c & img, Color_c
   if (stw <= 0) return;
   if (sty >= h || sty+img.rows < 0) return;
 
+  if (img.spans)
+  {
+    // span encoded image, skip empty runs and fill full runs with the solid colour
+    const int full = 255*255;
+    const int sr = blend(0, c.r(), full, full, 0);
+    const int sg = blend(0, c.g(), full, full, 0);
+    const int sb = blend(0, c.b(), full, full, 0);
+
+    for (int y = 0; y < img.rows; y++, yp++)
+    {
+      if (yp < 0 || yp >= h) continue;
+
+      int aprev = 0;
+
+      uint8_t * dst = s + yp*pitch + bbp*stx;
+      SpanReader_c src(img.getSpans(y));
+
+      if (sti > 0)
+      {
+        src.skip(sti-1);
+        aprev = src.next() * c.a();
+      }
+
+      int x = stw;
+
+      while (x > 0)
+      {
+        int n;
+
+        if (aprev == 0 && (n = std::min(src.inRun(SPAN_EMPTY), x)) > 0)
+        {
+          src.skip(n);
+          dst += n*bbp;
+          x -= n;
+        }
+        else if (aprev == full && (n = std::min(src.inRun(SPAN_FULL), x)) > 0)
+        {
+          src.skip(n);
+          x -= n;
+
+          for (; n > 0; n--, dst += bbp)
+            pxput(dst, sr, sg, sb);
+        }
+        else
+        {
+          int a = src.next() * c.a();
+
+          auto px = pxget(dst);
+
+          std::get<0>(px) = blend(std::get<0>(px), c.r(), a, aprev, stb);
+          std::get<1>(px) = blend(std::get<1>(px), c.g(), a, aprev, stb);
+          std::get<2>(px) = blend(std::get<2>(px), c.b(), a, aprev, stb);
+
+          pxput(dst, std::get<0>(px), std::get<1>(px), std::get<2>(px));
+
+          aprev = a;
+          dst += bbp;
+          x--;
+        }
+      }
+    }
+
+    return;
+  }
+
   for (int y = 0; y < img.rows; y++)
   {
     if (yp >= 0 && yp < h)
@@ -160,14 +292,14 @@ void outputGlyph_NONE(int sx, int sy, const internal::PaintData_c & img, Color_c
       {
         a = *src * c.a();
 
-        uint8_t r, g, b;
-        std::tie(r, g, b) = pxget(dst);
+        // the channel type is whatever pxget returns, normally uint8_t
+        auto px = pxget(dst);
 
-        r = blend(r, c.r(), a, aprev, stb);
-        g = blend(g, c.g(), a, aprev, stb);
-        b = blend(b, c.b(), a, aprev, stb);
+        std::get<0>(px) = blend(std::get<0>(px), c.r(), a, aprev, stb);
+        std::get<1>(px) = blend(std::get<1>(px), c.g(), a, aprev, stb);
+        std::get<2>(px) = blend(std::get<2>(px), c.b(), a, aprev, stb);
 
-        pxput(dst, r, g, b);
+        pxput(dst, std::get<0>(px), std::get<1>(px), std::get<2>(px));
 
         aprev = a;
         xp++;
@@ -263,6 +395,83 @@ void outputGlyph_HorizontalRGB(int sx, int sy, const internal::PaintData_c & img
   if (stw <= 0) return;                          // leave function when there is nothing to output
   if (sty >= h || sty+img.rows < 0) return;
 
+  if (img.spans)                                 // span encoded images, same as below, but whole pixels
+  {                                              // within empty or full runs are skipped or filled
+    const int full = 255*255;
+    const int s1 = blend(0, sp1c, full, full, 0);
+    const int s2 = blend(0, sp2c, full, full, 0);
+    const int s3 = blend(0, sp3c, full, full, 0);
+
+    for (int y = 0; y < img.rows; y++, yp++)
+    {
+      if (yp < 0 || yp >= h) continue;
+
+      int a = 0;
+      int aprev = 0;
+
+      uint8_t * dst = s + yp*pitch + bbp*stx;
+      SpanReader_c src(img.getSpans(y));
+
+      if (sti > 0)
+      {
+        src.skip(sti-1);
+        aprev = src.next() * alpha;
+      }
+
+      int x = stw;
+
+      auto px = pxget(dst);
+      auto sp1 = std::get<0>(px);
+      auto sp2 = std::get<1>(px);
+      auto sp3 = std::get<2>(px);
+
+      switch (stc)
+      {
+        case 0: a = src.next()*alpha; sp1 = blend(sp1, sp1c, a, aprev, stb); aprev = a;
+        case 1: a = src.next()*alpha; sp2 = blend(sp2, sp2c, a, aprev, stb); aprev = a;
+        case 2: a = src.next()*alpha; sp3 = blend(sp3, sp3c, a, aprev, stb); aprev = a;
+      }
+
+      pxput(dst, sp1, sp2, sp3);
+      dst += bbp;
+      x--;
+
+      while (x > 0)
+      {
+        int n;
+
+        if (aprev == 0 && (n = std::min(src.inRun(SPAN_EMPTY)/3, x)) > 0)
+        {
+          src.skip(3*n);
+          dst += n*bbp;
+          x -= n;
+        }
+        else if (aprev == full && (n = std::min(src.inRun(SPAN_FULL)/3, x)) > 0)
+        {
+          src.skip(3*n);
+          x -= n;
+
+          for (; n > 0; n--, dst += bbp)
+            pxput(dst, s1, s2, s3);
+        }
+        else
+        {
+          std::tie(sp1, sp2, sp3) = pxget(dst);
+
+          a = src.next()*alpha; sp1 = blend(sp1, sp1c, a, aprev, stb); aprev = a;
+          a = src.next()*alpha; sp2 = blend(sp2, sp2c, a, aprev, stb); aprev = a;
+          a = src.next()*alpha; sp3 = blend(sp3, sp3c, a, aprev, stb); aprev = a;
+
+          pxput(dst, sp1, sp2, sp3);
+          dst += bbp;
+          x--;
+        }
+      }
+    }
+
+    return;
+  }
+
   for (int y = 0; y < img.rows; y++)
   {
     if (yp >= 0 && yp < h)
@@ -276,8 +485,10 @@ void outputGlyph_HorizontalRGB(int sx, int sy, const internal::PaintData_c & img
 
       int x = stw;
 
-      uint8_t sp1, sp2, sp3;
-      std::tie(sp1, sp2, sp3) = pxget(dst);      // get pixel, there is always at least one to output
+      auto px = pxget(dst);                      // get pixel, there is always at least one to output
+      auto sp1 = std::get<0>(px);                // the channel type is whatever pxget returns
+      auto sp2 = std::get<1>(px);
+      auto sp3 = std::get<2>(px);
 
       switch (stc)                               // do the remaining sub pixels for the first pixel
       {                                          // all remaining ones are complete
@@ -307,6 +518,142 @@ void outputGlyph_HorizontalRGB(int sx, int sy, const internal::PaintData_c & img
   }
 }
 
+
+/**
+ * Blitting function to paint glyphs onto single channel (grey) surfaces
+ *
+ * This is the same as outputGlyph_NONE, but there is only one channel to blend, so each pixel only
+ * requires one blending operation. The pixels are accessed by the row and the column, so that surfaces
+ * with less than one byte per pixel can be used as well
+ *
+ * \param sx shift value for x, the x position where to output the image, in 1/64 pixels
+ * \param sy y position in 1/64 pixels
+ * \param img the image to paint
+ * \param v the grey value to use for painting, already gamma corrected
+ * \param alpha the alpha value to use for painting
+ * \param s pointer to the start of the surface to paint on
+ * \param pitch how many bytes per line of pixels
+ * \param w width in pixels of the surface s
+ * \param h height in pixels of the surface s
+ * \param pxget function (e.g. lambda) to read out a pixel, arguments are the pointer to the row, the x and the y
+ *              position of the pixel, it returns the grey value
+ * \param pxput function (e.g. lambda) that writes a pixel, arguments are the pointer to the row, the x and y position
+ *              and the new grey value
+ * \param blend the function that calculates the blending of the pixel value and the glyph, see function blend for a
+ *              description of the arguments
+ * \param cx clip rectangle left edge in pixels
+ * \param cy clib rectangle upper edge in pixels
+ * \param cw width in pixels of the clip rectangle
+ * \param ch height in pixels of the clip rectangle
+ */
+template <class P1, class P2, class B>
+void outputGlyph_Gray(int sx, int sy, const internal::PaintData_c & img, int v, int alpha,
+                      uint8_t * s, int pitch, int w, int h,
+                      const P1 & pxget, const P2 & pxput, const B & blend,
+                      int cx = 0, int cy = 0, int cw = std::numeric_limits<int>::max(), int ch = std::numeric_limits<int>::max())
+{
+  // the clipping works with the pixel positions instead of the pointer, as pixels might be
+  // smaller than one byte
+  int x0 = std::max(cx, 0);
+  int y0 = std::max(cy, 0);
+
+  if (cw < w-x0) w = x0+cw;
+  if (ch < h-y0) h = y0+ch;
+
+  int stx, stb;
+
+  std::tie(stx, stb) = divmod_inf(sx, 64);
+  stx += img.left;
+
+  int sty = div_inf(sy+32, 64) - img.top;
+
+  int sti = 0;
+  int stw = img.width + 1;
+
+  if (stx < x0)
+  {
+    sti += x0-stx;
+    stw -= x0-stx;
+    stx = x0;
+  }
+
+  if (stx+stw >= w)
+  {
+    stw -= (stx+stw-w+1);
+  }
+
+  if (stw <= 0) return;
+  if (sty >= h || sty+img.rows < y0) return;
+
+  const int full = 255*255;
+  const int sv = blend(0, v, full, full, 0);
+
+  for (int y = 0, yp = sty; y < img.rows; y++, yp++)
+  {
+    if (yp < y0 || yp >= h) continue;
+
+    uint8_t * row = s + yp*pitch;
+    int aprev = 0;
+
+    if (img.spans)
+    {
+      // span encoded image, skip empty runs and fill full runs with the solid value
+      SpanReader_c src(img.getSpans(y));
+
+      if (sti > 0)
+      {
+        src.skip(sti-1);
+        aprev = src.next() * alpha;
+      }
+
+      int x = stx;
+      int xe = stx+stw;
+
+      while (x < xe)
+      {
+        int n;
+
+        if (aprev == 0 && (n = std::min(src.inRun(SPAN_EMPTY), xe-x)) > 0)
+        {
+          src.skip(n);
+          x += n;
+        }
+        else if (aprev == full && (n = std::min(src.inRun(SPAN_FULL), xe-x)) > 0)
+        {
+          src.skip(n);
+
+          for (; n > 0; n--, x++)
+            pxput(row, x, yp, sv);
+        }
+        else
+        {
+          int a = src.next() * alpha;
+
+          pxput(row, x, yp, blend(pxget(row, x, yp), v, a, aprev, stb));
+
+          aprev = a;
+          x++;
+        }
+      }
+    }
+    else
+    {
+      const uint8_t * src = img.getBuffer() + y*img.pitch + sti;
+
+      if (sti > 0) aprev = *(src-1) * alpha;
+
+      for (int x = stx; x < stx+stw; x++, src++)
+      {
+        int a = *src * alpha;
+
+        pxput(row, x, yp, blend(pxget(row, x, yp), v, a, aprev, stb));
+
+        aprev = a;
+      }
+    }
+  }
+}
+
 } }
 
 #endif
@@ -0,0 +1,70 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#ifndef STLL_DISTANCE_FIELD_H
+#define STLL_DISTANCE_FIELD_H
+
+/** \file
+ *  \brief signed distance fields for scalable glyph images
+ */
+
+#include <cstdint>
+
+namespace STLL { namespace internal {
+
+/** \brief the value of a distance field right on the outline of the shape */
+const uint8_t distanceFieldEdge = 128;
+
+/** \brief create a signed distance field out of an anti aliased coverage image
+ *
+ * The field gets a border of spread pixels on each side, so it has the size
+ * (w+2*spread) x (h+2*spread). Each value contains the distance of the pixel centre
+ * to the outline of the shape: distanceFieldEdge is right on the outline, bigger values are
+ * inside, smaller values outside, each pixel of distance changes the value by 127/spread.
+ * Distances bigger than spread are clamped. The partial coverage of the anti aliased pixels
+ * is used to place the outline with sub pixel accuracy.
+ *
+ * \param s the coverage image, 0 is outside, 255 inside
+ * \param pitch number of bytes to get to the next line of s
+ * \param w the width of the image
+ * \param h the hight of the image
+ * \param d where to put the distance field
+ * \param dpitch number of bytes to get to the next line of d
+ * \param spread the maximal distance that is stored in the field
+ */
+void distanceField(const uint8_t * s, int pitch, int w, int h, uint8_t * d, int dpitch, int spread);
+
+/** \brief calculate the coverage of a pixel out of a distance field value
+ *
+ * This is what the shaders do when drawing distance fields, it is here to allow
+ * checking the fields.
+ *
+ * \param v the value from the distance field
+ * \param spread the spread used when creating the field
+ * \param scale size of one field pixel on the target in pixels
+ * \param ramp width of the soft edge in target pixels, 1 gives normal anti aliasing, bigger values
+ *             emulate blurring
+ */
+uint8_t distanceFieldCoverage(uint8_t v, int spread, double scale, double ramp);
+
+} }
+
+#endif
@@ -22,11 +22,17 @@
 #ifndef STLL_GLYPH_ATLAS_H
 #define STLL_GLYPH_ATLAS_H
 
+#include "../layouter.h"
 #include "textureAtlas.h"
 #include "glyphKey.h"
 #include "glyphprepare.h"
+#include "distanceField.h"
 
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
 #include <experimental/optional>
 
 namespace STLL { namespace internal {
@@ -41,6 +47,8 @@ class FontAtlasData_c {
     int32_t left;   // where is the left of the image, when the base-point is known
     int32_t top;    // where is the top of the image, when the base-point is known
 
+    uint32_t page = 0; // the page of a PagedGlyphAtlas_c that contains the image
+
     FontAtlasData_c(uint32_t posx, uint32_t posy, uint32_t w, uint32_t height, uint32_t l, uint32_t t) :
       pos_x(posx), pos_y(posy), rows(height), width(w), left(l), top(t) {}
 
@@ -49,19 +57,40 @@ class FontAtlasData_c {
 
 // A font atlas for the fonts as used in STLL
 //
+// When spread is not 0 unblurred glyphs are stored as signed distance fields with that spread
+// instead of coverage images. Blurred glyphs and rectangles are always stored as normal images
 class GlyphAtlas_c : public TextureAtlas_c<internal::GlyphKey_c, FontAtlasData_c, std::shared_ptr<FontFace_c>, 1>
 {
+  private:
+
+    uint16_t spread;
+
   public:
 
     const uint16_t blurrmax = 20;
 
-    GlyphAtlas_c(uint32_t width, uint32_t height):
-      TextureAtlas_c<internal::GlyphKey_c, FontAtlasData_c, std::shared_ptr<FontFace_c>, 1>(width, height)
+    GlyphAtlas_c(uint32_t width, uint32_t height, uint16_t spr = 0):
+      TextureAtlas_c<internal::GlyphKey_c, FontAtlasData_c, std::shared_ptr<FontFace_c>, 1>(width, height), spread(spr)
     {}
 
     virtual typename std::unordered_map<internal::GlyphKey_c, FontAtlasData_c>::iterator addElement(const internal::GlyphKey_c & key, const std::shared_ptr<FontFace_c> & f)
     {
-      if (f)
+      if (f && spread > 0 && key.blurr == 0)
+      {
+        auto g = f->renderGlyph(key.glyphIndex, SUBP_NONE);
+
+        std::unordered_map<internal::GlyphKey_c, FontAtlasData_c>::iterator i;
+        bool valid;
+
+        // like glyphPrepare we add one empty column and row as a frame
+        std::tie(i, valid) = insert(key, g.w+2*spread+1, g.h+2*spread+1, g.left-spread, g.top+spread);
+
+        if (valid)
+          distanceField(g.data, g.pitch, g.w, g.h, getData()+i->second.pos_y*width()+i->second.pos_x, width(), spread);
+
+        return i;
+      }
+      else if (f)
       {
         auto g = f->renderGlyph(key.glyphIndex, key.sp);
 
@@ -123,6 +152,299 @@ class GlyphAtlas_c : public TextureAtlas_c<internal::GlyphKey_c, FontAtlasData_c
     }
 };
 
+// a glyph atlas that consists of several pages, each one is a GlyphAtlas_c
+//
+// As long as there is only one page, that page grows up to the maximal size, after that
+// new pages of that size are added until the maximal number of pages is reached. New
+// images are always added to the current page. Once that is full and no new page can be
+// added, the page that was not used for the longest time is cleared and becomes the current page.
+//
+// Usage is tracked in batches: all images used for one draw operation belong to the same
+// batch and pages used within the current batch are never cleared. When there is no other
+// page left the batch has to be drawn and a new batch started with nextBatch.
+//
+// Pages can also be pinned, e.g. for layouts that have been prepared for drawing but not yet drawn,
+// pinned pages are never reused, only clear and load remove them.
+//
+// In distance field mode glyphs are rendered once per font file at a reference size
+// into signed distance fields and scaled when drawn, so all sizes of a font share the same
+// images. Blurring is done by widening the soft edge when drawing, only when the blurr is
+// bigger than what the field can represent a normal blurred image is created.
+//
+// The atlas can be saved into a file and loaded again at the next start of the program, so
+// that the glyphs don't need to be rendered again. Fonts are identified by the hash of their
+// content and their size within the file. The glyphs of a loaded font are used as soon as a font with
+// the same content and size is used.
+class PagedGlyphAtlas_c
+{
+  private:
+
+    class Page_c
+    {
+      public:
+        std::unique_ptr<GlyphAtlas_c> atlas;
+        uint64_t lastUse;  // the batch that used this page last
+        uint32_t id;       // changes each time the page is cleared
+        uint32_t pins;     // number of pins on the current content of the page
+    };
+
+    std::vector<Page_c> pages;
+    uint32_t current = 0;
+
+    uint32_t maxSize;
+    uint32_t maxPages;
+
+    uint64_t batch = 1;
+    uint32_t nextId = 1;
+
+    // distance field mode: size of the reference fonts in pixels (0 means mode is off)
+    // and the fonts at that size
+    uint32_t fieldSize;
+    uint16_t spread;
+    std::unique_ptr<FontCache_c> fieldFonts;
+
+    // the fonts used within the keys of the pages, required to identify the fonts when saving
+    std::unordered_map<intptr_t, std::weak_ptr<FontFace_c>> fonts;
+    std::weak_ptr<FontFace_c> lastFont;
+
+    // fonts of a loaded file that have not been used since loading. The keys of their glyphs
+    // contain the address of the tag instead of the font. Once a font with the same
+    // content and size is used, the keys are changed to that font
+    class SavedFont_c
+    {
+      public:
+        uint64_t hash;
+        uint32_t size;
+        std::unique_ptr<uint8_t> tag;
+    };
+
+    std::vector<SavedFont_c> savedFonts;
+
+    void addFont(const std::shared_ptr<FontFace_c> & f);
+
+    void registerFont(const std::shared_ptr<FontFace_c> & f)
+    {
+      // most of the time it is the same font as the last time
+      if (!lastFont.owner_before(f) && !f.owner_before(lastFont)) return;
+
+      lastFont = f;
+      addFont(f);
+    }
+
+    FontAtlasData_c use(uint32_t p, FontAtlasData_c d)
+    {
+      pages[p].lastUse = batch;
+      d.page = p;
+      return d;
+    }
+
+    void addPage(uint32_t size)
+    {
+      pages.push_back(Page_c { std::make_unique<GlyphAtlas_c>(size, size, spread), 0, nextId++, 0 });
+    }
+
+    std::experimental::optional<FontAtlasData_c> find(const GlyphKey_c & k, const std::shared_ptr<FontFace_c> & f)
+    {
+      if (f) registerFont(f);
+
+      for (uint32_t p = 0; p < pages.size(); p++)
+      {
+        auto d = pages[p].atlas->get(k);
+        if (d) return use(p, d.value());
+      }
+
+      auto d = pages[current].atlas->find(k, f);
+      if (d) return use(current, d.value());
+
+      // the current page is full, as long as there is only one page we let it grow
+      while (pages.size() == 1 && pages[0].atlas->width() < maxSize)
+      {
+        pages[0].atlas->doubleSize();
+
+        d = pages[0].atlas->find(k, f);
+        if (d) return use(0, d.value());
+      }
+
+      if (pages.size() < maxPages)
+      {
+        addPage(pages[0].atlas->width());
+        current = pages.size()-1;
+      }
+      else
+      {
+        // reuse the least recently used page, as long as that is not pinned or required for the current batch
+        auto lru = pages.end();
+
+        for (auto p = pages.begin(); p != pages.end(); p++)
+          if (p->pins == 0 && (lru == pages.end() || p->lastUse < lru->lastUse))
+            lru = p;
+
+        if (lru == pages.end() || lru->lastUse == batch)
+          return std::experimental::optional<FontAtlasData_c>();
+
+        lru->atlas->clear();
+        lru->id = nextId++;
+        current = lru - pages.begin();
+      }
+
+      d = pages[current].atlas->find(k, f);
+      if (d) return use(current, d.value());
+
+      return std::experimental::optional<FontAtlasData_c>();
+    }
+
+  public:
+
+    const uint16_t blurrmax = 20;
+
+    // when fieldSz is not 0 the atlas works in distance field mode with that reference size in pixels
+    PagedGlyphAtlas_c(uint32_t startSize, uint32_t maxSz, uint32_t maxPg, uint32_t fieldSz = 0) :
+      maxSize(maxSz), maxPages(std::max(maxPg, 1u)), fieldSize(fieldSz), spread(fieldSz/8)
+    {
+      if (fieldSize > 0)
+      {
+        spread = std::max(spread, (uint16_t)1);
+        fieldFonts = std::make_unique<FontCache_c>();
+      }
+
+      addPage(startSize);
+    }
+
+    // is the glyph stored as a distance field?
+    bool isDistanceField(const std::shared_ptr<FontFace_c> & face, uint16_t blurr) const
+    {
+      // the field can represent soft edges that are as wide as the spread on the target
+      return fieldSize > 0 && (uint64_t)blurr*fieldSize <= (uint64_t)spread*face->getSize();
+    }
+
+    // size of one distance field pixel on the target for glyphs of the given font
+    double distanceScale(const std::shared_ptr<FontFace_c> & face) const
+    {
+      return face->getSize()/(64.0*fieldSize);
+    }
+
+    uint16_t distanceSpread(void) const { return spread; }
+
+    std::experimental::optional<FontAtlasData_c> getGlyph(std::shared_ptr<FontFace_c> face, glyphIndex_t glyph, SubPixelArrangement sp, uint16_t blurr)
+    {
+      if (isDistanceField(face, blurr))
+      {
+        auto f = fieldFonts->getFont(face->getResource(), 64*fieldSize);
+        return find(internal::GlyphKey_c(f, glyph, SUBP_NONE, 0), f);
+      }
+
+      // glyphs with a certain blurr are always without subpixel placement,
+      // you'd not recognize the difference
+      if (blurr > blurrmax) sp = SUBP_NONE;
+
+      return find(internal::GlyphKey_c(face, glyph, sp, blurr), face);
+    }
+
+    std::experimental::optional<FontAtlasData_c> getRect(int w, int h, SubPixelArrangement, uint16_t blurr)
+    {
+      // rectangles are always without sub-pixel placement
+      return find(internal::GlyphKey_c(w, h, SUBP_NONE, blurr), std::shared_ptr<FontFace_c>());
+    }
+
+    // the small completely filled rectangle that is used for drawing unblurred rectangles
+    std::experimental::optional<FontAtlasData_c> getFilledRect(void)
+    {
+      return getRect(640, 640, SUBP_NONE, 0);
+    }
+
+    // put the images for the commands starting at index i into the atlas. The function returns
+    // the index of the first command that could not be added, all commands before that
+    // one can be drawn with the current atlas content. When the returned value is equal to i
+    // the image for that command doesn't even fit into an empty page. When used is given, the
+    // pages that contain the images are added to it
+    size_t prepare(const std::vector<CommandData_c> & dat, size_t i, SubPixelArrangement sp,
+                   std::vector<uint32_t> * used = nullptr)
+    {
+      while (i < dat.size())
+      {
+        auto & ii = dat[i];
+
+        std::experimental::optional<FontAtlasData_c> d;
+
+        switch (ii.command)
+        {
+          case CommandData_c::CMD_GLYPH:
+            // when subpixel placement is on we always create all 3 required images
+            d = getGlyph(ii.font, ii.glyphIndex, sp, ii.blurr);
+            break;
+          case CommandData_c::CMD_RECT:
+            if (ii.blurr > 0)
+              d = getRect(ii.w, ii.h, sp, ii.blurr);
+            else
+              d = getFilledRect();
+            break;
+
+          default:
+            d = FontAtlasData_c();
+            break;
+        }
+
+        if (!d) break;
+
+        if (used && ii.command != CommandData_c::CMD_IMAGE && std::find(used->begin(), used->end(), d.value().page) == used->end())
+          used->push_back(d.value().page);
+
+        i++;
+      }
+
+      return i;
+    }
+
+    // start a new batch, pages used up to now may be reused
+    void nextBatch(void) { batch++; }
+
+    // mark a page as used within the current batch
+    void touch(uint32_t p) { pages[p].lastUse = batch; }
+
+    // pin and unpin a page, the id must be the id of the page when it was pinned, pins
+    // of content that has been cleared in the meantime are ignored
+    void pin(uint32_t p) { pages[p].pins++; }
+
+    void unpin(uint32_t p, uint32_t id)
+    {
+      if (p < pages.size() && pages[p].id == id && pages[p].pins > 0)
+        pages[p].pins--;
+    }
+
+    uint32_t pageCount(void) const { return pages.size(); }
+    GlyphAtlas_c & page(uint32_t p) { return *pages[p].atlas; }
+    const GlyphAtlas_c & page(uint32_t p) const { return *pages[p].atlas; }
+
+    // the id of the page content, as long as the id stays the same, all images on that page
+    // stay where they are
+    uint32_t pageId(uint32_t p) const { return pages[p].id; }
+
+    // all pages have the same size
+    uint32_t width(void) const { return pages[0].atlas->width(); }
+    uint32_t height(void) const { return pages[0].atlas->height(); }
+
+    void clear(void)
+    {
+      for (auto & p : pages)
+      {
+        p.atlas->clear();
+        p.id = nextId++;
+        p.pins = 0;
+      }
+
+      savedFonts.clear();
+    }
+
+    // write the content of all pages into a file, returns false when the file can not be written
+    bool save(const std::string & filename) const;
+
+    // replace the content of the atlas with the content of a file written by save. The file
+    // must have been written with the same distance field settings and it must not contain more
+    // pages than allowed for this atlas. When the file can not be used, false is returned and
+    // the atlas is unchanged. All pages get new ids and need to be uploaded completely
+    bool load(const std::string & filename);
+};
+
 } }
 
 #endif
@@ -25,16 +25,36 @@
 
 #include <stll/layouterFont.h>
 #include <stll/internal/glyphKey.h>
+#include <stll/internal/slabAllocator.h>
+#include <stll/internal/sharedGlyphCache.h>
 
 #include <unordered_map>
+#include <vector>
+#include <memory>
 #include <cstdint>
 
 
 namespace STLL { namespace internal {
 
+// kinds of runs within span encoded images, the run header is a 16 bit little endian
+// value with the kind in the upper 2 bits and the length of the run in the lower 14 bits
+// literal runs are followed by the coverage values of the run
+enum
+{
+  SPAN_EMPTY = 0,    // all values are 0
+  SPAN_FULL = 1,     // all values are 255
+  SPAN_LITERAL = 2,  // the values are stored after the header
+  SPAN_MAXLEN = 0x3FFF
+};
+
 // encapsulation for an object to paint it contains the data for the alpha value
 // of an object to paint. It is used to store information about single glyphs or
 // single rectangles to draw
+//
+// the alpha values are either stored as a normal bytemap or, when that is a lot smaller,
+// as runs of empty, full and other values. The buffer then starts with one 32 bit offset
+// for each row, pointing to the first run of that row. The runs of a row cover the complete
+// pitch of the image
 class PaintData_c
 {
   public:
@@ -43,16 +63,33 @@ class PaintData_c
     int32_t rows;  // hight of image
     int32_t width; // width of image
     int32_t pitch; // number of bytes per line of image, guaranteed to be at least 1 or 2 bigger than width
-    std::unique_ptr<uint8_t[]> buffer;
+    uint8_t * buffer; // the image data, it belongs to the allocator given in the constructor
+    uint32_t slab;    // slab of the allocator that contains the buffer
+    bool spans;       // the buffer contains span encoded data
     uint32_t lastUse;
 
-    // create from Freetype glyph data
-    PaintData_c(const FontFace_c::GlyphSlot_c & ft, uint16_t blurr, SubPixelArrangement sp);
+    // create from Freetype glyph data, when a scratch buffer is given, big images
+    // are span encoded when that saves enough memory
+    PaintData_c(const FontFace_c::GlyphSlot_c & ft, uint16_t blurr, SubPixelArrangement sp, SlabAllocator_c & mem,
+                std::vector<uint8_t> * scratch);
 
     // create rectangle data
-    PaintData_c(uint16_t width, uint16_t height, uint16_t blurr, SubPixelArrangement sp);
+    PaintData_c(uint16_t width, uint16_t height, uint16_t blurr, SubPixelArrangement sp, SlabAllocator_c & mem,
+                std::vector<uint8_t> * scratch);
+
+    // empty image, the shared glyph cache fills in the fields
+    PaintData_c(void) : left(0), top(0), rows(0), width(0), pitch(0), buffer(nullptr), slab(0), spans(false), lastUse(0) { }
+
+    // the bytemap, only valid when the image is not span encoded
+    const uint8_t * getBuffer(void) const { return buffer; }
 
-    const uint8_t * getBuffer(void) const { return buffer.get(); }
+    // the first run of a row, only valid when the image is span encoded
+    const uint8_t * getSpans(int row) const { return buffer + ((const uint32_t*)buffer)[row]; }
+
+  private:
+
+    // copy the image into memory from the allocator, span encoded when that is sufficiently smaller
+    void store(const uint8_t * img, SlabAllocator_c & mem);
 };
 
 class GlyphCache_c
@@ -61,15 +98,48 @@ class GlyphCache_c
     // our glyph cache with all the rendered glyphs
     std::unordered_map<GlyphKey_c, PaintData_c> glyphCache;
 
+    // the memory for the images of the glyphs
+    SlabAllocator_c memory;
+
+    // store big images span encoded, they are first rendered into the scratch buffer
+    bool compress = true;
+    std::vector<uint8_t> scratch;
+
     // each time we access a glyph from the cache we increase this number
     // and write the value into the lastUse field of the rendered glyph
     // that is how we can find out glyphs that were not used the longest time
     uint32_t useCounter = 0;
 
+    // render glyphs with the internal rasterizer instead of FreeType
+    bool outlines = false;
+
+    // when set the images are taken from and added to this cache, so that other
+    // processes can use them as well
+    std::shared_ptr<SharedGlyphCache_c> shared;
+
+    // add an image that is not yet in the cache, it is taken from the shared cache or created
+    // with the create function and then added to the shared cache, key creates the key for the shared cache
+    template <class K, class F>
+    PaintData_c & add(const GlyphKey_c & k, K key, F create);
+
   public:
     PaintData_c & getGlyph(std::shared_ptr<FontFace_c> face, glyphIndex_t glyph, SubPixelArrangement sp, uint16_t blurr);
     PaintData_c & getRect(int w, int h, SubPixelArrangement sp, uint16_t blurr);
     void trim(size_t num);
+
+    // number of bytes used for the glyph images
+    size_t getMemory(void) const { return memory.capacity(); }
+
+    // enable or disable span encoding for newly rendered images
+    void setCompression(bool c) { compress = c; }
+
+    // use a cache in shared memory in addition to the own memory, nullptr to stop using it
+    // this empties the cache
+    void setShared(std::shared_ptr<SharedGlyphCache_c> s);
+
+    // render the glyphs with FontFace_c::renderOutline instead of FontFace_c::renderGlyph,
+    // changing this setting empties the cache
+    void setOutlineRendering(bool o);
 };
 
 } }
@@ -83,6 +83,13 @@ class OGL_Program_c
       glBindAttribLocation(handle, position, name.c_str());
     }
 
+    // bind a fragment shader output to a colour number and index for dual source blending
+    // must be called before link
+    void bindFragDataLocation(int colour, int index, const std::string & name)
+    {
+      glBindFragDataLocationIndexed(handle, colour, index, name.c_str());
+    }
+
     void link(void)
     {
       glLinkProgram(handle);
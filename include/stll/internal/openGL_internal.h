@@ -2,9 +2,53 @@
 #define STLL_OPENGL_INTERNALS_H
 
 #include "ogl_shader.h"
+#include "glyphAtlas.h"
+
+#include <array>
+#include <vector>
+#include <limits>
 
 namespace STLL { namespace internal {
 
+// offset and clip rectangle for the quads of one layout, used when many layouts are drawn
+// together in one frame and the offset can not be given when drawing
+class FrameClip_c
+{
+  public:
+    float ox = 0, oy = 0;
+    float x1 = std::numeric_limits<float>::lowest();
+    float y1 = std::numeric_limits<float>::lowest();
+    float x2 = std::numeric_limits<float>::max();
+    float y2 = std::numeric_limits<float>::max();
+
+    // move and clip a quad, the data contains x1, x2, y1, y2, u1, u2, v1, v2 in that order,
+    // the texture coordinates are cut back together with the positions. Returns false
+    // when nothing of the quad is left
+    bool apply(std::array<float, 8> & d) const
+    {
+      d[0] += ox; d[1] += ox;
+      d[2] += oy; d[3] += oy;
+
+      if (d[0] >= x2 || d[1] <= x1 || d[2] >= y2 || d[3] <= y1) return false;
+
+      if (d[0] < x1) { d[4] += (d[5]-d[4])*(x1-d[0])/(d[1]-d[0]); d[0] = x1; }
+      if (d[1] > x2) { d[5] -= (d[5]-d[4])*(d[1]-x2)/(d[1]-d[0]); d[1] = x2; }
+      if (d[2] < y1) { d[6] += (d[7]-d[6])*(y1-d[2])/(d[3]-d[2]); d[2] = y1; }
+      if (d[3] > y2) { d[7] -= (d[7]-d[6])*(d[3]-y2)/(d[3]-d[2]); d[3] = y2; }
+
+      return true;
+    }
+};
+
+// a range of primitives that use the same atlas page, the range starts at first and
+// ends at the start of the next range, the units of first depend on the OpenGL version
+class PageRun_c
+{
+  public:
+    GLuint texture;
+    uint32_t first;
+};
+
 // base class that implements the OpenGL functionality
 // all OpenGL classes are specialisations of this class
 template <int V>
@@ -21,10 +65,14 @@ class openGL_internals
     // outputs are performed
     void setupProjection(int width, int height) { }
 
-    // when the texture has changed this will be called and you will need
-    // to reuploade it, texture size might change as well
+    // when the texture has changed its size this will be called and you will need
+    // to reuploade it completely
     void updateTexture(const uint8_t * data, int C) { }
 
+    // when parts of the texture have changed this will be called for each
+    // of the changed regions, only that region needs to be uploaded
+    void updateTextureRegion(const uint8_t * data, int C, const AtlasRegion_c & r) { }
+
     // this is a class you must declare for cached drawing put all variables
     // in here for your cache. Make sure that it can either properly copy
     // or only move and make sure you free all your resources when the objects
@@ -32,9 +80,14 @@ class openGL_internals
     class DrawCacheInternal_c { };
 
     // this class must contain information you need when doing a draw, e.g. buffers
-    // for vertices or such
+    // for vertices or such, it must have a FrameClip_c member called clip that is applied
+    // to all drawn quads
     class CreateInternal_c { };
 
+    // true, when the drawing functions draw immediately instead of collecting
+    // the quads for endPreparation
+    static const bool immediate = false;
+
     // this is called, when a cache is drawn, at first it is checked, whether
     // the cache that was used to create this drawcache is still useful and if
     // so this drawing function is called
@@ -45,18 +98,34 @@ class openGL_internals
     // add to the cache when end cache preparation is called and you also need to
     // draw the cache
     void startCachePreparation(DrawCacheInternal_c &) { }
-    void endCachePreparation(DrawCacheInternal_c & dc, CreateInternal_c &, SubPixelArrangement sp, int sx, int sy, uint32_t atlasId, int C) { }
+    void endCachePreparation(DrawCacheInternal_c & dc, CreateInternal_c &, SubPixelArrangement sp, int sx, int sy, int C) { }
 
     // this pair is used, when no cache is going to be made (e.g, the user provided
     // no cache object, or the layout is too complex and requires texture atlas flushes
     void startPreparation(int sx, int sy) { }
     void endPreparation(CreateInternal_c &, SubPixelArrangement sp, int sx, int sy, int C) { }
 
+    // draw quads that have been created in advance (possibly on a different thread) for an
+    // atlas of size scale, the atlas might have grown to size C in the meantime. The quads
+    // were created with page numbers instead of textures in selectPage, textures contains
+    // the texture for each page. Not required for immediate drawing
+    void drawPrepared(CreateInternal_c &, SubPixelArrangement sp, int sx, int sy, int C, int scale, const std::vector<GLuint> & textures) { }
+
+    // the following drawing functions use the atlas page with the given texture, this is called
+    // before the first drawing function and whenever the page changes. The drawing functions are
+    // static, when they collect quads into vb they must not call OpenGL, so that layouts can be
+    // prepared without an OpenGL context (see VertexPreparation_c)
+    static void selectPage(CreateInternal_c & vb, GLuint texture) { }
+
     // drawing functions for normal rectangles, smooth rectangles, and glyphs
-    void drawRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C) { }
-    void drawSmoothRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C) { }
-    void drawSubpGlyph() { }
-    void drawNormalGlyph(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C) { }
+    static void drawRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C) { }
+    static void drawSmoothRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C) { }
+    static void drawSubpGlyph(CreateInternal_c & vb, SubPixelArrangement sp, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C) { }
+    static void drawNormalGlyph(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C) { }
+
+    // draw a glyph from a distance field, scale is the size of one field pixel on the target
+    // and spread the spread of the field, only required when distance fields are supported
+    static void drawDistanceGlyph(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, double scale, uint16_t spread, int C) { }
 };
 
 
@@ -64,8 +133,22 @@ template <>
 class openGL_internals<1>
 {
   private:
+    // Helper function to draw one quad, data contains x1, x2, y1, y2, u1, u2, v1, v2
+    static void drawQuad(const FrameClip_c & clip, std::array<float, 8> data, Color_c c)
+    {
+      if (!clip.apply(data)) return;
+
+      glBegin(GL_QUADS);
+      glColor3f(c.r()/255.0, c.g()/255.0, c.b()/255.0);
+      glTexCoord2f(data[4], data[6]); glVertex3f(data[0], data[2], 0);
+      glTexCoord2f(data[5], data[6]); glVertex3f(data[1], data[2], 0);
+      glTexCoord2f(data[5], data[7]); glVertex3f(data[1], data[3], 0);
+      glTexCoord2f(data[4], data[7]); glVertex3f(data[0], data[3], 0);
+      glEnd();
+    }
+
     // Helper function to draw one glyph or one sub pixel color of one glyph
-    void drawGlyph(const CommandData_c & i, int subpcol, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawGlyph(const FrameClip_c & clip, const CommandData_c & i, int subpcol, const FontAtlasData_c & pos, Color_c c, int C)
     {
       double w = pos.width-1;
       double wo = 0;
@@ -76,13 +159,13 @@ class openGL_internals<1>
         wo = subpcol-2;
       }
 
-      glBegin(GL_QUADS);
-      glColor3f(c.r()/255.0, c.g()/255.0, c.b()/255.0);
-      glTexCoord2f(1.0*(pos.pos_x+wo)/C,             1.0*(pos.pos_y)/C);            glVertex3f(i.x/64.0+pos.left,   (i.y+32)/64-pos.top,            0);
-      glTexCoord2f(1.0*(pos.pos_x+wo+pos.width-1)/C, 1.0*(pos.pos_y)/C);            glVertex3f(i.x/64.0+pos.left+w, (i.y+32)/64-pos.top,            0);
-      glTexCoord2f(1.0*(pos.pos_x+wo+pos.width-1)/C, 1.0*(pos.pos_y+pos.rows-1)/C); glVertex3f(i.x/64.0+pos.left+w, (i.y+32)/64-pos.top+pos.rows-1, 0);
-      glTexCoord2f(1.0*(pos.pos_x+wo)/C,             1.0*(pos.pos_y+pos.rows-1)/C); glVertex3f(i.x/64.0+pos.left,   (i.y+32)/64-pos.top+pos.rows-1, 0);
-      glEnd();
+      std::array<float, 8> data;
+      data[0] = i.x/64.0+pos.left;               data[1] = i.x/64.0+pos.left+w;
+      data[2] = (i.y+32)/64-pos.top;             data[3] = (i.y+32)/64-pos.top+pos.rows-1;
+      data[4] = 1.0*(pos.pos_x+wo)/C;            data[5] = 1.0*(pos.pos_x+wo+pos.width-1)/C;
+      data[6] = 1.0*(pos.pos_y)/C;               data[7] = 1.0*(pos.pos_y+pos.rows-1)/C;
+
+      drawQuad(clip, data, c);
     }
 
     void drawBuffers(GLuint displayList, SubPixelArrangement /*sp*/, int sx, int sy, float texscaler)
@@ -121,11 +204,17 @@ class openGL_internals<1>
       glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, C, C, 0, GL_ALPHA, GL_UNSIGNED_BYTE, data);
     }
 
+    void updateTextureRegion(const uint8_t * data, int C, const AtlasRegion_c & r)
+    {
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, C);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, GL_ALPHA, GL_UNSIGNED_BYTE, data+r.y*C+r.x);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+
     class DrawCacheInternal_c
     {
       public:
         GLuint vDisplayList;
-        uint32_t atlasId;
         uint32_t scale;
 
         ~DrawCacheInternal_c(void)
@@ -133,19 +222,20 @@ class openGL_internals<1>
           glDeleteLists(vDisplayList, 1);
         }
 
-        DrawCacheInternal_c(void) : vDisplayList(0), atlasId(0) {}
+        DrawCacheInternal_c(void) : vDisplayList(0) {}
 
         DrawCacheInternal_c(const DrawCacheInternal_c &) = delete;
 
         DrawCacheInternal_c(DrawCacheInternal_c && orig)
         {
           vDisplayList = orig.vDisplayList; orig.vDisplayList = 0;
+          scale = orig.scale;
         }
 
         void operator=(DrawCacheInternal_c && orig)
         {
           vDisplayList = orig.vDisplayList; orig.vDisplayList = 0;
-          atlasId = orig.atlasId; orig.atlasId = 0;
+          scale = orig.scale;
         }
     };
 
@@ -159,9 +249,13 @@ class openGL_internals<1>
     class CreateInternal_c
     {
       public:
+        FrameClip_c clip;
+
         CreateInternal_c(size_t /*s*/) { }
     };
 
+    static const bool immediate = true;
+
     void startCachePreparation(DrawCacheInternal_c & dc)
     {
       if (dc.vDisplayList == 0)
@@ -171,13 +265,12 @@ class openGL_internals<1>
       glNewList(dc.vDisplayList, GL_COMPILE);
     }
 
-    void endCachePreparation(DrawCacheInternal_c & dc, CreateInternal_c &, SubPixelArrangement sp, int sx, int sy, uint32_t atlasId, int C)
+    void endCachePreparation(DrawCacheInternal_c & dc, CreateInternal_c &, SubPixelArrangement sp, int sx, int sy, int C)
     {
       glEndList();
       glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
       drawBuffers(dc.vDisplayList, sp, sx, sy, 1);
 
-      dc.atlasId = atlasId;
       dc.scale = C;
     }
 
@@ -193,67 +286,76 @@ class openGL_internals<1>
       glPopMatrix();
     }
 
-    void drawRectangle(CreateInternal_c & /*vb*/, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    // OpenGL 1 draws immediately, so there is nothing prepared to draw
+    void drawPrepared(CreateInternal_c & /*vb*/, SubPixelArrangement /*sp*/, int /*sx*/, int /*sy*/, int /*C*/, int /*scale*/,
+                      const std::vector<GLuint> & /*textures*/) { }
+
+    static void selectPage(CreateInternal_c & /*vb*/, GLuint texture)
     {
-      glBegin(GL_QUADS);
-      glColor3f(c.r()/255.0, c.g()/255.0, c.b()/255.0);
-      int x = (ii.x+32)/64;
-      int y = (ii.y+32)/64;
-      int w = (ii.x+ii.w+32)/64;
-      int h = (ii.y+ii.h+32)/64;
-      glTexCoord2f(1.0*(pos.pos_x+5)/C, 1.0*(pos.pos_y+5)/C); glVertex3f(x, y, 0);
-      glTexCoord2f(1.0*(pos.pos_x+5)/C, 1.0*(pos.pos_y+5)/C); glVertex3f(w, y, 0);
-      glTexCoord2f(1.0*(pos.pos_x+5)/C, 1.0*(pos.pos_y+5)/C); glVertex3f(w, h, 0);
-      glTexCoord2f(1.0*(pos.pos_x+5)/C, 1.0*(pos.pos_y+5)/C); glVertex3f(x, h, 0);
-      glEnd();
+      // we draw immediately (or into the display list) so simply bind the texture
+      glBindTexture(GL_TEXTURE_2D, texture);
     }
 
-    void drawSmoothRectangle(CreateInternal_c & /*vb*/, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
-      glBegin(GL_QUADS);
-      glColor3f(c.r()/255.0, c.g()/255.0, c.b()/255.0);
-      glTexCoord2f(1.0*(pos.pos_x)/C,             1.0*(pos.pos_y)/C);            glVertex3f(ii.x/64.0+pos.left,             (ii.y+32)/64-pos.top,            0);
-      glTexCoord2f(1.0*(pos.pos_x+pos.width-1)/C, 1.0*(pos.pos_y)/C);            glVertex3f(ii.x/64.0+pos.left+pos.width-1, (ii.y+32)/64-pos.top,            0);
-      glTexCoord2f(1.0*(pos.pos_x+pos.width-1)/C, 1.0*(pos.pos_y+pos.rows-1)/C); glVertex3f(ii.x/64.0+pos.left+pos.width-1, (ii.y+32)/64-pos.top+pos.rows-1, 0);
-      glTexCoord2f(1.0*(pos.pos_x)/C,             1.0*(pos.pos_y+pos.rows-1)/C); glVertex3f(ii.x/64.0+pos.left,             (ii.y+32)/64-pos.top+pos.rows-1, 0);
-      glEnd();
+      std::array<float, 8> data;
+      data[0] = (ii.x+32)/64;          data[1] = (ii.x+ii.w+32)/64;
+      data[2] = (ii.y+32)/64;          data[3] = (ii.y+ii.h+32)/64;
+      data[4] = 1.0*(pos.pos_x+5)/C;   data[5] = 1.0*(pos.pos_x+5)/C;
+      data[6] = 1.0*(pos.pos_y+5)/C;   data[7] = 1.0*(pos.pos_y+5)/C;
+
+      drawQuad(vb.clip, data, c);
     }
 
-    void drawNormalGlyph(CreateInternal_c & /*vb*/, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawSmoothRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
-      drawGlyph(ii, 0, pos, c, C);
+      std::array<float, 8> data;
+      data[0] = ii.x/64.0+pos.left;                data[1] = ii.x/64.0+pos.left+pos.width-1;
+      data[2] = (ii.y+32)/64-pos.top;              data[3] = (ii.y+32)/64-pos.top+pos.rows-1;
+      data[4] = 1.0*(pos.pos_x)/C;                 data[5] = 1.0*(pos.pos_x+pos.width-1)/C;
+      data[6] = 1.0*(pos.pos_y)/C;                 data[7] = 1.0*(pos.pos_y+pos.rows-1)/C;
+
+      drawQuad(vb.clip, data, c);
+    }
+
+    static void drawNormalGlyph(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    {
+      drawGlyph(vb.clip, ii, 0, pos, c, C);
     }
 
-    void drawSubpGlyph(CreateInternal_c & /*vb*/, SubPixelArrangement sp, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawSubpGlyph(CreateInternal_c & vb, SubPixelArrangement sp, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
       switch (sp)
       {
         case SUBP_RGB:
         {
-          glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE); drawGlyph(ii, 1, pos, c, C);
-          glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE); drawGlyph(ii, 2, pos, c, C);
-          glColorMask(GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE); drawGlyph(ii, 3, pos, c, C);
+          glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE); drawGlyph(vb.clip, ii, 1, pos, c, C);
+          glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE); drawGlyph(vb.clip, ii, 2, pos, c, C);
+          glColorMask(GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE); drawGlyph(vb.clip, ii, 3, pos, c, C);
           glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
         }
         break;
 
         case SUBP_BGR:
         {
-          glColorMask(GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE); drawGlyph(ii, 1, pos, c, C);
-          glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE); drawGlyph(ii, 2, pos, c, C);
-          glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE); drawGlyph(ii, 3, pos, c, C);
+          glColorMask(GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE); drawGlyph(vb.clip, ii, 1, pos, c, C);
+          glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE); drawGlyph(vb.clip, ii, 2, pos, c, C);
+          glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE); drawGlyph(vb.clip, ii, 3, pos, c, C);
           glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
         }
         break;
 
         default:
         {
-          drawGlyph(ii, 0, pos, c, C);
+          drawGlyph(vb.clip, ii, 0, pos, c, C);
         }
         break;
       }
     }
 
+    // distance fields are only supported with OpenGL 3, the atlas never contains them here
+    static void drawDistanceGlyph(CreateInternal_c & /*vb*/, const CommandData_c & /*ii*/, const FontAtlasData_c & /*pos*/, Color_c /*c*/, double /*scale*/, uint16_t /*spread*/, int /*C*/) { }
+
 };
 
 template <>
@@ -263,8 +365,27 @@ class openGL_internals<2>
 
     internal::OGL_Program_c program;
 
+    // program for drawing sub pixel output in one pass with dual source blending
+    internal::OGL_Program_c lcdProgram;
+    bool dualSource;
+
     GLuint vertexBuffer;
 
+    // dual source blending is part of OpenGL 3.3, before that we need the extension and
+    // at least OpenGL 3.0 for the shader outputs
+    static bool hasDualSourceBlending(void)
+    {
+      int major = 0, minor = 0;
+      const char * v = (const char*)glGetString(GL_VERSION);
+
+      if (!v || sscanf(v, "%d.%d", &major, &minor) != 2 || major < 3) return false;
+      if (major > 3 || minor >= 3) return true;
+
+      const char * e = (const char*)glGetString(GL_EXTENSIONS);
+
+      return e && strstr(e, "GL_ARB_blend_func_extended");
+    }
+
     class vertex
     {
     public:
@@ -276,13 +397,41 @@ class openGL_internals<2>
       x(_x), y(_y), u(_u), v(_v), r(c.r()), g(c.g()), b(c.b()), a(c.a()) {}
     };
 
-    void drawBuffers(SubPixelArrangement sp, size_t s, int sx, int sy, int C, float texscaler)
+
+    void drawRuns(const std::vector<PageRun_c> & runs, size_t s)
+    {
+      for (size_t r = 0; r < runs.size(); r++)
+      {
+        size_t end = r+1 < runs.size() ? runs[r+1].first : s;
+
+        glBindTexture(GL_TEXTURE_2D, runs[r].texture);
+        glDrawArrays(GL_QUADS, runs[r].first, end-runs[r].first);
+      }
+    }
+
+    void drawBuffers(SubPixelArrangement sp, size_t s, const std::vector<PageRun_c> & runs, int sx, int sy, int C, float texscaler)
     {
       glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
       glEnableVertexAttribArray(0); glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, x));
       glEnableVertexAttribArray(1); glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, u));
       glEnableVertexAttribArray(2); glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, r));
 
+      if (dualSource && (sp == SUBP_RGB || sp == SUBP_BGR))
+      {
+        // all 3 channels in one pass, the alpha channel is not touched
+        // just like in the multi pass version below
+        glBlendFunc(GL_SRC1_COLOR, GL_ONE_MINUS_SRC1_COLOR);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE);
+
+        lcdProgram.setUniform("offset", sx/64.0, sy/64);
+        lcdProgram.setUniform("texscaler", texscaler);
+        lcdProgram.setUniform("lshift", sp == SUBP_RGB ? 1.0f/C : -1.0f/C);
+        drawRuns(runs, s);
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        return;
+      }
+
       program.setUniform("offset", sx/64.0, sy/64);
       program.setUniform("texscaler", texscaler);
 
@@ -290,21 +439,21 @@ class openGL_internals<2>
       {
         default:
         case SUBP_NONE:
-          program.setUniform("ashift", 0);
-          glDrawArrays(GL_QUADS, 0, s);
+          program.setUniform("ashift", 0.0f);
+          drawRuns(runs, s);
           break;
 
         case SUBP_RGB:
-          glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE); program.setUniform("ashift", -1.0f/C); glDrawArrays(GL_QUADS, 0, s);
-          glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE); program.setUniform("ashift", -0.0f/C); glDrawArrays(GL_QUADS, 0, s);
-          glColorMask(GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE); program.setUniform("ashift",  1.0f/C); glDrawArrays(GL_QUADS, 0, s);
+          glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE); program.setUniform("ashift", -1.0f/C); drawRuns(runs, s);
+          glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE); program.setUniform("ashift", -0.0f/C); drawRuns(runs, s);
+          glColorMask(GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE); program.setUniform("ashift",  1.0f/C); drawRuns(runs, s);
           glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
           break;
 
         case SUBP_BGR:
-          glColorMask(GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE); program.setUniform("ashift", -1.0f/C); glDrawArrays(GL_QUADS, 0, s);
-          glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE); program.setUniform("ashift", -0.0f/C); glDrawArrays(GL_QUADS, 0, s);
-          glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE); program.setUniform("ashift",  1.0f/C); glDrawArrays(GL_QUADS, 0, s);
+          glColorMask(GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE); program.setUniform("ashift", -1.0f/C); drawRuns(runs, s);
+          glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE); program.setUniform("ashift", -0.0f/C); drawRuns(runs, s);
+          glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE); program.setUniform("ashift",  1.0f/C); drawRuns(runs, s);
           glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
           break;
       }
@@ -352,6 +501,63 @@ class openGL_internals<2>
       program.setUniform("texture", 0);
       program.setUniform("texscaler", 1.0f);
 
+      dualSource = hasDualSourceBlending();
+
+      if (dualSource)
+      {
+        lcdProgram.attachShader(GL_FRAGMENT_SHADER, "130",
+          "uniform sampler2D atlas;"
+          "uniform float lshift;"
+
+          "in vec2 TexCoord;"
+          "in vec3 ourColor;"
+
+          "out vec4 color;"
+          "out vec4 alpha;"
+
+          "void main()"
+          "{"
+          "  float r = texture(atlas, vec2(TexCoord.x-lshift, TexCoord.y)).a;"
+          "  float g = texture(atlas, TexCoord).a;"
+          "  float b = texture(atlas, vec2(TexCoord.x+lshift, TexCoord.y)).a;"
+          "  color = vec4(ourColor, 1.0);"
+          "  alpha = vec4(r, g, b, 1.0);"
+          "}"
+        );
+
+        lcdProgram.attachShader(GL_VERTEX_SHADER, "130",
+          "uniform float width;"
+          "uniform float height;"
+          "uniform float texscaler;"
+          "uniform vec2 offset;"
+
+          "in vec2 vertex;"
+          "in vec4 color;"
+          "in vec2 tex_coord;"
+
+          "out vec2 TexCoord;"
+          "out vec3 ourColor;"
+
+          "void main()"
+          "{"
+          "  ourColor = vec3(color.r/255.0, color.g/255.0, color.b/255.0);"
+          "  TexCoord = tex_coord/texscaler;"
+          "  gl_Position = vec4((vertex.x-width+offset.x)/width, 1.0-(vertex.y+offset.y)/height, 0, 1.0);"
+          "}"
+        );
+
+        lcdProgram.bindAttributeLocation(0, "vertex");
+        lcdProgram.bindAttributeLocation(1, "tex_coord");
+        lcdProgram.bindAttributeLocation(2, "color");
+        lcdProgram.bindFragDataLocation(0, 0, "color");
+        lcdProgram.bindFragDataLocation(0, 1, "alpha");
+
+        lcdProgram.link();
+
+        lcdProgram.setUniform("atlas", 0);
+        lcdProgram.setUniform("texscaler", 1.0f);
+      }
+
       glGenBuffers(1, &vertexBuffer);
     }
 
@@ -365,6 +571,12 @@ class openGL_internals<2>
       glViewport(0, 0, width, height);
       program.setUniform("width", width/2.0f);
       program.setUniform("height", height/2.0f);
+
+      if (dualSource)
+      {
+        lcdProgram.setUniform("width", width/2.0f);
+        lcdProgram.setUniform("height", height/2.0f);
+      }
     }
 
     void updateTexture(const uint8_t * data, int C)
@@ -372,6 +584,13 @@ class openGL_internals<2>
       glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, C, C, 0, GL_ALPHA, GL_UNSIGNED_BYTE, data);
     }
 
+    void updateTextureRegion(const uint8_t * data, int C, const AtlasRegion_c & r)
+    {
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, C);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, GL_ALPHA, GL_UNSIGNED_BYTE, data+r.y*C+r.x);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+
     /** \brief class to store a layout in a cached format for even faster repaint */
     class DrawCacheInternal_c
     {
@@ -379,15 +598,15 @@ class openGL_internals<2>
 
       GLuint vBuffer;
       size_t elements;
-      uint32_t atlasId;
       uint32_t scale;
+      std::vector<PageRun_c> runs;
 
       ~DrawCacheInternal_c(void)
       {
         glDeleteBuffers(1, &vBuffer);
       }
 
-      DrawCacheInternal_c(void) : vBuffer(0), elements(0), atlasId(0) {}
+      DrawCacheInternal_c(void) : vBuffer(0), elements(0) {}
 
       DrawCacheInternal_c(const DrawCacheInternal_c &) = delete;
 
@@ -395,14 +614,16 @@ class openGL_internals<2>
       {
         vBuffer = orig.vBuffer; orig.vBuffer = 0;
         elements = orig.elements; orig.elements = 0;
-        atlasId = orig.atlasId; orig.atlasId = 0;
+        scale = orig.scale;
+        runs.swap(orig.runs);
       }
 
       void operator=(DrawCacheInternal_c && orig)
       {
         vBuffer = orig.vBuffer; orig.vBuffer = 0;
         elements = orig.elements; orig.elements = 0;
-        atlasId = orig.atlasId; orig.atlasId = 0;
+        scale = orig.scale;
+        runs.swap(orig.runs);
       }
     };
 
@@ -411,6 +632,8 @@ class openGL_internals<2>
     {
       public:
         std::vector<vertex> vb;
+        std::vector<PageRun_c> runs;
+        FrameClip_c clip;
 
         CreateInternal_c(size_t s)
         {
@@ -418,10 +641,12 @@ class openGL_internals<2>
         }
     };
 
+    static const bool immediate = false;
+
     void drawCache(DrawCacheInternal_c & dc, SubPixelArrangement sp, int sx, int sy, int C)
     {
       glBindBuffer(GL_ARRAY_BUFFER, dc.vBuffer);
-      drawBuffers(sp, dc.elements, sx, sy, C, C/dc.scale);
+      drawBuffers(sp, dc.elements, dc.runs, sx, sy, C, C/dc.scale);
     }
 
     void startCachePreparation(DrawCacheInternal_c & dc)
@@ -429,15 +654,15 @@ class openGL_internals<2>
       if (dc.vBuffer == 0) { glGenBuffers(1, &dc.vBuffer); }
       glBindBuffer(GL_ARRAY_BUFFER, dc.vBuffer);
     }
-    void endCachePreparation(DrawCacheInternal_c & dc, CreateInternal_c & vb, SubPixelArrangement sp, int sx, int sy, uint32_t atlasId, int C)
+    void endCachePreparation(DrawCacheInternal_c & dc, CreateInternal_c & vb, SubPixelArrangement sp, int sx, int sy, int C)
     {
       glBufferData(GL_ARRAY_BUFFER, sizeof(vertex)*vb.vb.size(), vb.vb.data(), GL_STATIC_DRAW);
 
-      drawBuffers(sp, vb.vb.size(), sx, sy, C, 1);
+      drawBuffers(sp, vb.vb.size(), vb.runs, sx, sy, C, 1);
 
-      dc.atlasId = atlasId;
       dc.elements = vb.vb.size();
       dc.scale = C;
+      dc.runs = vb.runs;
     }
 
     void startPreparation(int /*sx*/, int /*sy*/)
@@ -448,40 +673,85 @@ class openGL_internals<2>
     {
       glBufferData(GL_ARRAY_BUFFER, sizeof(vertex)*vb.vb.size(), vb.vb.data(), GL_STREAM_DRAW);
 
-      drawBuffers(sp, vb.vb.size(), sx, sy, C, 1);
+      drawBuffers(sp, vb.vb.size(), vb.runs, sx, sy, C, 1);
+    }
+
+    void drawPrepared(CreateInternal_c & vb, SubPixelArrangement sp, int sx, int sy, int C, int scale, const std::vector<GLuint> & textures)
+    {
+      for (auto & r : vb.runs)
+        r.texture = textures[r.texture];
+
+      glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(vertex)*vb.vb.size(), vb.vb.data(), GL_STREAM_DRAW);
+
+      drawBuffers(sp, vb.vb.size(), vb.runs, sx, sy, C, 1.0f*C/scale);
+    }
+
+    static void selectPage(CreateInternal_c & vb, GLuint texture)
+    {
+      vb.runs.push_back(PageRun_c { texture, (uint32_t)vb.vb.size() });
     }
 
-    void drawRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
-      vb.vb.push_back(vertex((ii.x+32)/64,      (ii.y+32)/64,      1.0*(pos.pos_x+5)/C,           1.0*(pos.pos_y+5)/C,          c));
-      vb.vb.push_back(vertex((ii.x+32+ii.w)/64, (ii.y+32)/64,      1.0*(pos.pos_x+pos.width-5)/C, 1.0*(pos.pos_y+5)/C,          c));
-      vb.vb.push_back(vertex((ii.x+32+ii.w)/64, (ii.y+32+ii.h)/64, 1.0*(pos.pos_x+pos.width-5)/C, 1.0*(pos.pos_y+pos.rows-5)/C, c));
-      vb.vb.push_back(vertex((ii.x+32)/64,      (ii.y+32+ii.h)/64, 1.0*(pos.pos_x+5)/C,           1.0*(pos.pos_y+pos.rows-5)/C, c));
+      std::array<float, 8> data;
+      data[0] = (ii.x+32)/64;                  data[1] = (ii.x+32+ii.w)/64;
+      data[2] = (ii.y+32)/64;                  data[3] = (ii.y+32+ii.h)/64;
+      data[4] = 1.0*(pos.pos_x+5)/C;           data[5] = 1.0*(pos.pos_x+pos.width-5)/C;
+      data[6] = 1.0*(pos.pos_y+5)/C;           data[7] = 1.0*(pos.pos_y+pos.rows-5)/C;
+
+      addQuad(vb, data, c);
     }
 
-    void drawSmoothRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawSmoothRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
-      vb.vb.push_back(vertex((ii.x+32)/64+pos.left,           (ii.y+32)/64-pos.top,         1.0*(pos.pos_x)/C,           1.0*(pos.pos_y)/C,          c));
-      vb.vb.push_back(vertex((ii.x+32)/64+pos.left+pos.width, (ii.y+32)/64-pos.top,         1.0*(pos.pos_x+pos.width)/C, 1.0*(pos.pos_y)/C,          c));
-      vb.vb.push_back(vertex((ii.x+32)/64+pos.left+pos.width, (ii.y+32)/64-pos.top+pos.rows,1.0*(pos.pos_x+pos.width)/C, 1.0*(pos.pos_y+pos.rows)/C, c));
-      vb.vb.push_back(vertex((ii.x+32)/64+pos.left,           (ii.y+32)/64-pos.top+pos.rows,1.0*(pos.pos_x)/C,           1.0*(pos.pos_y+pos.rows)/C, c));
+      std::array<float, 8> data;
+      data[0] = (ii.x+32)/64+pos.left;         data[1] = (ii.x+32)/64+pos.left+pos.width;
+      data[2] = (ii.y+32)/64-pos.top;          data[3] = (ii.y+32)/64-pos.top+pos.rows;
+      data[4] = 1.0*(pos.pos_x)/C;             data[5] = 1.0*(pos.pos_x+pos.width)/C;
+      data[6] = 1.0*(pos.pos_y)/C;             data[7] = 1.0*(pos.pos_y+pos.rows)/C;
+
+      addQuad(vb, data, c);
     }
 
-    void drawNormalGlyph(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawNormalGlyph(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
-      vb.vb.push_back(vertex((ii.x)/64.0+pos.left,           (ii.y+32)/64-pos.top,         1.0*(pos.pos_x)/C,           1.0*(pos.pos_y)/C,          c));
-      vb.vb.push_back(vertex((ii.x)/64.0+pos.left+pos.width, (ii.y+32)/64-pos.top,         1.0*(pos.pos_x+pos.width)/C, 1.0*(pos.pos_y)/C,          c));
-      vb.vb.push_back(vertex((ii.x)/64.0+pos.left+pos.width, (ii.y+32)/64-pos.top+pos.rows,1.0*(pos.pos_x+pos.width)/C, 1.0*(pos.pos_y+pos.rows)/C, c));
-      vb.vb.push_back(vertex((ii.x)/64.0+pos.left,           (ii.y+32)/64-pos.top+pos.rows,1.0*(pos.pos_x)/C,           1.0*(pos.pos_y+pos.rows)/C, c));
+      std::array<float, 8> data;
+      data[0] = (ii.x)/64.0+pos.left;          data[1] = (ii.x)/64.0+pos.left+pos.width;
+      data[2] = (ii.y+32)/64-pos.top;          data[3] = (ii.y+32)/64-pos.top+pos.rows;
+      data[4] = 1.0*(pos.pos_x)/C;             data[5] = 1.0*(pos.pos_x+pos.width)/C;
+      data[6] = 1.0*(pos.pos_y)/C;             data[7] = 1.0*(pos.pos_y+pos.rows)/C;
+
+      addQuad(vb, data, c);
+    }
+
+    static void drawSubpGlyph(CreateInternal_c & vb, SubPixelArrangement /*sp*/, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    {
+      std::array<float, 8> data;
+      data[0] = (ii.x)/64.0+pos.left;          data[1] = (ii.x)/64.0+pos.left+pos.width/3.0;
+      data[2] = (ii.y+32)/64-pos.top;          data[3] = (ii.y+32)/64-pos.top+pos.rows;
+      data[4] = 1.0*(pos.pos_x)/C;             data[5] = 1.0*(pos.pos_x+pos.width)/C;
+      data[6] = 1.0*(pos.pos_y)/C;             data[7] = 1.0*(pos.pos_y+pos.rows)/C;
+
+      addQuad(vb, data, c);
     }
 
-    void drawSubpGlyph(CreateInternal_c & vb, SubPixelArrangement /*sp*/, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+  private:
+
+    static void addQuad(CreateInternal_c & vb, std::array<float, 8> & data, Color_c c)
     {
-      vb.vb.push_back(vertex((ii.x)/64.0+pos.left,               (ii.y+32)/64-pos.top,         1.0*(pos.pos_x)/C,           1.0*(pos.pos_y)/C,          c));
-      vb.vb.push_back(vertex((ii.x)/64.0+pos.left+pos.width/3.0, (ii.y+32)/64-pos.top,         1.0*(pos.pos_x+pos.width)/C, 1.0*(pos.pos_y)/C,          c));
-      vb.vb.push_back(vertex((ii.x)/64.0+pos.left+pos.width/3.0, (ii.y+32)/64-pos.top+pos.rows,1.0*(pos.pos_x+pos.width)/C, 1.0*(pos.pos_y+pos.rows)/C, c));
-      vb.vb.push_back(vertex((ii.x)/64.0+pos.left,               (ii.y+32)/64-pos.top+pos.rows,1.0*(pos.pos_x)/C,           1.0*(pos.pos_y+pos.rows)/C, c));
+      if (!vb.clip.apply(data)) return;
+
+      vb.vb.push_back(vertex(data[0], data[2], data[4], data[6], c));
+      vb.vb.push_back(vertex(data[1], data[2], data[5], data[6], c));
+      vb.vb.push_back(vertex(data[1], data[3], data[5], data[7], c));
+      vb.vb.push_back(vertex(data[0], data[3], data[4], data[7], c));
     }
+
+  public:
+
+    // distance fields are only supported with OpenGL 3, the atlas never contains them here
+    static void drawDistanceGlyph(CreateInternal_c & /*vb*/, const CommandData_c & /*ii*/, const FontAtlasData_c & /*pos*/, Color_c /*c*/, double /*scale*/, uint16_t /*spread*/, int /*C*/) { }
 };
 
 template <>
@@ -490,21 +760,40 @@ class openGL_internals<3>
   private:
     internal::OGL_Program_c program;
 
-    GLuint vertexBuffer, vertexArray, vertexElement;
+    GLuint vertexBuffer, vertexArray, quadBuffer;
 
-    class vertex
+    // one record per glyph or rectangle, the vertex shader expands the
+    // unit quad into the 4 corners using this data
+    class instance
     {
     public:
-      GLfloat x, y;   // position
-      GLfloat u, v;   // texture
-      uint8_t r, g, b, a; // colour
+      GLfloat x, y, w, h;   // position and size
+      GLfloat u, v, tw, th; // texture rectangle
+      uint8_t r, g, b, a;   // colour
       GLbyte sp;
+      GLfloat field;        // 0 for coverage images, for distance fields the factor to get
+                            // from the field value to the coverage
 
-      vertex (GLfloat _x, GLfloat _y, GLfloat _u, GLfloat _v, Color_c c, uint8_t _sp) :
-      x(_x), y(_y), u(_u), v(_v), r(c.r()), g(c.g()), b(c.b()), a(c.a()), sp(_sp) {}
+      instance (GLfloat _x, GLfloat _y, GLfloat _w, GLfloat _h, GLfloat _u, GLfloat _v, GLfloat _tw, GLfloat _th, Color_c c, uint8_t _sp, GLfloat _field) :
+      x(_x), y(_y), w(_w), h(_h), u(_u), v(_v), tw(_tw), th(_th), r(c.r()), g(c.g()), b(c.b()), a(c.a()), sp(_sp), field(_field) {}
     };
 
-    void drawBuffers(SubPixelArrangement sp, size_t s, int sx, int sy, int C, float texscale)
+    void drawRuns(const std::vector<PageRun_c> & runs, size_t s)
+    {
+      for (size_t r = 0; r < runs.size(); r++)
+      {
+        size_t end = r+1 < runs.size() ? runs[r+1].first : s;
+
+        // there is no base instance in OpenGL 3.3, so move the instance
+        // attributes to the start of the run
+        setupInstanceAttributes(runs[r].first);
+
+        glBindTexture(GL_TEXTURE_2D, runs[r].texture);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, end-runs[r].first);
+      }
+    }
+
+    void drawBuffers(SubPixelArrangement sp, size_t s, const std::vector<PageRun_c> & runs, int sx, int sy, int C, float texscale)
     {
       glBlendFunc(GL_SRC1_COLOR, GL_ONE_MINUS_SRC1_COLOR);
       program.setUniform("offset", 1.0*sx/64.0, sy/64);
@@ -516,31 +805,50 @@ class openGL_internals<3>
           program.setUniform("texRshift", 0.0f, 0.0f);
           program.setUniform("texGshift", 0.0f, 0.0f);
           program.setUniform("texBshift", 0.0f, 0.0f);
-          glDrawElements(GL_TRIANGLES, s, GL_UNSIGNED_INT, 0);
+          drawRuns(runs, s);
           break;
 
         case SUBP_RGB:
           program.setUniform("texRshift", 0.0f, 0.0f);
           program.setUniform("texGshift", 1.0f/C, 0.0f);
           program.setUniform("texBshift", 2.0f/C, 0.0f);
-          glDrawElements(GL_TRIANGLES, s, GL_UNSIGNED_INT, 0);
+          drawRuns(runs, s);
           break;
 
         case SUBP_BGR:
           program.setUniform("texRshift", 2.0f/C, 0.0f);
           program.setUniform("texGshift", 1.0f/C, 0.0f);
           program.setUniform("texBshift", 0.0f/C, 0.0f);
-          glDrawElements(GL_TRIANGLES, s, GL_UNSIGNED_INT, 0);
+          drawRuns(runs, s);
           break;
       }
     }
 
-    void setupAttributes(void)
+    // the instance buffer must be bound to GL_ARRAY_BUFFER
+    void setupInstanceAttributes(size_t first)
     {
-      glEnableVertexAttribArray(0); glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, x));
-      glEnableVertexAttribArray(1); glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, u));
-      glEnableVertexAttribArray(2); glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, r));
-      glEnableVertexAttribArray(3); glVertexAttribPointer(3, 1, GL_BYTE, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, sp));
+      size_t o = first*sizeof(instance);
+
+      glEnableVertexAttribArray(0); glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(instance), (void*)(o+offsetof(instance, x)));
+      glEnableVertexAttribArray(1); glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(instance), (void*)(o+offsetof(instance, u)));
+      glEnableVertexAttribArray(2); glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(instance), (void*)(o+offsetof(instance, r)));
+      glEnableVertexAttribArray(3); glVertexAttribPointer(3, 1, GL_BYTE, GL_FALSE, sizeof(instance), (void*)(o+offsetof(instance, sp)));
+      glEnableVertexAttribArray(5); glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(instance), (void*)(o+offsetof(instance, field)));
+
+      glVertexAttribDivisor(0, 1);
+      glVertexAttribDivisor(1, 1);
+      glVertexAttribDivisor(2, 1);
+      glVertexAttribDivisor(3, 1);
+      glVertexAttribDivisor(5, 1);
+    }
+
+    void setupAttributes(GLuint instances)
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+      glEnableVertexAttribArray(4); glVertexAttribPointer(4, 2, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0);
+
+      glBindBuffer(GL_ARRAY_BUFFER, instances);
+      setupInstanceAttributes(0);
     }
 
   public:
@@ -555,17 +863,26 @@ class openGL_internals<3>
         "in vec2 TexCoord;"
         "in vec4 ourColor;"
         "in float sp;"
+        "flat in float Field;"
 
         "layout (location = 0, index = 0) out vec4 color;"
         "layout (location = 0, index = 1) out vec4 alpha;"
 
         "void main()"
         "{"
-        "  vec4 r = texture2D(texture, TexCoord+sp*texRshift);"
-        "  vec4 g = texture2D(texture, TexCoord+sp*texGshift);"
-        "  vec4 b = texture2D(texture, TexCoord+sp*texBshift);"
         "  color = ourColor;"
-        "  alpha = vec4(r.r, g.r, b.r, 1.0);"
+        "  if (Field > 0.0)"
+        "  {"
+        "    float a = clamp((texture2D(texture, TexCoord).r-128.0/255.0)*Field+0.5, 0.0, 1.0);"
+        "    alpha = vec4(a, a, a, 1.0);"
+        "  }"
+        "  else"
+        "  {"
+        "    vec4 r = texture2D(texture, TexCoord+sp*texRshift);"
+        "    vec4 g = texture2D(texture, TexCoord+sp*texGshift);"
+        "    vec4 b = texture2D(texture, TexCoord+sp*texBshift);"
+        "    alpha = vec4(r.r, g.r, b.r, 1.0);"
+        "  }"
         "}"
       );
 
@@ -575,21 +892,26 @@ class openGL_internals<3>
         "uniform float texscaler;"
         "uniform vec2 offset;"
 
-        "layout (location = 0) in vec3 vertex;"
-        "layout (location = 1) in vec2 tex_coord;"
+        "layout (location = 0) in vec4 rect;"
+        "layout (location = 1) in vec4 tex_rect;"
         "layout (location = 2) in vec4 color;"
         "layout (location = 3) in float subpixels;"
+        "layout (location = 4) in vec2 corner;"
+        "layout (location = 5) in float field;"
 
         "out vec2 TexCoord;"
         "out vec4 ourColor;"
         "out float sp;"
+        "flat out float Field;"
 
         "void main()"
         "{"
         "  ourColor = vec4(color.r/255.0, color.g/255.0, color.b/255.0, color.a/255.0);"
-        "  TexCoord = vec2(tex_coord.x, tex_coord.y)/texscaler;"
+        "  vec2 vertex = rect.xy + corner*rect.zw;"
+        "  TexCoord = (tex_rect.xy + corner*tex_rect.zw)/texscaler;"
         "  gl_Position = vec4((vertex.x-width+offset.x)/width, 1.0-(vertex.y+offset.y)/height, 0, 1.0);"
         "  sp = subpixels;"
+        "  Field = field;"
         "}"
       );
 
@@ -598,17 +920,22 @@ class openGL_internals<3>
       program.setUniform("texture", 0);
       program.setUniform("texscaler", 1.0f);
 
+      // the corners of the unit quad in triangle strip order
+      static const GLubyte quad[8] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+
+      glGenBuffers(1, &quadBuffer);       glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+
       glGenVertexArrays(1, &vertexArray); glBindVertexArray(vertexArray);
-      glGenBuffers(1, &vertexBuffer);     glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-      glGenBuffers(1, &vertexElement);    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexElement);
+      glGenBuffers(1, &vertexBuffer);
 
-      setupAttributes();
+      setupAttributes(vertexBuffer);
     }
 
     void cleanup(void)
     {
       glDeleteBuffers(1, &vertexBuffer);
-      glDeleteBuffers(1, &vertexElement);
+      glDeleteBuffers(1, &quadBuffer);
       glDeleteVertexArrays(1, &vertexArray);
     }
 
@@ -617,6 +944,13 @@ class openGL_internals<3>
       glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, C, C, 0, GL_RED, GL_UNSIGNED_BYTE, data);
     }
 
+    void updateTextureRegion(const uint8_t * data, int C, const AtlasRegion_c & r)
+    {
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, C);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, GL_RED, GL_UNSIGNED_BYTE, data+r.y*C+r.x);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+
     void setupProjection(int width, int height)
     {
       glViewport(0, 0, width, height);
@@ -629,19 +963,18 @@ class openGL_internals<3>
     {
       public:
 
-        GLuint vArray, vBuffer, vElements;
+        GLuint vArray, vBuffer;
         size_t elements;
-        uint32_t atlasId;
         uint32_t scale;
+        std::vector<PageRun_c> runs;
 
         ~DrawCacheInternal_c(void)
         {
           glDeleteBuffers(1, &vBuffer);
-          glDeleteBuffers(1, &vElements);
           glDeleteVertexArrays(1, &vArray);
         }
 
-        DrawCacheInternal_c(void) : vArray(0), vBuffer(0), vElements(0), elements(0), atlasId(0) {}
+        DrawCacheInternal_c(void) : vArray(0), vBuffer(0), elements(0) {}
 
         DrawCacheInternal_c(const DrawCacheInternal_c &) = delete;
 
@@ -649,67 +982,87 @@ class openGL_internals<3>
         {
           vArray = orig.vArray; orig.vArray = 0;
           vBuffer = orig.vBuffer; orig.vBuffer = 0;
-          vElements = orig.vElements; orig.vElements = 0;
           elements = orig.elements; orig.elements = 0;
-          atlasId = orig.atlasId; orig.atlasId = 0;
+          scale = orig.scale;
+          runs.swap(orig.runs);
         }
 
         void operator=(DrawCacheInternal_c && orig)
         {
           vArray = orig.vArray; orig.vArray = 0;
           vBuffer = orig.vBuffer; orig.vBuffer = 0;
-          vElements = orig.vElements; orig.vElements = 0;
           elements = orig.elements; orig.elements = 0;
-          atlasId = orig.atlasId; orig.atlasId = 0;
+          scale = orig.scale;
+          runs.swap(orig.runs);
         }
     };
 
     void drawCache(DrawCacheInternal_c & dc, SubPixelArrangement sp, int sx, int sy, int C)
     {
       glBindVertexArray(dc.vArray);
-      drawBuffers(sp, dc.elements, sx, sy, C, C/dc.scale);
+      glBindBuffer(GL_ARRAY_BUFFER, dc.vBuffer);
+      drawBuffers(sp, dc.elements, dc.runs, sx, sy, C, C/dc.scale);
     }
 
     class CreateInternal_c
     {
       public:
-        std::vector<vertex> vb;
-        std::vector<GLuint> vbe;
+        std::vector<instance> vb;
+        std::vector<PageRun_c> runs;
+        FrameClip_c clip;
 
         CreateInternal_c(size_t s)
         {
-          vb.reserve(s*4);
-          vbe.reserve(s*6);
+          vb.reserve(s);
         }
     };
 
+    static const bool immediate = false;
+
     void startCachePreparation(DrawCacheInternal_c & dc)
     {
       if (dc.vArray == 0)    { glGenVertexArrays(1, &dc.vArray); } glBindVertexArray(dc.vArray);
-      if (dc.vBuffer == 0)   { glGenBuffers(1, &dc.vBuffer);     } glBindBuffer(GL_ARRAY_BUFFER, dc.vBuffer);
-      if (dc.vElements == 0) { glGenBuffers(1, &dc.vElements);   } glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dc.vElements);
+      if (dc.vBuffer == 0)   { glGenBuffers(1, &dc.vBuffer);     }
 
-      setupAttributes();
+      setupAttributes(dc.vBuffer);
     }
-    void endCachePreparation(DrawCacheInternal_c & dc, CreateInternal_c & vb, SubPixelArrangement sp, int sx, int sy, uint32_t atlasId, int C)
+    void endCachePreparation(DrawCacheInternal_c & dc, CreateInternal_c & vb, SubPixelArrangement sp, int sx, int sy, int C)
     {
       uploadAndDraw(vb, sp, sx, sy, C, GL_STATIC_DRAW);
 
-      dc.atlasId = atlasId;
-      dc.elements = vb.vbe.size();
+      dc.elements = vb.vb.size();
       dc.scale = C;
+      dc.runs = vb.runs;
     }
 
     void startPreparation(int /*sx*/, int /*sy*/)
     {
       glBindVertexArray(vertexArray);
+      glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
     }
     void endPreparation(CreateInternal_c & vb, SubPixelArrangement sp, int sx, int sy, int C)
     {
       uploadAndDraw(vb, sp, sx, sy, C, GL_STREAM_DRAW);
     }
 
-    void drawRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    void drawPrepared(CreateInternal_c & vb, SubPixelArrangement sp, int sx, int sy, int C, int scale, const std::vector<GLuint> & textures)
+    {
+      for (auto & r : vb.runs)
+        r.texture = textures[r.texture];
+
+      glBindVertexArray(vertexArray);
+      glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(instance)*vb.vb.size(), vb.vb.data(), GL_STREAM_DRAW);
+
+      drawBuffers(sp, vb.vb.size(), vb.runs, sx, sy, C, 1.0f*C/scale);
+    }
+
+    static void selectPage(CreateInternal_c & vb, GLuint texture)
+    {
+      vb.runs.push_back(PageRun_c { texture, (uint32_t)vb.vb.size() });
+    }
+
+    static void drawRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
       std::array<float, 8> data;
       data[0] = (ii.x+32)/64;         data[1] = (ii.x+32+ii.w)/64;
@@ -717,10 +1070,10 @@ class openGL_internals<3>
       data[4] = 1.0*(pos.pos_x+5)/C;  data[5] = 1.0*(pos.pos_x+pos.width-6)/C;
       data[6] = 1.0*(pos.pos_y+5)/C;  data[7] = 1.0*(pos.pos_y+pos.rows-6)/C;
 
-      addQuad(vb, data, c, 0);
+      addQuad(vb, data, c, 0, 0);
     }
 
-    void drawSmoothRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawSmoothRectangle(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
       std::array<float, 8> data;
       data[0] = (ii.x+32)/64+pos.left; data[1] = (ii.x+32)/64+pos.left+pos.width;
@@ -728,10 +1081,10 @@ class openGL_internals<3>
       data[4] = 1.0*(pos.pos_x)/C;     data[5] = 1.0*(pos.pos_x+pos.width)/C;
       data[6] = 1.0*(pos.pos_y)/C;     data[7] = 1.0*(pos.pos_y+pos.rows)/C;
 
-      addQuad(vb, data, c, 1);
+      addQuad(vb, data, c, 1, 0);
     }
 
-    void drawNormalGlyph(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawNormalGlyph(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
       std::array<float, 8> data;
       data[0] = (ii.x)/64.0+pos.left; data[1] = (ii.x)/64.0+pos.left+pos.width;
@@ -739,10 +1092,10 @@ class openGL_internals<3>
       data[4] = 1.0*(pos.pos_x)/C;    data[5] = 1.0*(pos.pos_x+pos.width)/C;
       data[6] = 1.0*(pos.pos_y)/C;    data[7] = 1.0*(pos.pos_y+pos.rows)/C;
 
-      addQuad(vb, data, c, 0);
+      addQuad(vb, data, c, 0, 0);
     }
 
-    void drawSubpGlyph(CreateInternal_c & vb, SubPixelArrangement /*sp*/, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
+    static void drawSubpGlyph(CreateInternal_c & vb, SubPixelArrangement /*sp*/, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, int C)
     {
       std::array<float, 8> data;
       data[0] = ii.x/64.0+pos.left;   data[1] = ii.x/64.0+pos.left+(pos.width-1)/3.0;
@@ -750,31 +1103,147 @@ class openGL_internals<3>
       data[4] = 1.0*(pos.pos_x)/C;    data[5] = 1.0*(pos.pos_x+pos.width-1)/C;
       data[6] = 1.0*(pos.pos_y)/C;    data[7] = 1.0*(pos.pos_y+pos.rows)/C;
 
-      addQuad(vb, data, c, 1);
+      addQuad(vb, data, c, 1, 0);
+    }
+
+    static void drawDistanceGlyph(CreateInternal_c & vb, const CommandData_c & ii, const FontAtlasData_c & pos, Color_c c, double scale, uint16_t spread, int C)
+    {
+      std::array<float, 8> data;
+      data[0] = ii.x/64.0+pos.left*scale;   data[1] = data[0]+pos.width*scale;
+      data[2] = (ii.y+32)/64-pos.top*scale; data[3] = data[2]+pos.rows*scale;
+      data[4] = 1.0*(pos.pos_x)/C;          data[5] = 1.0*(pos.pos_x+pos.width)/C;
+      data[6] = 1.0*(pos.pos_y)/C;          data[7] = 1.0*(pos.pos_y+pos.rows)/C;
+
+      // the soft edge is one pixel wide, blurring is emulated by widening it, a gaussian blurr
+      // spreads an edge over roughly 1.3 times the blurr radius
+      double ramp = std::max(1.0, 1.3*ii.blurr/64.0);
+
+      addQuad(vb, data, c, 0, 255.0*spread*scale/(127.0*ramp));
     }
 
   private:
 
     void uploadAndDraw(const CreateInternal_c & vb, SubPixelArrangement sp, int sx, int sy, int C, int drawMode)
     {
-      glBufferData(GL_ARRAY_BUFFER, sizeof(vertex)*vb.vb.size(), vb.vb.data(), drawMode);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLint)*vb.vbe.size(), vb.vbe.data(), drawMode);
-      drawBuffers(sp, vb.vbe.size(), sx, sy, C, 1);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(instance)*vb.vb.size(), vb.vb.data(), drawMode);
+      drawBuffers(sp, vb.vb.size(), vb.runs, sx, sy, C, 1);
     }
 
-    void addQuad(CreateInternal_c & vb, std::array<float, 8> & data, Color_c c, int sp)
+    static void addQuad(CreateInternal_c & vb, std::array<float, 8> & data, Color_c c, int sp, float field)
     {
-      GLshort si = vb.vb.size();
-      vb.vb.push_back(vertex(data[0], data[2], data[4], data[6], c, sp));
-      vb.vb.push_back(vertex(data[1], data[2], data[5], data[6], c, sp));
-      vb.vb.push_back(vertex(data[1], data[3], data[5], data[7], c, sp));
-      vb.vb.push_back(vertex(data[0], data[3], data[4], data[7], c, sp));
-      vb.vbe.push_back(si+0); vb.vbe.push_back(si+1); vb.vbe.push_back(si+2);
-      vb.vbe.push_back(si+0); vb.vbe.push_back(si+2); vb.vbe.push_back(si+3);
+      if (!vb.clip.apply(data)) return;
+
+      vb.vb.push_back(instance(data[0], data[2], data[1]-data[0], data[3]-data[2],
+                               data[4], data[6], data[5]-data[4], data[7]-data[6], c, sp, field));
     }
 
 };
 
+// creates the quads for layouts from the images in a glyph atlas. For the OpenGL versions that
+// collect the quads (2 and 3) this doesn't call any OpenGL function, so it doesn't need an
+// OpenGL context and may run on any thread. OpenGL 1 draws right away
+template <int V, class G>
+class VertexPreparation_c
+{
+  public:
+    typedef typename openGL_internals<V>::CreateInternal_c Buffer_c;
+
+    VertexPreparation_c(PagedGlyphAtlas_c & c, const G & gamma) : cache(c), g(gamma) { }
+
+    // set up the clip of vb for a layout at sx, sy (in 1/64th pixels) clipped to the
+    // given rectangle in pixels, the offset is the same as the one used by showLayout
+    static void setClip(Buffer_c & vb, int sx, int sy, uint16_t cx, uint16_t cy, uint16_t cw, uint16_t ch)
+    {
+      vb.clip.ox = sx/64.0;
+      vb.clip.oy = sy/64;
+      vb.clip.x1 = cx;
+      vb.clip.y1 = cy;
+      vb.clip.x2 = (float)cx+cw;
+      vb.clip.y2 = (float)cy+ch;
+    }
+
+    // add the drawing commands from i to j to vb, all their images must be in the atlas. Page is
+    // the atlas page that is currently selected in vb, the pages used are added to usedPages when it
+    // is given. The page runs get the texture from textures, when no textures are given they get the
+    // page number instead, as the texture might not exist yet. Image commands are given to image
+    template <class F>
+    void addCommands(Buffer_c & vb, const std::vector<CommandData_c> & dat, size_t i, size_t j,
+                     SubPixelArrangement sp, uint32_t & page, const std::vector<GLuint> * textures,
+                     std::vector<std::pair<uint32_t, uint32_t>> * usedPages, F image)
+    {
+      // switch to the atlas page of the given image, when necessary
+      auto selectPage = [&](const FontAtlasData_c & pos) {
+        if (pos.page != page)
+        {
+          page = pos.page;
+          openGL_internals<V>::selectPage(vb, textures ? (*textures)[page] : page);
+
+          if (usedPages && std::none_of(usedPages->begin(), usedPages->end(),
+                                        [page](const std::pair<uint32_t, uint32_t> & p) { return p.first == page; }))
+            usedPages->push_back(std::make_pair(page, cache.pageId(page)));
+        }
+      };
+
+      for (size_t k = i; k < j; k++)
+      {
+        auto & ii = dat[k];
+
+        switch (ii.command)
+        {
+          case CommandData_c::CMD_GLYPH:
+            {
+              auto pos = cache.getGlyph(ii.font, ii.glyphIndex, sp, ii.blurr).value();
+              Color_c c = g.forward(ii.c);
+
+              selectPage(pos);
+
+              if (cache.isDistanceField(ii.font, ii.blurr))
+              {
+                openGL_internals<V>::drawDistanceGlyph(vb, ii, pos, c, cache.distanceScale(ii.font),
+                                                       cache.distanceSpread(), cache.width());
+              }
+              else if ((sp == SUBP_RGB || sp == SUBP_BGR) && (ii.blurr <= cache.blurrmax))
+              {
+                openGL_internals<V>::drawSubpGlyph(vb, sp, ii, pos, c, cache.width());
+              }
+              else
+              {
+                openGL_internals<V>::drawNormalGlyph(vb, ii, pos, c, cache.width());
+              }
+            }
+            break;
+
+          case CommandData_c::CMD_RECT:
+            {
+              Color_c c = g.forward(ii.c);
+
+              if (ii.blurr == 0)
+              {
+                auto pos = cache.getFilledRect().value();
+                selectPage(pos);
+                openGL_internals<V>::drawRectangle(vb, ii, pos, c, cache.width());
+              }
+              else
+              {
+                auto pos = cache.getRect(ii.w, ii.h, sp, ii.blurr).value();
+                selectPage(pos);
+                openGL_internals<V>::drawSmoothRectangle(vb, ii, pos, c, cache.width());
+              }
+            }
+            break;
+
+          case CommandData_c::CMD_IMAGE:
+            image(ii);
+            break;
+        }
+      }
+    }
+
+  private:
+    PagedGlyphAtlas_c & cache;
+    const G & g;
+};
+
 } }
 
 #endif
@@ -0,0 +1,101 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef STLL_OUTLINE_CACHE_H
+#define STLL_OUTLINE_CACHE_H
+
+#include <stll/layouterFont.h>
+
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace STLL { namespace internal {
+
+// the outline of one glyph in font units, the curves are kept as they are, so that
+// they can be flattened with the precision required for the size they are rendered at
+class GlyphOutline_c
+{
+  public:
+    enum
+    {
+      OUTLINE_MOVE,   // 1 point: start a new contour
+      OUTLINE_LINE,   // 1 point: the end of the line
+      OUTLINE_CONIC,  // 2 points: control point and end point
+      OUTLINE_CUBIC   // 3 points: 2 control points and end point
+    };
+
+    std::vector<uint8_t> commands;
+    std::vector<int32_t> points;   // x and y of the points of all commands
+
+    // control box of all points
+    int32_t xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+
+    // false for glyphs that have no outline (e.g. bitmap fonts)
+    bool valid = false;
+};
+
+// scanline rasterizer that accumulates the signed area covered by lines of closed
+// contours, the coverage of a pixel is the sum of the accumulated values of the pixels
+// to its left, so each line only touches the pixels it crosses
+class CoverageRasterizer_c
+{
+  private:
+    int w = 0, h = 0;
+    std::vector<float> acc;
+
+  public:
+    // start a new image, all lines must be within 0..w and 0..h
+    void reset(int width, int height);
+
+    // add a line, coordinates in pixels with y pointing downwards
+    void line(float x0, float y0, float x1, float y1);
+
+    // calculate the coverage of all pixels into out
+    void finish(uint8_t * out, int pitch);
+};
+
+// the outlines of all glyphs of a font file, this cache is shared between all sizes
+// of a font and renders the glyphs with the rasterizer above
+class OutlineCache_c
+{
+  private:
+    std::unordered_map<glyphIndex_t, GlyphOutline_c> outlines;
+
+    CoverageRasterizer_c rasterizer;
+    std::vector<uint8_t> bitmap;
+    std::vector<uint8_t> filtered;
+
+  public:
+    // get the outline, it is loaded from the face on first use
+    const GlyphOutline_c & getOutline(FT_FaceRec_ * face, glyphIndex_t glyphIndex);
+
+    // render a glyph with ppem pixels per EM (in 1/64 pixels) and shifted by dx 1/64 pixels to the right
+    // only SUBP_NONE, SUBP_RGB and SUBP_BGR are supported, the returned image stays valid until the
+    // next call, when the glyph has no outline an empty image is returned
+    FontFace_c::GlyphSlot_c render(FT_FaceRec_ * face, glyphIndex_t glyphIndex, uint32_t ppem,
+                                   SubPixelArrangement sp, int32_t dx);
+};
+
+} }
+
+#endif
@@ -24,6 +24,9 @@
 
 #include <vector>
 #include <array>
+#include <map>
+#include <set>
+#include <iosfwd>
 #include <experimental/optional>
 
 namespace STLL { namespace internal {
@@ -64,6 +67,84 @@ class RectanglePacker_c
     void clear(void);
 
     void doubleSize(void);
+
+    // write the complete state of the packer, so that it can be restored with load,
+    // when load fails because of invalid data, the packer is not changed
+    void save(std::ostream & out) const;
+    bool load(std::istream & in);
+};
+
+// a rectangle packer that places the rectangles on shelves and that can also release
+// rectangles again
+//
+// Shelves are horizontal stripes of the area. The height of a rectangle is rounded up
+// to a height class (at most 1/8th is wasted) and the rectangle is placed on a shelf
+// of its class. Each shelf keeps a list of the free spans on it, so released rectangles
+// can be reused by other rectangles of the same class. Once a shelf is completely free
+// again, it is merged with its free neighbours and can be reused for any other height class.
+//
+// The shelves of each class are sorted by their widest free span and the free shelves by
+// their height, so an allocation is a few logarithmic lookups instead of a test of every
+// position as in RectanglePacker_c.
+class ShelfPacker_c
+{
+  private:
+    int width_, height_;
+
+    class Span_c
+    {
+      public:
+        uint32_t x, w;
+    };
+
+    class Shelf_c
+    {
+      public:
+        uint32_t h;
+        uint32_t freeWidth;          // sum of the width of all free spans
+        uint32_t maxSpan;            // width of the widest free span
+        std::vector<Span_c> spans;   // the free spans, sorted by x
+    };
+
+    // all shelves by their y-position
+    std::map<uint32_t, Shelf_c> shelves;
+
+    // the shelves that are used for each height class and that still have free space,
+    // as pairs of the widest free span and the y-position
+    std::map<uint32_t, std::set<std::pair<uint32_t, uint32_t>>> classes;
+
+    // completely free shelves as pairs of height and y-position
+    std::set<std::pair<uint32_t, uint32_t>> empty;
+
+    // start of the area that doesn't contain any shelves
+    uint32_t top;
+
+    static uint32_t heightClass(uint32_t h);
+
+    std::experimental::optional<std::array<uint32_t, 2>> allocateInClass(uint32_t hc, uint32_t w);
+    std::array<uint32_t, 2> allocateOnShelf(uint32_t y, Shelf_c & s, uint32_t w);
+    Shelf_c & newShelf(uint32_t y, uint32_t h);
+    void updateClass(uint32_t y, Shelf_c & s);
+
+  public:
+
+    ShelfPacker_c(int width, int height);
+
+    uint32_t width(void) const { return width_; }
+    uint32_t height(void) const { return height_; }
+
+    // allocate a rectangular area of the given size
+    // if none such area is available the optional will be empty
+    std::experimental::optional<std::array<uint32_t, 2>> allocate(uint32_t w, uint32_t h);
+
+    // release an area that was returned by allocate, the width and height must be
+    // the same as the ones used for allocation
+    void deallocate(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+    // release all occupied area
+    void clear(void);
+
+    void doubleSize(void);
 };
 
 } }
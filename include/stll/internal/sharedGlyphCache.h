@@ -0,0 +1,118 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef STLL_SHARED_GLYPH_CACHE_H
+#define STLL_SHARED_GLYPH_CACHE_H
+
+#include <stll/layouterFont.h>
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+namespace STLL { namespace internal {
+
+class PaintData_c;
+
+// key of an image in the shared cache, the font is identified by the hash of its
+// content and its size, because the font pointers are different in each process
+// glyphs rendered with the internal rasterizer look different, so they get their own entries
+class SharedGlyphKey_c
+{
+  public:
+    SharedGlyphKey_c(const std::shared_ptr<FontFace_c> & f, glyphIndex_t idx, SubPixelArrangement s, uint16_t b, bool o = false) :
+      font(f->getContentHash()), size(f->getSize()), glyphIndex(idx), sp(s), blurr(b), w(0), h(0), outline(o) { }
+
+    // rectangles, w and h are already in pixels, just like in GlyphKey_c
+    SharedGlyphKey_c(uint16_t w_, uint16_t h_, SubPixelArrangement s, uint16_t b) :
+      font(0), size(0), glyphIndex(0), sp(s), blurr(b), w(w_), h(h_), outline(false) { }
+
+    uint64_t font;
+    uint32_t size;
+    glyphIndex_t glyphIndex;
+    SubPixelArrangement sp;
+    uint16_t blurr;
+    uint16_t w, h;
+    bool outline;
+
+    uint64_t hash(void) const;
+};
+
+// a glyph cache in a POSIX shared memory segment that can be used by several processes
+// at the same time
+//
+// the segment contains an open addressing hash table and an arena for the images. Entries
+// are claimed with an atomic compare and exchange of the hash of their key, so no locks are
+// required. Images are never removed, once the arena or the table is full nothing is added
+// any more and the callers need to keep the images in their own memory
+class SharedGlyphCache_c
+{
+  private:
+    class Header_c;
+    class Slot_c;
+
+    int fd;
+    uint8_t * base;
+    size_t mapped;
+
+    Header_c * header;
+    Slot_c * slots;
+    uint8_t * arena;
+
+    SharedGlyphCache_c(int fd, uint8_t * base, size_t mapped);
+
+    // find the slot for the key, when insert is true an empty slot is claimed for it
+    // and claimed is set
+    Slot_c * findSlot(const SharedGlyphKey_c & k, bool insert, bool & claimed) const;
+
+    void toPaintData(const Slot_c & s, PaintData_c & p) const;
+
+  public:
+    SharedGlyphCache_c(const SharedGlyphCache_c &) = delete;
+    SharedGlyphCache_c & operator=(const SharedGlyphCache_c &) = delete;
+    ~SharedGlyphCache_c(void);
+
+    // open the segment with the given name (e.g. "/myprogram-glyphs") or create it with the
+    // given size in bytes, when it doesn't exist yet, nullptr is returned on failure
+    static std::shared_ptr<SharedGlyphCache_c> open(const std::string & name, size_t bytes);
+
+    // remove the segment name, processes that have it opened can continue to use it
+    static bool remove(const std::string & name);
+
+    // look up an image, when found p is changed to point to the image within the segment
+    bool find(const SharedGlyphKey_c & k, PaintData_c & p) const;
+
+    // copy an image into the segment, when successful, p is changed to point to the
+    // image within the segment, when another process added the same image already, that
+    // image is used
+    bool insert(const SharedGlyphKey_c & k, PaintData_c & p);
+
+    // is p a pointer into the segment?
+    bool contains(const uint8_t * p) const { return p >= base && p < base+mapped; }
+
+    // number of bytes used for images within the segment
+    size_t getMemory(void) const;
+};
+
+} }
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#ifndef STLL_SLAB_ALLOCATOR_H
+#define STLL_SLAB_ALLOCATOR_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace STLL { namespace internal {
+
+// a simple size classed slab allocator for the glyph images in the glyph caches
+//
+// requested sizes are rounded up to a size class (4 classes for each power of 2, starting
+// with 64 bytes), each slab contains slots of exactly one size class. So all glyphs
+// of similar size are packed together in big blocks of memory. Blocks that are
+// too big for a normal slab get a slab of their own.
+//
+// Freed slots are reused for the next allocation of that size class. Slabs that are
+// completely empty are released, except for one spare slab per size class, so that a cache
+// that keeps on replacing glyphs of similar sizes doesn't need to go to the heap at all
+class SlabAllocator_c
+{
+  private:
+
+    static const size_t slabSize = 64*1024;
+    static const uint32_t none = UINT32_MAX;
+
+    class Slab_c
+    {
+      public:
+        std::unique_ptr<uint8_t[]> memory;
+        size_t slotSize;      // size of one slot in this slab
+        uint32_t slots;       // number of slots in this slab
+        uint32_t used;        // number of slots currently in use
+        uint32_t unused;      // slots starting with this index have never been used
+        uint32_t freeList;    // first slot of the list of free slots, the index of the next free
+                              // slot is stored in the first bytes of the free slot
+        uint32_t sizeClass;
+    };
+
+    std::vector<Slab_c> slabs;
+
+    // the slabs without memory that can be reused
+    std::vector<uint32_t> freeSlabs;
+
+    // for each size class the slabs that have free slots
+    std::vector<std::vector<uint32_t>> partial;
+
+    uint32_t newSlab(uint32_t sc, size_t size);
+    void releaseSlab(uint32_t slab);
+
+  public:
+
+    // the size class for a block of size bytes and the slot size of a size class
+    static uint32_t sizeClass(size_t size);
+    static size_t classSize(uint32_t sc);
+
+    // allocate a block of at least size bytes, the memory is cleared to zero
+    // the function returns the pointer and the slab that the block belongs to
+    // the slab index is required for freeing the block again. For size 0 a
+    // null pointer is returned, freeing it does nothing
+    std::pair<uint8_t *, uint32_t> allocate(size_t size);
+
+    // return a block
+    void free(uint8_t * p, uint32_t slab);
+
+    // release all memory, all blocks become invalid
+    void clear(void);
+
+    // the number of bytes currently requested from the heap
+    size_t capacity(void) const;
+};
+
+} }
+
+#endif
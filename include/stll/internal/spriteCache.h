@@ -0,0 +1,449 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#ifndef STLL_SPRITE_CACHE_H
+#define STLL_SPRITE_CACHE_H
+
+#include <stll/layouter.h>
+
+#include <stll/internal/glyphCache.h>
+#include <stll/internal/blitter.h>
+#include <stll/internal/dividers.h>
+
+#include <experimental/optional>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+
+// a cache for completely rendered layouts. A layout is rendered once into an
+// intermediate image (the sprite) and subsequent outputs of the same layout
+// at the same sub pixel position only need to blend that single image onto the
+// target, which is a lot faster than going through all glyphs one by one
+
+namespace STLL { namespace internal {
+
+// the parts of a drawing command that influence the looks of a sprite. Fonts are identified
+// by the hash of their content and their size, so that a font that is freed and another font
+// that is later allocated at the same address are never mixed up
+class SpriteCommand_c
+{
+  public:
+    uint64_t font;
+    uint32_t fontSize;
+    uint32_t glyphIndex;
+    int32_t x, y;
+    uint32_t w, h;
+    uint32_t c;
+    uint16_t blurr;
+    uint8_t command;
+
+    SpriteCommand_c(const CommandData_c & d) :
+      font(d.font ? d.font->getContentHash() : 0), fontSize(d.font ? d.font->getSize() : 0),
+      glyphIndex(d.glyphIndex), x(d.x), y(d.y), w(d.w), h(d.h),
+      c(((uint32_t)d.c.r() << 24) | ((uint32_t)d.c.g() << 16) | ((uint32_t)d.c.b() << 8) | d.c.a()),
+      blurr(d.blurr), command(d.command) { }
+
+    bool operator==(const SpriteCommand_c & a) const
+    {
+      return       font == a.font
+          &&   fontSize == a.fontSize
+          && glyphIndex == a.glyphIndex
+          &&          x == a.x
+          &&          y == a.y
+          &&          w == a.w
+          &&          h == a.h
+          &&          c == a.c
+          &&      blurr == a.blurr
+          &&    command == a.command;
+    }
+};
+
+// a prerendered layout, each pixel consists of 6 values: first the premultiplied linear colour
+// for the 3 colour channels (in r, g, b order) then the coverage for the same 3 channels.
+// Colour and coverage are scaled to 255*S, S being the scale of the gamma function used
+// when creating the sprite. Having 3 coverage values allows sub pixel output
+class LayoutSprite_c
+{
+  public:
+    int32_t left;   // position of the top left corner relative to the pixel position of the layout
+    int32_t top;
+    int32_t width;  // width and height of the sprite in pixels
+    int32_t rows;
+    std::unique_ptr<uint16_t[]> buffer;
+    uint32_t lastUse;
+
+    // the commands the sprite was created from, they are compared on each hit because
+    // the key only contains a hash, and the version of the layout they were last
+    // compared with, so that showing the same layout again doesn't need the comparison
+    std::vector<SpriteCommand_c> commands;
+    uint64_t version;
+
+    LayoutSprite_c(void) : left(0), top(0), width(0), rows(0), lastUse(0), version(0) { }
+
+    size_t bytes(void) const { return sizeof(uint16_t)*6*width*rows + sizeof(SpriteCommand_c)*commands.size(); }
+};
+
+// the key for the sprite cache, it contains a hash over the content of the layout
+// and all other information that influences the looks of the sprite
+class SpriteKey_c
+{
+  public:
+    uint64_t hash;
+    size_t commands;
+    SubPixelArrangement sp;
+    uint8_t fx, fy;         // sub pixel position of the layout
+
+    bool operator==(const SpriteKey_c & a) const
+    {
+      return     hash == a.hash
+          && commands == a.commands
+          &&       sp == a.sp
+          &&       fx == a.fx
+          &&       fy == a.fy;
+    }
+};
+
+} }
+
+namespace std {
+
+  template <>
+  class hash<STLL::internal::SpriteKey_c>
+  {
+  public :
+    size_t operator()(const STLL::internal::SpriteKey_c & name ) const
+    {
+      return (size_t)name.hash
+           + (size_t)name.fx
+           + ((size_t)name.fy << 6)
+           + ((size_t)name.sp << 12);
+    }
+  };
+
+}
+
+namespace STLL { namespace internal {
+
+class SpriteCache_c
+{
+  private:
+    std::unordered_map<SpriteKey_c, LayoutSprite_c> sprites;
+
+    // maximal number of bytes for all sprites together and the
+    // number of bytes currently used
+    size_t budget = 0;
+    size_t used = 0;
+
+    // same last use scheme as in the glyph cache
+    uint32_t useCounter = 0;
+
+    // hashes of the layouts seen recently, indexed by the version of the layout, so that
+    // showing an unchanged layout doesn't need to hash all commands again, 0 marks a layout
+    // that can not be cached
+    std::unordered_map<uint64_t, uint64_t> hashes;
+
+    // remove the least recently used sprites until at least size bytes are free
+    void makeRoom(size_t size);
+
+  public:
+
+    // calculate the key for a layout at a given position, when the layout can not
+    // be cached (because it contains images) nothing is returned
+    std::experimental::optional<SpriteKey_c> key(const TextLayout_c & l, int sx, int sy, SubPixelArrangement sp);
+
+    // find the sprite for a layout, returns nullptr, when the sprite is not in the cache
+    // or when the sprite with the same key was created from different commands
+    const LayoutSprite_c * find(const SpriteKey_c & k, const TextLayout_c & l);
+
+    // add a sprite for a layout to the cache, possibly removing old sprites to keep within the
+    // budget, a sprite with the same key is replaced. Returns nullptr, when the sprite doesn't
+    // fit into the budget at all
+    const LayoutSprite_c * insert(const SpriteKey_c & k, const TextLayout_c & l, LayoutSprite_c && s);
+
+    // set the maximal number of bytes to use for all sprites, 0 disables the cache
+    void setBudget(size_t bytes);
+    size_t getBudget(void) const { return budget; }
+
+    void clear(void);
+};
+
+/** create a sprite for a layout
+ *
+ * \param l the layout to render
+ * \param fx sub pixel position in x direction in 1/64 pixels (0..63)
+ * \param fy sub pixel position in y direction in 1/64 pixels (0..63)
+ * \param sp sub pixel arrangement to use
+ * \param cache the glyph cache to get the glyph images from
+ * \param g gamma function, only forward and scale are used
+ * \param maxBytes when the sprite would need more bytes than this, no sprite is created and
+ *        an empty sprite (width and rows 0) is returned
+ */
+template <class G>
+LayoutSprite_c createSprite(const TextLayout_c & l, int fx, int fy, SubPixelArrangement sp,
+                            GlyphCache_c & cache, const G & g, size_t maxBytes)
+{
+  LayoutSprite_c res;
+
+  // first find out the area covered by all the commands, we do the same
+  // calculations as the blitters
+  int minx = std::numeric_limits<int>::max();
+  int miny = std::numeric_limits<int>::max();
+  int maxx = std::numeric_limits<int>::min();
+  int maxy = std::numeric_limits<int>::min();
+
+  auto area = [&](int x0, int y0, int x1, int y1) -> void {
+    minx = std::min(minx, x0);
+    miny = std::min(miny, y0);
+    maxx = std::max(maxx, x1);
+    maxy = std::max(maxy, y1);
+  };
+
+  auto imgArea = [&](int x, int y, const PaintData_c & img) -> void {
+    int stx = div_inf(x, 64) + img.left;
+    int sty = div_inf(y+32, 64) - img.top;
+
+    // the blitter output one pixel more than the image width because of the
+    // sub pixel shift
+    if (sp == SUBP_NONE)
+      area(stx, sty, stx+img.width+1, sty+img.rows);
+    else
+      area(stx, sty, stx+img.width/3+1, sty+img.rows);
+  };
+
+  for (auto & i : l.getData())
+  {
+    switch (i.command)
+    {
+      case CommandData_c::CMD_GLYPH:
+        imgArea(fx+i.x, fy+i.y, cache.getGlyph(i.font, i.glyphIndex, sp, i.blurr));
+        break;
+
+      case CommandData_c::CMD_RECT:
+        if (i.blurr == 0)
+          area(div_inf(i.x+fx+32, 64), div_inf(i.y+fy+32, 64),
+               div_inf(i.x+fx+(int)i.w+32, 64), div_inf(i.y+fy+(int)i.h+32, 64));
+        else
+          imgArea(fx+i.x, fy+i.y, cache.getRect(i.w, i.h, sp, i.blurr));
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if (minx >= maxx || miny >= maxy) return res;
+
+  // one additional pixel, because the blitters never output into the last column
+  int w = maxx-minx+1;
+  int h = maxy-miny;
+
+  if (sizeof(uint16_t)*6*w*h > maxBytes) return res;
+
+  res.left = minx;
+  res.top = miny;
+  res.width = w;
+  res.rows = h;
+  res.buffer = std::make_unique<uint16_t[]>(6*w*h);
+
+  uint8_t * s = (uint8_t*)res.buffer.get();
+  int pitch = sizeof(uint16_t)*6*w;
+  int bbp = sizeof(uint16_t)*6;
+
+  int S = g.scale();
+
+  auto pxget = [](const uint8_t * p) -> auto {
+    auto v = (const uint16_t*)p;
+    return std::make_tuple(v[0], v[1], v[2]);
+  };
+  auto pxput = [](uint8_t * p, uint16_t a, uint16_t b, uint16_t c) -> void {
+    auto v = (uint16_t*)p;
+    v[0] = a; v[1] = b; v[2] = c;
+  };
+  auto pxgetBGR = [](const uint8_t * p) -> auto {
+    auto v = (const uint16_t*)p;
+    return std::make_tuple(v[2], v[1], v[0]);
+  };
+  auto pxputBGR = [](uint8_t * p, uint16_t a, uint16_t b, uint16_t c) -> void {
+    auto v = (uint16_t*)p;
+    v[2] = a; v[1] = b; v[0] = c;
+  };
+
+  // the sprite is linear and premultiplied, so blending is a simple linear interpolation
+  // towards the scaled colour value, the same works for the coverage when blending with
+  // full intensity
+  auto blend = [S](int a1, int a2, int b1, int b2, int c) -> int {
+    if (b1 == 0 && (b2== 0 || c == 0)) return a1;
+    int b = (int)b1 + ((int)b2-(int)b1)*c/64;
+    return a1 + (a2*S-a1)*b/(255*255);
+  };
+
+  auto output = [&](int x, int y, const PaintData_c & img, Color_c c) -> void {
+    // colour and coverage are blended in separate passes, the coverage is stored 3 values further
+    switch (sp)
+    {
+      default:
+      case SUBP_NONE:
+        outputGlyph_NONE(x, y, img, c, s, pitch, bbp, w, h, pxget, pxput, blend);
+        outputGlyph_NONE(x, y, img, Color_c(255, 255, 255, c.a()), s+3*sizeof(uint16_t), pitch, bbp, w, h,
+                         pxget, pxput, blend);
+        break;
+
+      case SUBP_RGB:
+        outputGlyph_HorizontalRGB(x, y, img, c.r(), c.g(), c.b(), c.a(), s, pitch, bbp, w, h, pxget, pxput, blend);
+        outputGlyph_HorizontalRGB(x, y, img, 255, 255, 255, c.a(), s+3*sizeof(uint16_t), pitch, bbp, w, h,
+                                  pxget, pxput, blend);
+        break;
+
+      case SUBP_BGR:
+        outputGlyph_HorizontalRGB(x, y, img, c.b(), c.g(), c.r(), c.a(), s, pitch, bbp, w, h, pxgetBGR, pxputBGR, blend);
+        outputGlyph_HorizontalRGB(x, y, img, 255, 255, 255, c.a(), s+3*sizeof(uint16_t), pitch, bbp, w, h,
+                                  pxgetBGR, pxputBGR, blend);
+        break;
+    }
+  };
+
+  int ox = fx - 64*minx;
+  int oy = fy - 64*miny;
+
+  for (auto & i : l.getData())
+  {
+    switch (i.command)
+    {
+      case CommandData_c::CMD_GLYPH:
+        output(ox+i.x, oy+i.y, cache.getGlyph(i.font, i.glyphIndex, sp, i.blurr), g.forward(i.c));
+        break;
+
+      case CommandData_c::CMD_RECT:
+        if (i.blurr == 0)
+        {
+          // just like the direct output we fill the rectangle with the opaque colour, use the
+          // full resolution of the gamma function to keep it exactly the same
+          int r = g.forward(i.c.r());
+          int gr = g.forward(i.c.g());
+          int b = g.forward(i.c.b());
+
+          int x0 = div_inf(i.x+fx+32, 64)-minx;
+          int y0 = div_inf(i.y+fy+32, 64)-miny;
+          int x1 = div_inf(i.x+fx+(int)i.w+32, 64)-minx;
+          int y1 = div_inf(i.y+fy+(int)i.h+32, 64)-miny;
+
+          for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++)
+            {
+              uint16_t * p = res.buffer.get() + 6*(y*w+x);
+              p[0] = r;
+              p[1] = gr;
+              p[2] = b;
+              p[3] = p[4] = p[5] = 255*S;
+            }
+        }
+        else
+        {
+          output(ox+i.x, oy+i.y, cache.getRect(i.w, i.h, sp, i.blurr), g.forward(i.c));
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  return res;
+}
+
+/** output a sprite onto a surface
+ *
+ * \param x x position of the top left corner of the sprite in pixels
+ * \param y y position of the top left corner of the sprite in pixels
+ * \param sprite the sprite to output, it must have been created with the same gamma function g
+ * \param s pointer to the start of the surface to paint on
+ * \param pitch how many bytes per line of pixels
+ * \param bbp how many bytes per pixel
+ * \param w width in pixels of the surface s
+ * \param h height in pixels of the surface s
+ * \param pxget function to read a pixel, returns a tuple with the r, g and b value
+ * \param pxput function to write a pixel, gets the pointer and the r, g and b value
+ * \param g gamma function
+ * \param cx clip rectangle left edge in pixels
+ * \param cy clib rectangle upper edge in pixels
+ * \param cw width in pixels of the clip rectangle
+ * \param ch height in pixels of the clip rectangle
+ */
+template <class P1, class P2, class G>
+void outputSprite(int x, int y, const LayoutSprite_c & sprite,
+                  uint8_t * s, int pitch, int bbp, int w, int h,
+                  const P1 & pxget, const P2 & pxput, const G & g,
+                  int cx = 0, int cy = 0, int cw = std::numeric_limits<int>::max(),
+                  int ch = std::numeric_limits<int>::max())
+{
+  // intersection of the sprite, the surface and the clip rectangle
+  int x0 = std::max(std::max(x, cx), 0);
+  int y0 = std::max(std::max(y, cy), 0);
+  int x1 = std::min(x+sprite.width, w);
+  int y1 = std::min(y+sprite.rows, h);
+
+  int cr = (cw < std::numeric_limits<int>::max()-cx) ? cx+cw : std::numeric_limits<int>::max();
+  x1 = std::min(x1, cr);
+
+  if (ch < std::numeric_limits<int>::max()-cy) y1 = std::min(y1, cy+ch);
+
+  // the glyph blitters never touch the last column of the output area, do the
+  // same here, so that cached and direct output look identical
+  if (x1 == w || x1 == cr) x1--;
+
+  if (x0 >= x1 || y0 >= y1) return;
+
+  const int full = 255*g.scale();
+
+  auto channel = [&g, full](uint8_t d, int p, int a) -> uint8_t {
+    if (a == 0) return d;
+    if (a == full) return g.inverse(p);
+    return g.inverse(g.forward(d)*(full-a)/full + p);
+  };
+
+  for (int yp = y0; yp < y1; yp++)
+  {
+    const uint16_t * src = sprite.buffer.get() + 6*((yp-y)*sprite.width + (x0-x));
+    uint8_t * dst = s + yp*pitch + bbp*x0;
+
+    for (int xp = x0; xp < x1; xp++)
+    {
+      // most of the sprite is usually empty, so check for that first
+      if (src[3] | src[4] | src[5])
+      {
+        auto px = pxget(dst);
+
+        pxput(dst, channel(std::get<0>(px), src[0], src[3]),
+                   channel(std::get<1>(px), src[1], src[4]),
+                   channel(std::get<2>(px), src[2], src[5]));
+      }
+
+      src += 6;
+      dst += bbp;
+    }
+  }
+}
+
+} }
+
+#endif
@@ -23,13 +23,22 @@
 #define STLL_TEXTURE_ATLAS_H
 
 #include "rectanglePacker.h"
+#include "binaryIO.h"
 
 #include <vector>
 #include <cstring>
 #include <unordered_map>
+#include <algorithm>
 
 namespace STLL { namespace internal {
 
+// a rectangular area inside of a texture atlas in pixels
+class AtlasRegion_c
+{
+  public:
+    uint32_t x, y, w, h;
+};
+
 // a texture atlas, allowing you to store texture
 // snippets, K is used to reference the elements
 // D is the data stored with each element, the stored texture will
@@ -45,7 +54,62 @@ class TextureAtlas_c
     std::vector<uint8_t> data;
 
     // whenever the content of the texture is changed, this value is updated
-    uint32_t version;
+    uint32_t version = 0;
+
+    // the areas that changed since the last call to resetDirty, and a flag that is set
+    // when the atlas changed its size, a texture copy of the atlas must then be recreated
+    std::vector<AtlasRegion_c> dirty;
+    bool resized = true;
+
+    // don't keep too many separate regions, as each one requires its own upload
+    static const size_t maxDirty = 16;
+
+    void markDirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+    {
+      if (w == 0 || h == 0) return;
+
+      AtlasRegion_c n { x, y, w, h };
+
+      // the packer places consecutive glyphs next to one another, so most of the time
+      // the new area can be merged with the previous one without including too
+      // many pixels that didn't change
+      if (!dirty.empty())
+      {
+        auto & l = dirty.back();
+
+        uint32_t x1 = std::min(l.x, x);
+        uint32_t y1 = std::min(l.y, y);
+        uint32_t x2 = std::max(l.x+l.w, x+w);
+        uint32_t y2 = std::max(l.y+l.h, y+h);
+
+        if ((x2-x1)*(y2-y1) <= 2*(l.w*l.h + w*h))
+        {
+          l = AtlasRegion_c { x1, y1, x2-x1, y2-y1 };
+          return;
+        }
+      }
+
+      dirty.push_back(n);
+
+      if (dirty.size() > maxDirty)
+      {
+        // too many regions, combine them all into one
+        AtlasRegion_c b = dirty[0];
+
+        for (auto & d : dirty)
+        {
+          uint32_t x2 = std::max(b.x+b.w, d.x+d.w);
+          uint32_t y2 = std::max(b.y+b.h, d.y+d.h);
+          b.x = std::min(b.x, d.x);
+          b.y = std::min(b.y, d.y);
+          b.w = x2-b.x;
+          b.h = y2-b.y;
+        }
+
+        dirty.clear();
+        dirty.push_back(b);
+      }
+    }
 
   protected:
 
@@ -59,6 +123,7 @@ class TextureAtlas_c
         auto pos = p.value();
 
         version++;
+        markDirty(pos[0], pos[1], w, h);
 
         return std::make_tuple(map.insert(std::make_pair(key, D(pos[0], pos[1], w, h, args...))).first, true);
       }
@@ -111,6 +176,18 @@ class TextureAtlas_c
       }
     }
 
+    // get an element from the texture atlas without trying to add it, when the
+    // element is not in the atlas, the returned optional will be empty
+    std::experimental::optional<D> get(const K & key) const
+    {
+      auto i = map.find(key);
+
+      if (i != map.end())
+        return i->second;
+      else
+        return std::experimental::optional<D>();
+    }
+
     const uint8_t * getData(void) const { return data.data(); }
     uint8_t * getData(void) { return data.data(); }
 
@@ -119,10 +196,82 @@ class TextureAtlas_c
 
     uint32_t getVersion(void) const { return version; }
 
+    // the regions of the atlas that changed since the last resetDirty
+    const std::vector<AtlasRegion_c> & getDirtyRegions(void) const { return dirty; }
+
+    // true, when the size of the atlas changed since the last resetDirty, in that
+    // case the whole atlas needs to be uploaded
+    bool isResized(void) const { return resized; }
+
+    // call this after you have uploaded the changed regions
+    void resetDirty(void)
+    {
+      dirty.clear();
+      resized = false;
+    }
+
+    // all the elements stored in the atlas
+    const std::unordered_map<K, D> & elements(void) const { return map; }
+
+    // write the packer state and the image, the elements are not written, as only the
+    // user of the atlas knows how to store the keys
+    void save(std::ostream & out) const
+    {
+      r.save(out);
+      writeBinary(out, data.data(), data.size());
+    }
+
+    // restore the state written by save, the saved atlas must have the same size as this one. All
+    // elements are removed, they have to be added again with restore. When the data is invalid
+    // false is returned and the atlas is unchanged
+    bool load(std::istream & in)
+    {
+      RectanglePacker_c p(1, 1);
+
+      if (!p.load(in) || p.width() != r.width() || p.height() != r.height()) return false;
+
+      std::vector<uint8_t> d(data.size());
+      if (!readBinary(in, d.data(), d.size())) return false;
+
+      r = p;
+      data.swap(d);
+      map.clear();
+
+      version++;
+      resized = true;
+      dirty.clear();
+
+      return true;
+    }
+
+    // add an element at the given position without allocating space for it, this
+    // is used to restore the elements of a loaded atlas
+    void restore(const K & key, const D & d)
+    {
+      map.insert(std::make_pair(key, d));
+    }
+
+    // replace the keys of all elements with the key returned by f(key)
+    template <class F>
+    void changeKeys(F f)
+    {
+      std::unordered_map<K, D> m;
+      m.reserve(map.size());
+
+      for (auto & e : map)
+        m.insert(std::make_pair(f(e.first), e.second));
+
+      map.swap(m);
+    }
+
     void clear(void) {
       r.clear();
       map.clear();
       std::fill(data.begin(), data.end(), 0);
+
+      // the whole content is gone, so everything has to be uploaded again
+      dirty.clear();
+      markDirty(0, 0, width(), height());
     }
 
     void doubleSize(void)
@@ -140,6 +289,9 @@ class TextureAtlas_c
       }
 
       data.swap(d);
+
+      resized = true;
+      dirty.clear();
     }
 };
 
@@ -36,6 +36,19 @@
 
 namespace STLL { namespace internal {
 
+// create the error message for a failed parse, txt is the parsed text, when available
+inline std::string xml_errorPugi(const pugi::xml_document & doc, const pugi::xml_parse_result & res, const std::string & txt)
+{
+  std::string error = std::string("Error Parsing XHTML [") + doc.child("node").attribute("attr").value() + "]\n" +
+                      "Error description: " + res.description() + "\n" +
+                      "Error offset: " + boost::lexical_cast<std::string>(res.offset);
+
+  if (!txt.empty())
+    error += "  " + txt.substr(std::max<int>(res.offset-20, 0), 20) + "[here]" + txt.substr(res.offset, 20);
+
+  return error;
+}
+
 inline std::tuple<std::unique_ptr<pugi::xml_document>, std::string> xml_parseStringPugi(const std::string & txt)
 {
   auto doc = std::make_unique<pugi::xml_document>();
@@ -45,10 +58,41 @@ inline std::tuple<std::unique_ptr<pugi::xml_document>, std::string> xml_parseStr
 
   if (!res)
   {
-    error =  std::string("Error Parsing XHTML [") + doc->child("node").attribute("attr").value() + "]\n" +
-             "Error description: " + res.description() + "\n" +
-             "Error offset: " + boost::lexical_cast<std::string>(res.offset) + "  " +
-             txt.substr(std::max<int>(res.offset-20, 0), 20) + "[here]" + txt.substr(res.offset, 20);
+    error = xml_errorPugi(*doc, res, txt);
+  }
+
+  return std::make_tuple(std::move(doc), std::move(error));
+}
+
+// parse the text within the buffer without copying it, the buffer is modified and the nodes
+// of the document point into the buffer, so it must exist as long as the document
+inline std::tuple<std::unique_ptr<pugi::xml_document>, std::string> xml_parseBufferPugi(char * txt, size_t length)
+{
+  auto doc = std::make_unique<pugi::xml_document>();
+  std::string error;
+
+  auto res = doc->load_buffer_inplace(txt, length, pugi::parse_ws_pcdata);
+
+  if (!res)
+  {
+    // the buffer is partially modified, so there is no text to show
+    error = xml_errorPugi(*doc, res, "");
+  }
+
+  return std::make_tuple(std::move(doc), std::move(error));
+}
+
+// parse a file, the file is read into a buffer owned by the document and parsed within that buffer
+inline std::tuple<std::unique_ptr<pugi::xml_document>, std::string> xml_parseFilePugi(const std::string & filename)
+{
+  auto doc = std::make_unique<pugi::xml_document>();
+  std::string error;
+
+  auto res = doc->load_file(filename.c_str(), pugi::parse_ws_pcdata);
+
+  if (!res)
+  {
+    error = xml_errorPugi(*doc, res, "");
   }
 
   return std::make_tuple(std::move(doc), std::move(error));
@@ -79,6 +123,18 @@ inline const char * xml_getAttribute(pugi::xml_node i, const char * attr) {
     return 0;
 }
 
+// pugi returns the attribute values directly, nothing to release
+inline void xml_releaseAttributeValues(pugi::xml_node) { }
+
+// replace the content of a node by a single text node
+inline void xml_setText(pugi::xml_node i, const std::string & text)
+{
+  while (i.first_child())
+    i.remove_child(i.first_child());
+
+  i.append_child(pugi::node_pcdata).set_value(text.c_str());
+}
+
 template <class F>
 bool xml_forEachChild(pugi::xml_node i, F f)
 {
@@ -114,6 +170,8 @@ bool xml_forEachAttribute(pugi::xml_node i, F f)
 
 #ifdef USE_LIBXML2
 #include <libxml/tree.h>
+#include <string>
+#include <deque>
 
 namespace STLL { namespace internal {
 
@@ -130,12 +188,8 @@ class libxml2Doc_c {
     libxml2Doc_c(libxml2Doc_c && d) : doc(d.doc) { d.doc = 0; }
 };
 
-inline std::tuple<libxml2Doc_c, std::string> xml_parseStringLibXML2(const std::string & txt)
+inline std::tuple<libxml2Doc_c, std::string> xml_checkLibXML2(libxml2Doc_c && doc)
 {
-  LIBXML_TEST_VERSION
-
-  /*parse the file and get the DOM */
-  libxml2Doc_c doc(xmlReadDoc((const xmlChar*)txt.c_str(), "", "utf-8", XML_PARSE_NOERROR + XML_PARSE_NOWARNING));
   std::string error;
 
   if ((doc.doc == nullptr) || !(doc.doc->properties & XML_DOC_WELLFORMED))
@@ -147,6 +201,31 @@ inline std::tuple<libxml2Doc_c, std::string> xml_parseStringLibXML2(const std::s
   return std::make_tuple(std::move(doc), std::move(error));
 }
 
+inline std::tuple<libxml2Doc_c, std::string> xml_parseStringLibXML2(const std::string & txt)
+{
+  LIBXML_TEST_VERSION
+
+  /*parse the file and get the DOM */
+  return xml_checkLibXML2(libxml2Doc_c(xmlReadDoc((const xmlChar*)txt.c_str(), "", "utf-8", XML_PARSE_NOERROR + XML_PARSE_NOWARNING)));
+}
+
+// libxml2 can not parse in place, the buffer is only read, but at least it doesn't need
+// to be copied into a string first
+inline std::tuple<libxml2Doc_c, std::string> xml_parseBufferLibXML2(const char * txt, size_t length)
+{
+  LIBXML_TEST_VERSION
+
+  return xml_checkLibXML2(libxml2Doc_c(xmlReadMemory(txt, length, "", "utf-8", XML_PARSE_NOERROR + XML_PARSE_NOWARNING)));
+}
+
+// the file is read piece by piece while parsing
+inline std::tuple<libxml2Doc_c, std::string> xml_parseFileLibXML2(const std::string & filename)
+{
+  LIBXML_TEST_VERSION
+
+  return xml_checkLibXML2(libxml2Doc_c(xmlReadFile(filename.c_str(), "utf-8", XML_PARSE_NOERROR + XML_PARSE_NOWARNING)));
+}
+
 inline const xmlNode * xml_getHeadNode(const libxml2Doc_c & doc)
 {
   return xmlDocGetRootElement(doc.doc);
@@ -163,8 +242,78 @@ inline const xmlNode * xml_getFirstChild(const xmlNode * i) { return i->children
 inline const xmlNode * xml_getNextSibling(const xmlNode * i) { return i->next; }
 inline const xmlNode * xml_getPreviousSibling(const xmlNode * i) { return i->prev; }
 
+// attribute values that consist of more than one node (e.g. with entity references) need to
+// be assembled into a new string. Those strings are kept here until release is called, the
+// strings are reused afterwards
+class libxml2AttributePool_c
+{
+  private:
+    std::deque<std::string> values;
+    size_t used = 0;
+
+  public:
+    const char * add(const xmlChar * v)
+    {
+      if (used == values.size()) values.emplace_back();
+
+      auto & s = values[used++];
+      s.assign(v ? (const char*)v : "");
+
+      return s.c_str();
+    }
+
+    void release(void) { used = 0; }
+};
+
+inline libxml2AttributePool_c & xml_attributePool(void)
+{
+  static thread_local libxml2AttributePool_c pool;
+  return pool;
+}
+
+// the value of an attribute, normally the value is a single text node and a pointer to the
+// content of that node is returned, so nothing is allocated
+inline const char * xml_getAttributeValue(const xmlAttr * a)
+{
+  auto c = a->children;
+
+  if (!c) return "";
+  if (!c->next && c->type == XML_TEXT_NODE && c->content) return (const char*)c->content;
+
+  xmlChar * content = xmlNodeListGetString(a->doc, c, 1);
+  auto res = xml_attributePool().add(content);
+  xmlFree(content);
+
+  return res;
+}
+
 inline const char * xml_getAttribute(const xmlNode * i, const char * attr) {
-  return (const char*)xmlGetProp(i, (const xmlChar*)attr);
+  if (i->type != XML_ELEMENT_NODE) return 0;
+
+  for (auto a = i->properties; a; a = a->next)
+    if (xmlStrEqual(a->name, (const xmlChar*)attr))
+      return xml_getAttributeValue(a);
+
+  return 0;
+}
+
+// allow the reuse of the attribute values assembled in the pool
+inline void xml_releaseAttributeValues(const xmlNode *) { xml_attributePool().release(); }
+
+// replace the content of a node by a single text node, the text is taken
+// as it is, entities are not replaced
+inline void xml_setText(const xmlNode * i, const std::string & text)
+{
+  auto n = const_cast<xmlNode*>(i);
+
+  while (n->children)
+  {
+    auto c = n->children;
+    xmlUnlinkNode(c);
+    xmlFreeNode(c);
+  }
+
+  xmlAddChild(n, xmlNewText((const xmlChar*)text.c_str()));
 }
 
 template <class F>
@@ -184,11 +333,7 @@ template <class F>
 bool xml_forEachAttribute(const xmlNode * i, F f) {
   for (auto c = i->properties; c; c = c->next)
   {
-    xmlChar *content = xmlNodeListGetString(i->doc, c->children, 1);
-    bool b = f((const char*)c->name, (const char *)content);
-    xmlFree(content);
-
-    if (b)
+    if (f((const char*)c->name, xml_getAttributeValue(c)))
     {
       return true;
     }
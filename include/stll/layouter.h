@@ -79,20 +79,29 @@ public:
 
   std::string imageURL; ///< URL of image to draw
 
+  /** \brief the span of the text this command was created for, see CodepointAttributes_c::span */
+  uint32_t span;
+
+  /** \brief 0 when this command draws the text itself (glyph or underline), i+1 when it draws
+   * the shadow with index i of CodepointAttributes_c::shadows */
+  uint16_t shadow;
+
   /** \brief constructor to create an glyph command
    */
-  CommandData_c(std::shared_ptr<FontFace_c> f, glyphIndex_t i, int32_t x_, int32_t y_, Color_c c_, uint16_t rad) :
-  command(CMD_GLYPH), x(x_), y(y_), glyphIndex(i), font(f), w(0), h(0), c(c_), blurr(rad) {}
+  CommandData_c(std::shared_ptr<FontFace_c> f, glyphIndex_t i, int32_t x_, int32_t y_, Color_c c_, uint16_t rad,
+                uint32_t span_ = 0, uint16_t shadow_ = 0) :
+  command(CMD_GLYPH), x(x_), y(y_), glyphIndex(i), font(f), w(0), h(0), c(c_), blurr(rad), span(span_), shadow(shadow_) {}
 
   /** \brief constructor to create an image command
    */
   CommandData_c(const std::string & i, int32_t x_, int32_t y_, uint32_t w_, uint32_t h_) :
-  command(CMD_IMAGE), x(x_), y(y_), glyphIndex(0), w(w_), h(h_), blurr(0), imageURL(i) {}
+  command(CMD_IMAGE), x(x_), y(y_), glyphIndex(0), w(w_), h(h_), blurr(0), imageURL(i), span(0), shadow(0) {}
 
   /** \brief constructor to create an rectangle command
    */
-  CommandData_c(int32_t x_, int32_t y_, uint32_t w_, uint32_t h_, Color_c c_, uint16_t rad) :
-  command(CMD_RECT), x(x_), y(y_), glyphIndex(0), w(w_), h(h_), c(c_), blurr(rad) {}
+  CommandData_c(int32_t x_, int32_t y_, uint32_t w_, uint32_t h_, Color_c c_, uint16_t rad,
+                uint32_t span_ = 0, uint16_t shadow_ = 0) :
+  command(CMD_RECT), x(x_), y(y_), glyphIndex(0), w(w_), h(h_), c(c_), blurr(rad), span(span_), shadow(shadow_) {}
 };
 
 /** \brief encapsulates a finished layout.
@@ -111,11 +120,43 @@ class TextLayout_c
     // the drawing commands that make up this layout
     std::vector<CommandData_c> data;
 
+    // spatial index of the link areas, see buildLinkIndex. The layout is cut into horizontal
+    // bands at the upper and lower edges of all link areas, each band contains the areas
+    // that cover it, sorted by their left edge
+    class LinkIndex_c
+    {
+      public:
+        class Area_c
+        {
+          public:
+            int32_t x0, x1;   // left and right edge of the area
+            int32_t maxX1;    // biggest right edge of this and all previous areas within the band
+            uint32_t link;    // index into links
+        };
+
+        std::vector<int32_t> bands;    // upper edges of the bands, the last value is the lower edge of the last band
+        std::vector<uint32_t> start;   // index of the first area of each band, plus the end of the last band
+        std::vector<Area_c> areas;
+        int32_t dx = 0, dy = 0;        // shift of the layout since the index was built
+        bool valid = false;
+    };
+
+    LinkIndex_c linkIndex;
+
+    // the commands sorted by their span, see buildSpanIndex, empty when there is no index
+    std::vector<std::pair<uint32_t, uint32_t>> spanIndex;
+
+    // identifier of the current content of data, see getVersion, 0 when not yet assigned
+    mutable uint64_t version = 0;
+
+    template <class F>
+    size_t forEachSpanCommand(uint32_t span, uint16_t shadow, F f);
+
   public:
 
     /** \brief get the command vector
      */
-    const std::vector<CommandData_c> getData(void) const { return data; }
+    const std::vector<CommandData_c> & getData(void) const { return data; }
 
     /** \brief a little structure to hold information for one rectangle */
     class Rectangle_c
@@ -163,6 +204,8 @@ class TextLayout_c
     void addCommand(Args&&... args)
     {
       data.emplace_back(std::forward<Args>(args)...);
+      spanIndex.clear();
+      version = 0;
     }
 
     /** \brief add a single drawing command to the end of the command list
@@ -174,6 +217,8 @@ class TextLayout_c
     void addCommand(const CommandData_c & c)
     {
       data.push_back(c);
+      spanIndex.clear();
+      version = 0;
     }
 
     /** \brief add a single drawing command to the start of the command list
@@ -187,6 +232,8 @@ class TextLayout_c
     void addCommandStart(Args&&... args)
     {
       data.emplace(data.begin(), std::forward<Args>(args)...);
+      spanIndex.clear();
+      version = 0;
     }
 
     /** \brief add a single drawing command to the start of the command list
@@ -198,6 +245,8 @@ class TextLayout_c
     void addCommandStart(const CommandData_c & d)
     {
       data.insert(data.begin(), d);
+      spanIndex.clear();
+      version = 0;
     }
 
     /** \brief append a layout to this layout, which means that the drawing
@@ -222,6 +271,9 @@ class TextLayout_c
       right = l.right;
       firstBaseline = l.firstBaseline;
       swap(links, l.links);
+      std::swap(linkIndex, l.linkIndex);
+      spanIndex.swap(l.spanIndex);
+      std::swap(version, l.version);
     }
 
     /** \brief copy assignment
@@ -234,6 +286,9 @@ class TextLayout_c
       right = l.right;
       firstBaseline = l.firstBaseline;
       links = l.links;
+      linkIndex = l.linkIndex;
+      spanIndex = l.spanIndex;
+      version = l.version;
     }
 
     ~TextLayout_c(void) { }
@@ -251,12 +306,83 @@ class TextLayout_c
     TextLayout_c(TextLayout_c && src);
 
     /** \brief shift all the commands within the layout by the given amount
+     *
+     * The link index stays valid.
      *
      * \param dx x-offset in 1/64th pixels
      * \param dy y-offset in 1/64th pixels
      */
     void shift(int32_t dx, int32_t dy);
 
+    /** \brief create an index for fast searching of links with linkAt and linksInRect
+     *
+     * Without the index these functions check all areas of all links. Create the index once the
+     * layout is finished. When you change links afterwards you need to call this function again,
+     * append removes the index.
+     */
+    void buildLinkIndex(void);
+
+    /** \brief find the link at a position
+     *
+     * \param x x-position in 1/64th pixels
+     * \param y y-position in 1/64th pixels
+     * \return the index into links of the link whose area contains the position, or -1 when there is
+     *         no link. If areas of several links overlap, one of them is returned
+     */
+    int linkAt(int32_t x, int32_t y) const;
+
+    /** \brief find all links that have an area within a rectangle
+     *
+     * \param x x-position of the rectangle in 1/64th pixels
+     * \param y y-position of the rectangle in 1/64th pixels
+     * \param w width of the rectangle in 1/64th pixels
+     * \param h height of the rectangle in 1/64th pixels
+     * \return the sorted indices into links of all links with at least one area overlapping the rectangle
+     */
+    std::vector<size_t> linksInRect(int32_t x, int32_t y, int32_t w, int32_t h) const;
+
+    /** \brief create an index for fast changes with recolor and moveShadow
+     *
+     * Without the index these functions check all commands of the layout, with it only the
+     * commands of the requested span are touched. Create the index once the layout is finished,
+     * adding commands or appending layouts removes the index.
+     */
+    void buildSpanIndex(void);
+
+    /** \brief change the colour of the commands created for a span of text
+     *
+     * Glyph positions are not changed, so this is much faster than a new layout, e.g. for
+     * hover effects. Caches that contain the drawn layout (like the drawing caches of the
+     * output drivers) need to be recreated.
+     *
+     * \param span the span to change, see CodepointAttributes_c::span, span 0 contains the
+     *        commands that belong to no span (e.g. borders and backgrounds of boxes), those
+     *        are never changed
+     * \param c the new colour
+     * \param shadow 0 to change the text itself (glyphs and underlines), i+1 to change
+     *        the shadow with index i
+     * \return the number of changed commands
+     */
+    size_t recolor(uint32_t span, Color_c c, uint16_t shadow = 0);
+
+    /** \brief move the shadow of a span of text
+     *
+     * \param span the span to change, see CodepointAttributes_c::span, span 0 is never changed
+     * \param shadow index of the shadow within CodepointAttributes_c::shadows
+     * \param dx the horizontal distance to move the shadow by in 1/64th pixels
+     * \param dy the vertical distance to move the shadow by in 1/64th pixels
+     * \return the number of changed commands
+     */
+    size_t moveShadow(uint32_t span, uint16_t shadow, int32_t dx, int32_t dy);
+
+    /** \brief get an identifier for the current drawing commands of the layout
+     *
+     * The version changes whenever the commands are changed, copies of a layout keep the
+     * version. Versions are never reused, so two layouts with the same version contain the
+     * same commands. Caches of drawn layouts use this to avoid comparing all commands.
+     */
+    uint64_t getVersion(void) const;
+
     /** \brief the height of the layout. This is supposed to be the vertical
      *  space that this layout takes up in 1/64th pixels
      */
@@ -383,9 +509,18 @@ class CodepointAttributes_c
    */
   size_t link;
 
+  /** \brief an identifier for this text that you can choose freely
+   *
+   * All drawing commands created for the text (glyphs, shadows and underlines) carry
+   * this value in CommandData_c::span, so that you can change their colour later on with
+   * TextLayout_c::recolor or move the shadows with TextLayout_c::moveShadow. The value 0,
+   * the default, means that the text belongs to no span, so start your identifiers at 1
+   */
+  uint32_t span;
+
   /** \brief create an empty attribute, no font, no language, no flags, no inlay, no baseline shift
    */
-  CodepointAttributes_c(void) : lang(""), flags(0), inlay(0), baseline_shift(0), link(0) { }
+  CodepointAttributes_c(void) : lang(""), flags(0), inlay(0), baseline_shift(0), link(0), span(0) { }
 
   /** \brief comparison operator
    */
@@ -395,7 +530,19 @@ class CodepointAttributes_c
       && flags == rhs.flags && shadows.size() && rhs.shadows.size()
       && std::equal(shadows.begin(), shadows.end(), rhs.shadows.begin())
       && inlay == rhs.inlay && baseline_shift == rhs.baseline_shift
-      && link == rhs.link;
+      && link == rhs.link && span == rhs.span;
+  }
+
+  /** \brief check whether text with these attributes can be shaped together with text
+   * with the other attributes
+   *
+   * Only the attributes that change the shaping are compared: the language and the baseline
+   * shift. The font is checked by the layouter for each character. Colour, shadows, links and
+   * spans only change the drawing commands of the glyphs, so they never split a shaping run
+   */
+  bool shapesLike(const CodepointAttributes_c & rhs) const
+  {
+    return lang == rhs.lang && baseline_shift == rhs.baseline_shift;
   }
 
   /** \brief this operator is required for the interval container within the
@@ -414,6 +561,7 @@ class CodepointAttributes_c
     inlay = rhs.inlay;
     baseline_shift = rhs.baseline_shift;
     link = rhs.link;
+    span = rhs.span;
 
     return *this;
   }
@@ -73,6 +73,17 @@ class TextStyleSheet_c
      */
     TextStyleSheet_c(std::shared_ptr<FontCache_c> c = 0);
 
+    /** \brief create a copy of a style sheet that uses a different font cache
+     *
+     * All rules, font families and settings are copied. The fonts will be opened with the
+     * given cache. As a cache can only be used by one thread, this is the way to get a style sheet
+     * for another thread.
+     *
+     * \param s the style sheet to copy
+     * \param c the cache to use, when nullptr a new cache with its own library instance is created
+     */
+    TextStyleSheet_c(const TextStyleSheet_c & s, std::shared_ptr<FontCache_c> c);
+
     /** \brief Add a font to a family.
      *
      * This function will add a new font to a family within this stylesheet.
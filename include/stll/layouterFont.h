@@ -46,6 +46,8 @@ struct FT_GlyphSlotRec_;
 
 namespace STLL {
 
+namespace internal { class OutlineCache_c; }
+
 /** \brief type used for all glyph indices. Right now there is no
  * font with more than 2^16 fonts, so 2^32 should be on the safe side.
  * Also HarfBuzz also uses only 2^32 codepoints.
@@ -158,7 +160,9 @@ class FontFace_c : boost::noncopyable
         GlyphSlot_c(int width, int height) : w(width), h(height), top(0), left(0), pitch(0), data(0) {}
     };
 
-    FontFace_c(std::shared_ptr<FreeTypeLibrary_c> l, const internal::FontFileResource_c & r, uint32_t size);
+    FontFace_c(std::shared_ptr<FreeTypeLibrary_c> l, const internal::FontFileResource_c & r, uint32_t size,
+               std::shared_ptr<internal::OutlineCache_c> outlines = nullptr,
+               std::shared_ptr<uint64_t> contentHash = nullptr);
     ~FontFace_c();
 
     /** \brief Get the FreeType structure for this font
@@ -178,6 +182,14 @@ class FontFace_c : boost::noncopyable
      */
     const internal::FontFileResource_c & getResource(void) const { return rec; }
 
+    /** \brief get a hash value of the content of the font file
+     *
+     * Two fonts with the same hash have the same glyphs, no matter where they have been
+     * loaded from. The hash is shared by all sizes of the font file that are opened by the same
+     * FontCache_c, so the file is only read once for all of them
+     */
+    uint64_t getContentHash(void) const;
+
     /** \brief Get the height of the font with multiplication factor of 64
      * \return height of font
      */
@@ -212,6 +224,24 @@ class FontFace_c : boost::noncopyable
      */
     GlyphSlot_c renderGlyph(glyphIndex_t glyphIndex, SubPixelArrangement sp);
 
+    /** \brief render a glyph of this font with the internal rasterizer
+     *
+     * The outline of each glyph is loaded from the font file only once and then kept for all
+     * sizes of the same font file, so this is faster than renderGlyph, when you need the same glyphs
+     * in many sizes, e.g. when zooming. The glyphs are not hinted, so they look a bit different from
+     * the ones of renderGlyph.
+     *
+     * \param glyphIndex the index of the glyph to render (take it from the layout)
+     * \param sp the requested sub-pixel arrangement, vertical arrangements are rendered with renderGlyph
+     * \param size the size to render the glyph in 1/64 pixels, 0 for the size of this font
+     * \param dx horizontal offset in 1/64 pixels, to place the glyph at sub pixel positions
+     * \return the image of the glyph, it is valid until the next glyph of this font file is rendered
+     */
+    GlyphSlot_c renderOutline(glyphIndex_t glyphIndex, SubPixelArrangement sp, uint32_t size = 0, int32_t dx = 0);
+
+    /** \brief get the cache with the glyph outlines of the font file */
+    std::shared_ptr<internal::OutlineCache_c> getOutlines(void) const { return outlines; }
+
     /** \brief check if a given character is available within this font
      * \param ch the unicode character to check
      * \return true, when the character is available within the font, false otherwise
@@ -223,6 +253,12 @@ class FontFace_c : boost::noncopyable
     std::shared_ptr<FreeTypeLibrary_c> lib;
     internal::FontFileResource_c rec;
     uint32_t size;
+    std::shared_ptr<internal::OutlineCache_c> outlines;
+
+    // hash of the font file, shared between all sizes, 0 when not yet calculated
+    std::shared_ptr<uint64_t> contentHash;
+
+    friend class FontCache_c;
 };
 
 /** \brief contains all the FontFaces_c of one FontRessource_c
@@ -437,6 +473,11 @@ class FontFamily_c
      */
     FontFamily_c(void) : cache(std::make_shared<FontCache_c>()) {}
 
+    /** \brief Initialize a family with the same fonts as another family but using a
+     * different font cache, e.g. to use the family in another thread
+     */
+    FontFamily_c(const FontFamily_c & f, std::shared_ptr<FontCache_c> c) : fonts(f.fonts), cache(c) {}
+
     /** \brief Get a font instance from the family.
      *
      * \param size Size in pixels
@@ -31,6 +31,9 @@
 #include "internal/xmllibraries.h"
 
 #include <string>
+#include <vector>
+#include <map>
+#include <memory>
 
 namespace STLL {
 
@@ -46,6 +49,173 @@ TextLayout_c layoutXML(pugi::xml_node txt, const TextStyleSheet_c & rules, const
 TextLayout_c layoutXML(const xmlNode * txt, const TextStyleSheet_c & rules, const Shape_c & shape);
 #endif
 
+/** \brief keeps the layout of a preparsed XML tree, so that it can be updated quickly
+ * after the tree has been changed
+ *
+ * The layout of each block within the body (paragraphs, headings, lists, tables, divs and
+ * the text between them) is kept together with its vertical position. When you change the tree,
+ * mark the changed nodes with markDirty. The next call to layout will only layout the blocks
+ * that contain those nodes again. The blocks following them are only moved, when the height
+ * changed, and the box of the body (borders and background) is adjusted.
+ *
+ * The blocks are moved without layouting them again, so the result is only identical to a
+ * complete layout when the left and right edges of the shape don't depend on the vertical
+ * position (e.g. RectangleShape_c). Otherwise use markAllDirty.
+ *
+ * When you add or remove nodes directly within the body, or you change the stylesheet or the
+ * shape, call markAllDirty. Nodes that are added or removed inside of a block are fine, as long as
+ * you mark the block (or one of its nodes) dirty. Removing a complete block requires markAllDirty
+ * _before_ the node is removed.
+ *
+ * \tparam X the node type of the XML library, either pugi::xml_node or const xmlNode *
+ */
+template <class X>
+class IncrementalXMLLayout_c
+{
+  private:
+    class Block_c
+    {
+      public:
+        X first;                // the first node of the block
+        X next;                 // the first node after the block
+        int32_t ystart;         // the position the block was laid out at
+        TextLayout_c l;
+        bool dirty;
+    };
+
+    X root;
+    std::vector<Block_c> blocks;
+    std::map<X, size_t> nodes;  // the nodes directly within the body and the block they belong to
+    TextLayout_c result;
+    bool valid = false;
+    bool changed = false;
+
+  public:
+
+    /** \brief create the object for the given tree, nothing is laid out yet
+     *  \param txt the html node of the tree, the tree must stay alive as long as this object is used
+     */
+    IncrementalXMLLayout_c(X txt) : root(txt) { }
+
+    /** \brief get the layout of the tree
+     *
+     * The first call will layout the complete tree, following calls will only
+     * update the parts that were marked as dirty
+     *
+     *  \param rules the stylesheet to use for layouting
+     *  \param shape the shape to layout into
+     *  \return the layout, it stays valid until the next call to layout
+     */
+    const TextLayout_c & layout(const TextStyleSheet_c & rules, const Shape_c & shape);
+
+    /** \brief mark a node as changed, the block that contains this node will be laid out again
+     *  \param node the changed node, may be an element, a text node or any node below them
+     */
+    void markDirty(X node);
+
+    /** \brief layout everything again with the next call to layout */
+    void markAllDirty(void) { valid = false; }
+};
+
+#ifdef USE_PUGI_XML
+extern template class IncrementalXMLLayout_c<pugi::xml_node>;
+#endif
+#ifdef USE_LIBXML2
+extern template class IncrementalXMLLayout_c<const xmlNode *>;
+#endif
+
+/** \brief an XHTML document that is parsed once and then laid out many times with different
+ * texts in some places
+ *
+ * Mark the elements that should receive a text with the attribute data-slot, the value
+ * of the attribute is the name of the slot, several elements may use the same name. When
+ * instantiating the template the content of those elements is replaced by the given text.
+ *
+ * The document is parsed only once. When a slot text changes, the whole block directly within
+ * the body that contains the slot (a complete paragraph, list, table or div, see IncrementalXMLLayout_c)
+ * is laid out again from scratch, including the lookup of its CSS rules, and so is the following
+ * block, as its margins depend on the changed one. All other blocks are kept from the previous
+ * instantiation and only moved, so put slots that change often into small blocks of their own.
+ *
+ * Create the template with compileXHTML. The template changes its document, so it can only be
+ * moved, not copied.
+ *
+ * \tparam X the node type of the XML library, either pugi::xml_node or const xmlNode *
+ */
+template <class X>
+class XHTMLTemplate_c
+{
+  private:
+    class Slot_c
+    {
+      public:
+        std::string name;
+        X node;
+        std::string value;
+        bool set;
+    };
+
+    std::shared_ptr<void> doc;  // keeps the parsed document alive
+    IncrementalXMLLayout_c<X> inc;
+    std::vector<Slot_c> slots;
+
+  public:
+
+    /** \brief create the template from a parsed document, use compileXHTML instead
+     *  \param d the document, it will be changed by the template
+     *  \param txt the html node of the document
+     */
+    XHTMLTemplate_c(std::shared_ptr<void> d, X txt);
+
+    XHTMLTemplate_c(const XHTMLTemplate_c &) = delete;
+    XHTMLTemplate_c & operator=(const XHTMLTemplate_c &) = delete;
+    XHTMLTemplate_c(XHTMLTemplate_c &&) = default;
+    XHTMLTemplate_c & operator=(XHTMLTemplate_c &&) = default;
+
+    /** \brief layout the document with the given slot texts
+     *
+     *  \param values the text for the slots, slots that are not given keep their
+     *                text from the last instantiation or from the document, the text
+     *                is used as it is, no entities are replaced
+     *  \param rules the stylesheet to use for layouting
+     *  \param shape the shape to layout into, when you change the stylesheet or
+     *                the shape call markAllDirty
+     *  \return the layout, it stays valid until the next call to instantiate
+     */
+    const TextLayout_c & instantiate(const std::map<std::string, std::string> & values,
+                                     const TextStyleSheet_c & rules, const Shape_c & shape);
+
+    /** \brief layout everything again with the next instantiation */
+    void markAllDirty(void) { inc.markAllDirty(); }
+
+    /** \brief get the names of all slots in the document, in document order */
+    std::vector<std::string> getSlots(void) const;
+};
+
+#ifdef USE_PUGI_XML
+extern template class XHTMLTemplate_c<pugi::xml_node>;
+#endif
+#ifdef USE_LIBXML2
+extern template class XHTMLTemplate_c<const xmlNode *>;
+#endif
+
+/** \brief parse XHTML code into a template
+ *  \param lib the library to use, currently supported as Pugi and LibXML2
+ *  \param txt the html text to parse, is must be utf-8. The text must be a proper XHTML document (see also \ref html_sec)
+ *  \return the template, with the slots of the document
+ *  \attention it is not checked that txt is proper utf-8. If you have unsafe sources
+ *  for your text to layout, use the check function from the utf-8 module
+ */
+#ifdef USE_PUGI_XML
+XHTMLTemplate_c<pugi::xml_node> compileXHTMLPugi(const std::string & txt);
+#endif
+#ifdef USE_LIBXML2
+XHTMLTemplate_c<const xmlNode *> compileXHTMLLibXML2(const std::string & txt);
+#endif
+
+#define compileXHTML2(lib, txt) compileXHTML##lib(txt)
+#define compileXHTML(lib, txt) compileXHTML2(lib, txt)
+
 /** \brief layout the given XHTML code
  *  \param lib the library to use, currently supported as Pugi and LibXML2
  *  \param txt the html text to parse, is must be utf-8. The text must be a proper XHTML document (see also \ref html_sec)
@@ -64,6 +234,86 @@ TextLayout_c layoutXHTMLLibXML2(const std::string & txt, const TextStyleSheet_c
 #define layoutXHTML2(lib, txt, rules, shape) layoutXHTML##lib(txt, rules, shape)
 #define layoutXHTML(lib, txt, rules, shape) layoutXHTML2(lib, txt, rules, shape)
 
+/** \brief layout the XHTML code within a buffer that you own
+ *
+ * Compared to layoutXHTML this avoids copying the whole document. Pugi parses the
+ * buffer in place, so the content of the buffer is destroyed. LibXML2 can not
+ * parse in place, but it reads directly from the buffer and leaves it unchanged
+ *
+ *  \param lib the library to use, currently supported as Pugi and LibXML2
+ *  \param txt the buffer with the html text, is must be utf-8, it doesn't need to be 0-terminated
+ *  \param length the number of bytes in the buffer
+ *  \param rules the stylesheet to use for layouting
+ *  \param shape the shape to layout into
+ *  \attention it is not checked that txt is proper utf-8. If you have unsafe sources
+ *  for your text to layout, use the check function from the utf-8 module
+ */
+#ifdef USE_PUGI_XML
+TextLayout_c layoutXHTMLBufferPugi(char * txt, size_t length, const TextStyleSheet_c & rules, const Shape_c & shape);
+#endif
+#ifdef USE_LIBXML2
+TextLayout_c layoutXHTMLBufferLibXML2(char * txt, size_t length, const TextStyleSheet_c & rules, const Shape_c & shape);
+#endif
+
+#define layoutXHTMLBuffer2(lib, txt, length, rules, shape) layoutXHTMLBuffer##lib(txt, length, rules, shape)
+#define layoutXHTMLBuffer(lib, txt, length, rules, shape) layoutXHTMLBuffer2(lib, txt, length, rules, shape)
+
+/** \brief layout the XHTML code within a file
+ *
+ * The file is read directly by the XML library, Pugi reads it into one buffer and parses
+ * it in place, LibXML2 reads it piece by piece
+ *
+ *  \param lib the library to use, currently supported as Pugi and LibXML2
+ *  \param filename the file to read, is must be utf-8
+ *  \param rules the stylesheet to use for layouting
+ *  \param shape the shape to layout into
+ */
+#ifdef USE_PUGI_XML
+TextLayout_c layoutXHTMLFilePugi(const std::string & filename, const TextStyleSheet_c & rules, const Shape_c & shape);
+#endif
+#ifdef USE_LIBXML2
+TextLayout_c layoutXHTMLFileLibXML2(const std::string & filename, const TextStyleSheet_c & rules, const Shape_c & shape);
+#endif
+
+#define layoutXHTMLFile2(lib, filename, rules, shape) layoutXHTMLFile##lib(filename, rules, shape)
+#define layoutXHTMLFile(lib, filename, rules, shape) layoutXHTMLFile2(lib, filename, rules, shape)
+
+/** \brief layout many independent XHTML documents with the same style sheet
+ *
+ * The documents are laid out concurrently. The calling thread uses the given style
+ * sheet, each additional thread uses a copy of it with its own font cache (see
+ * TextStyleSheet_c::TextStyleSheet_c(const TextStyleSheet_c &, std::shared_ptr<FontCache_c>)),
+ * that is used for all the documents the thread handles. So do not use the style sheet
+ * or its font cache in other threads while this function runs.
+ *
+ * The threads don't share one font cache, as FreeType faces can only be used by one thread
+ * at a time and the layout loads glyphs from them. So each additional thread copies the rules
+ * and opens the fonts it needs again. The threads are started for each call and end with it, the
+ * library keeps no threads around. Both costs are paid once per thread and call, not per document,
+ * so give many documents to one call instead of calling this function with a few documents at a time.
+ *
+ * When one of the documents can not be laid out, the exception of the first such
+ * document is thrown after all documents have been handled.
+ *
+ *  \param lib the library to use, currently supported as Pugi and LibXML2
+ *  \param txt the documents, see layoutXHTML
+ *  \param rules the stylesheet to use for layouting
+ *  \param shape the shape to layout into, it is used by all threads at the same time
+ *  \param threads the number of threads to use, 0 uses as many threads as the machine has cores
+ *  \return the layouts, in the order of the documents
+ */
+#ifdef USE_PUGI_XML
+std::vector<TextLayout_c> layoutXHTMLBatchPugi(const std::vector<std::string> & txt, const TextStyleSheet_c & rules,
+                                               const Shape_c & shape, unsigned int threads = 0);
+#endif
+#ifdef USE_LIBXML2
+std::vector<TextLayout_c> layoutXHTMLBatchLibXML2(const std::vector<std::string> & txt, const TextStyleSheet_c & rules,
+                                                  const Shape_c & shape, unsigned int threads = 0);
+#endif
+
+#define layoutXHTMLBatch2(lib, txt, rules, shape, threads) layoutXHTMLBatch##lib(txt, rules, shape, threads)
+#define layoutXHTMLBatch(lib, txt, rules, shape, threads) layoutXHTMLBatch2(lib, txt, rules, shape, threads)
+
 }
 
 #endif
@@ -0,0 +1,343 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#ifndef STLL_LAYOUTER_DRAW_LIST
+#define STLL_LAYOUTER_DRAW_LIST
+
+/** \file
+ *  \brief engine independent output driver that creates lists of textured rectangles
+ */
+
+#include "layouter.h"
+#include "color.h"
+
+#include "internal/glyphAtlas.h"
+#include "internal/gamma.h"
+
+#include <vector>
+#include <string>
+
+namespace STLL {
+
+/** \brief one textured rectangle of a draw list
+ *
+ * The rectangle is to be drawn at the given position with the given size, the texture
+ * comes from the given area of the glyph atlas and contains the alpha (coverage) values
+ * for the colour.
+ *
+ * The atlas is made out of several pages, page tells you which of the pages contains
+ * the texture.
+ *
+ * When subpixel is set, the atlas area contains an image with 3 times the horizontal
+ * resolution: the coverage values for the red, green and blue channel of one target pixel
+ * are stored in 3 consecutive texels. For SUBP_RGB the red value is at the texture
+ * coordinate, green one texel and blue two texels to the right of it. For SUBP_BGR
+ * red and blue are swapped. The 3 channels are to be blended separately
+ * e.g. with dual source blending.
+ *
+ * The class only contains plain values so the list can be directly copied into
+ * vertex or instance buffers.
+ */
+class DrawQuad_c
+{
+  public:
+    float x, y;           ///< top left corner on the target in pixels
+    float w, h;           ///< size on the target in pixels
+    float u, v;           ///< top left corner of the texture inside of the atlas in texels
+    float tw, th;         ///< size of the texture area inside of the atlas in texels
+    uint8_t r, g, b, a;   ///< colour, already converted with the gamma function
+    uint8_t subpixel;     ///< 1 when the texture contains separate values for the 3 colour channels
+    uint16_t page;        ///< the atlas page that contains the texture
+};
+
+/** \brief an image that needs to be drawn, the position is in 1/64th pixels on the target */
+class DrawImage_c
+{
+  public:
+    int32_t x, y;
+    uint32_t w, h;
+    std::string url;
+};
+
+/** \brief an area of the atlas in pixels */
+using AtlasRegion_c = internal::AtlasRegion_c;
+
+/** \brief the state of one page of the atlas */
+class DrawPage_c
+{
+  public:
+    /// the atlas pixel data, it has width*height bytes
+    const uint8_t * atlas;
+    uint32_t width;
+    uint32_t height;
+
+    /// when this is true the page is new or changed its size and your texture needs to be
+    /// recreated with the complete atlas data
+    bool resized;
+
+    /// the regions of the page that changed and need to be updated in your texture,
+    /// when resized is true, you can ignore this list
+    std::vector<AtlasRegion_c> dirty;
+
+    /// identifier of the page content, as long as this stays the same, the positions
+    /// within the page stay valid, so you can keep quads from earlier batches and draw
+    /// them again, once this value changes, old quads using this page become invalid
+    uint32_t id;
+};
+
+/** \brief one batch of drawing commands
+ *
+ * All quads of a batch use the atlas as it is at the time the batch is handed over
+ * to you. If the atlas changed, you need to update your copy of the atlas before you
+ * draw the quads. The atlas pages have one byte per pixel.
+ *
+ * Draw the quads in the given order and switch the texture whenever the page changes. Consecutive
+ * quads will use the same page most of the time.
+ */
+class DrawBatch_c
+{
+  public:
+    /// the rectangles to draw
+    std::vector<DrawQuad_c> quads;
+
+    /// images contained within the layout in this batch
+    std::vector<DrawImage_c> images;
+
+    /// all pages of the atlas
+    std::vector<DrawPage_c> pages;
+};
+
+/** \brief a class to output layouts into a list of textured rectangles
+ *
+ * This class is the CPU half of the OpenGL output driver. It manages a glyph atlas
+ * and converts layouts into lists of textured rectangles but does not draw anything. Use
+ * this class if you want to draw with your own engine (e.g. Vulkan, Direct3D, Metal).
+ *
+ * To output a layout call showLayout, it will call a function that you give with
+ * one or more batches of rectangles. The atlas consists of several pages, when all of them are full
+ * the least recently used page is cleared and reused. If the layout doesn't fit into all pages
+ * together, it will be split into several batches with pages being cleared between them, so you must
+ * draw (or at least upload the atlas) when you get the batch.
+ *
+ * The drawing should use blending of the colour with the alpha values from the atlas multiplied
+ * with the alpha of the colour. Just like with OpenGL you should draw into an sRGB framebuffer
+ * as the colours are converted into linear space by the gamma function.
+ *
+ * \tparam G the gamma calculation function, normally you don't need to change this
+ */
+template <class G = internal::Gamma_c<>>
+class showDrawList
+{
+  private:
+    internal::PagedGlyphAtlas_c cache;
+    G g;
+
+    DrawBatch_c batch;
+
+    void addQuad(float x, float y, float w, float h, const internal::FontAtlasData_c & pos,
+                 float u, float v, float tw, float th, Color_c c, uint8_t subpixel)
+    {
+      batch.quads.push_back(DrawQuad_c { x, y, w, h, u, v, tw, th, c.r(), c.g(), c.b(), c.a(), subpixel, (uint16_t)pos.page });
+    }
+
+  public:
+
+    /** \brief constructor
+     *
+     * \param cStart initial size of the glyph atlas, the atlas will be a square
+     *               image with the dimensions of cStart
+     * \param cMax once the atlas is full its dimensions will be doubled until it has reached
+     *             at least this value
+     * \param pages the maximal number of atlas pages of the final size
+     */
+    showDrawList(uint32_t cStart = 256, uint32_t cMax = 1024, uint32_t pages = 4) : cache(cStart, cMax, pages)
+    {
+      g.setGamma(22);
+    }
+
+    /** \brief convert a layout into rectangles
+     *
+     * \param l the layout to convert
+     * \param sx x position on the target in 1/64th pixels
+     * \param sy y position on the target in 1/64th pixels
+     * \param sp which kind of sub-pixel positioning do you want?
+     * \param submit function that is called with each batch (const DrawBatch_c &) that is created
+     *               for the layout, the batch is only valid until the function returns
+     */
+    template <class F>
+    void showLayout(const TextLayout_c & l, int sx, int sy, SubPixelArrangement sp, F submit)
+    {
+      const auto & dat = l.getData();
+      size_t i = 0;
+
+      while (i < dat.size())
+      {
+        size_t j = cache.prepare(dat, i, sp);
+
+        if (j == i)
+        {
+          // the image for this command doesn't even fit into an empty atlas page, skip it
+          i++;
+          continue;
+        }
+
+        batch.quads.clear();
+        batch.images.clear();
+
+        for (size_t k = i; k < j; k++)
+        {
+          auto & ii = dat[k];
+
+          switch (ii.command)
+          {
+            case CommandData_c::CMD_GLYPH:
+              {
+                auto pos = cache.getGlyph(ii.font, ii.glyphIndex, sp, ii.blurr).value();
+                Color_c c = g.forward(ii.c);
+
+                float x = (sx+ii.x)/64.0+pos.left;
+                float y = (sy+ii.y+32)/64-pos.top;
+
+                if ((sp == SUBP_RGB || sp == SUBP_BGR) && (ii.blurr <= cache.blurrmax))
+                  addQuad(x, y, (pos.width-1)/3.0, pos.rows, pos, pos.pos_x, pos.pos_y, pos.width-1, pos.rows, c, 1);
+                else
+                  addQuad(x, y, pos.width, pos.rows, pos, pos.pos_x, pos.pos_y, pos.width, pos.rows, c, 0);
+              }
+              break;
+
+            case CommandData_c::CMD_RECT:
+              {
+                Color_c c = g.forward(ii.c);
+
+                if (ii.blurr == 0)
+                {
+                  // use the inner part of the filled rectangle, so that we don't get
+                  // anything of the soft borders
+                  auto pos = cache.getFilledRect().value();
+
+                  int x1 = (sx+ii.x+32)/64;
+                  int y1 = (sy+ii.y+32)/64;
+                  int x2 = (sx+ii.x+ii.w+32)/64;
+                  int y2 = (sy+ii.y+ii.h+32)/64;
+
+                  addQuad(x1, y1, x2-x1, y2-y1, pos, pos.pos_x+5, pos.pos_y+5, pos.width-11, pos.rows-11, c, 0);
+                }
+                else
+                {
+                  auto pos = cache.getRect(ii.w, ii.h, sp, ii.blurr).value();
+
+                  float x = (sx+ii.x+32)/64+pos.left;
+                  float y = (sy+ii.y+32)/64-pos.top;
+
+                  addQuad(x, y, pos.width, pos.rows, pos, pos.pos_x, pos.pos_y, pos.width, pos.rows, c, 0);
+                }
+              }
+              break;
+
+            case CommandData_c::CMD_IMAGE:
+              batch.images.push_back(DrawImage_c { ii.x+sx, ii.y+sy, ii.w, ii.h, ii.imageURL });
+              break;
+          }
+        }
+
+        batch.pages.resize(cache.pageCount());
+
+        for (uint32_t p = 0; p < cache.pageCount(); p++)
+        {
+          auto & page = cache.page(p);
+
+          batch.pages[p].atlas = page.getData();
+          batch.pages[p].width = page.width();
+          batch.pages[p].height = page.height();
+          batch.pages[p].resized = page.isResized();
+          batch.pages[p].dirty = page.getDirtyRegions();
+          batch.pages[p].id = cache.pageId(p);
+
+          page.resetDirty();
+        }
+
+        submit(static_cast<const DrawBatch_c &>(batch));
+
+        // all pages may now be reused for the remaining part of the layout
+        cache.nextBatch();
+
+        i = j;
+      }
+    }
+
+    /** \brief get a pointer to an atlas page with glyphs */
+    const uint8_t * getData(uint32_t page = 0) const { return cache.page(page).getData(); }
+
+    uint32_t cacheWidth(void) const { return cache.width(); }
+    uint32_t cacheHeight(void) const { return cache.height(); }
+
+    /** \brief get the number of atlas pages currently in use */
+    uint32_t cachePages(void) const { return cache.pageCount(); }
+
+    /** \brief update the gamma value used for output
+     *
+     * Default value for the class is 22, which is good for sRGB output, which
+     * should be your default for high quality output. See \ref gamma_sec for details.
+     *
+     * \param gamma the new gamma value in 1/10th units. Use 22 for sRGB and 10 for normal linear
+     */
+    void setGamma(uint8_t gamma = 22)
+    {
+      g.setGamma(gamma);
+    }
+
+    /** \brief clear the glyph atlas. All quads created before become invalid
+     */
+    void clear(void)
+    {
+      cache.clear();
+    }
+
+    /** \brief save the atlas into a file
+     *
+     * Load the file with loadAtlas at the next start of your program, so that the glyphs
+     * don't need to be rendered again
+     *
+     * \param filename the file to write
+     * \return true, when the file was written
+     */
+    bool saveAtlas(const std::string & filename) const
+    {
+      return cache.save(filename);
+    }
+
+    /** \brief replace the atlas with the content of a file written by saveAtlas
+     *
+     * All pages will be marked as resized in the next batch, so that you upload them completely. The
+     * file must not contain more pages than allowed for this object. All quads created before become invalid.
+     *
+     * \param filename the file to read
+     * \return true, when the file was loaded, when false is returned the atlas is unchanged
+     */
+    bool loadAtlas(const std::string & filename)
+    {
+      return cache.load(filename);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#ifndef STLL_LAYOUTER_GRAY
+#define STLL_LAYOUTER_GRAY
+
+/** \file
+ *  \brief output driver for grey and black and white targets, e.g. e-ink panels
+ */
+
+#include "layouterFont.h"
+#include "layouter.h"
+#include "color.h"
+
+#include "internal/glyphCache.h"
+#include "internal/blitter.h"
+#include "internal/gamma.h"
+
+#include <limits>
+#include <string>
+
+namespace STLL {
+
+/** \brief the pixel formats supported by showGray */
+enum GrayFormat
+{
+  GRAY_8,              ///< one byte per pixel, 0 is black, 255 is white
+  GRAY_1,              ///< one bit per pixel, the leftmost pixel in the most significant bit, 1 is white, 0 is black
+  GRAY_1_DITHER        ///< same as GRAY_1, but intermediate grey values are dithered with an ordered 4x4 pattern
+};
+
+/** \brief a class to output layouts into grey or black and white memory buffers
+ *
+ * This class draws into plain memory buffers with a single channel, like the frame buffers of e-ink panels
+ * or small monochrome displays. It doesn't depend on any graphics library. Colours of the layout are converted
+ * into their luminance and blended with one gamma corrected blending operation per pixel, so it
+ * is about 3 times as fast as drawing onto a colour surface.
+ *
+ * For one bit targets, the existing pixels are read as black or white and the blended result is
+ * converted back with either a fixed threshold or with ordered dithering. Dithering keeps the
+ * anti-aliased edges of the glyphs a bit visible, but is only useful for glyphs that are big enough.
+ *
+ * Sub-pixel output is not possible on grey targets, so there is no option for it.
+ *
+ * \tparam G the gamma calculation class to use... normally you don't need to change this, keep the default
+ */
+template <class G = internal::Gamma_c<>>
+class showGray
+{
+  private:
+    G g;
+    internal::GlyphCache_c cache;
+    int cx, cy, cw, ch;
+
+    // the luminance of the colour, for blending this is calculated with linear values, the
+    // unblended fill of rectangles needs the gamma corrected value
+    int luminance(Color_c c) const
+    {
+      Color_c l = g.forward(c);
+      return (54*l.r() + 183*l.g() + 19*l.b() + 128) / 256;
+    }
+
+    // the ordered dithering thresholds for 1 bit targets
+    static int threshold(int x, int y, GrayFormat f)
+    {
+      static const uint8_t bayer[4][4] = {
+        {  0,  8,  2, 10 },
+        { 12,  4, 14,  6 },
+        {  3, 11,  1,  9 },
+        { 15,  7, 13,  5 }
+      };
+
+      if (f == GRAY_1_DITHER)
+        return bayer[y & 3][x & 3]*16 + 8;
+      else
+        return 128;
+    }
+
+    // fill a rectangle with a value, the coordinates are in pixels
+    template <class P2>
+    void fillRect(int x, int y, int rw, int rh, int v, uint8_t * pixels, int pitch, int w, int h,
+                  const P2 & pxput)
+    {
+      int x0 = std::max(std::max(x, cx), 0);
+      int y0 = std::max(std::max(y, cy), 0);
+      int x1 = std::min(x+rw, w);
+      int y1 = std::min(y+rh, h);
+
+      if (cw < std::numeric_limits<int>::max()-cx) x1 = std::min(x1, cx+cw);
+      if (ch < std::numeric_limits<int>::max()-cy) y1 = std::min(y1, cy+ch);
+
+      for (int yp = y0; yp < y1; yp++)
+        for (int xp = x0; xp < x1; xp++)
+          pxput(pixels + yp*pitch, xp, yp, v);
+    }
+
+    // output the layout with the given pixel access functions, images are handed to the images function
+    template <class P1, class P2, class I>
+    void drawLayout(const TextLayout_c & l, int sx, int sy, uint8_t * pixels, int pitch, int w, int h,
+                    const P1 & pxget, const P2 & pxput, const I & images)
+    {
+      auto bl = [this](int a1, int a2, int b1, int b2, int c) -> auto { return internal::blend(a1, a2, b1, b2, c, g); };
+
+      for (auto & i : l.getData())
+      {
+        switch (i.command)
+        {
+          case CommandData_c::CMD_GLYPH:
+            outputGlyph_Gray(sx+i.x, sy+i.y, cache.getGlyph(i.font, i.glyphIndex, SUBP_NONE, i.blurr),
+                             luminance(i.c), i.c.a(), pixels, pitch, w, h, pxget, pxput, bl, cx, cy, cw, ch);
+            break;
+
+          case CommandData_c::CMD_RECT:
+            if (i.blurr == 0)
+            {
+              int x = (i.x+sx+32)/64;
+              int y = (i.y+sy+32)/64;
+              fillRect(x, y, (i.x+sx+(int)i.w+32)/64-x, (i.y+sy+(int)i.h+32)/64-y,
+                       g.inverse(luminance(i.c)*g.scale()), pixels, pitch, w, h, pxput);
+            }
+            else
+            {
+              outputGlyph_Gray(sx+i.x, sy+i.y, cache.getRect(i.w, i.h, SUBP_NONE, i.blurr),
+                               luminance(i.c), i.c.a(), pixels, pitch, w, h, pxget, pxput, bl, cx, cy, cw, ch);
+            }
+            break;
+
+          case CommandData_c::CMD_IMAGE:
+            images(i);
+            break;
+        }
+      }
+    }
+
+  public:
+
+    showGray(void) : cx(0), cy(0), cw(std::numeric_limits<int>::max()), ch(std::numeric_limits<int>::max())
+    {
+      g.setGamma(22);
+    }
+
+    /** \brief class used to encapsulate image drawing
+     *
+     * When the routine showLayout needs to draw an image it will call the draw function in this
+     * class to do the job.
+     *
+     * Derive from this function and implement the draw function to handle image drawing in your application
+     */
+    class ImageDrawer_c
+    {
+      public:
+        /** \brief function called to draw an image
+         *
+         * \param x x-position to draw the image in 1/64 pixels
+         * \param y y-position to draw the image in 1/64 pixels
+         * \param w width of the image to draw
+         * \param h height of the image to draw
+         * \param url the url of the image to draw
+         */
+        virtual void draw(int32_t x, int32_t y, uint32_t w, uint32_t h, const std::string & url) = 0;
+    };
+
+    /** \brief display a single layout in a memory buffer
+     *
+     *  \param l layout to draw
+     *  \param sx x position on the target in 1/64th pixels
+     *  \param sy y position on the target in 1/64th pixels
+     *  \param pixels pointer to the first row of the target
+     *  \param pitch number of bytes per row of pixels
+     *  \param w width of the target in pixels
+     *  \param h height of the target in pixels
+     *  \param format the pixel format of the target
+     *  \param images a pointer to an image drawer class that is used to draw the images, when you give
+     *                a nullptr here, no images will be drawn
+     */
+    void showLayout(const TextLayout_c & l, int sx, int sy, uint8_t * pixels, int pitch, int w, int h,
+                    GrayFormat format = GRAY_8, ImageDrawer_c * images = nullptr)
+    {
+      auto img = [images, sx, sy](const CommandData_c & i) -> void {
+        if (images) images->draw(i.x+sx, i.y+sy, i.w, i.h, i.imageURL);
+      };
+
+      if (format == GRAY_8)
+      {
+        drawLayout(l, sx, sy, pixels, pitch, w, h,
+          [](const uint8_t * r, int x, int /*y*/) -> int { return r[x]; },
+          [](uint8_t * r, int x, int /*y*/, int v) -> void { r[x] = v; },
+          img);
+      }
+      else
+      {
+        drawLayout(l, sx, sy, pixels, pitch, w, h,
+          [](const uint8_t * r, int x, int /*y*/) -> int { return (r[x >> 3] & (0x80 >> (x & 7))) ? 255 : 0; },
+          [format](uint8_t * r, int x, int y, int v) -> void {
+            if (v >= threshold(x, y, format))
+              r[x >> 3] |= 0x80 >> (x & 7);
+            else
+              r[x >> 3] &= ~(0x80 >> (x & 7));
+          },
+          img);
+      }
+    }
+
+    /** \brief update the gamma value used for output
+     *
+     * Default value for the class is 22, which is good for sRGB output. E-ink panels
+     * often have a different response, so you might want to try other values.
+     * See \ref gamma_sec for details.
+     *
+     * \param gamma the new gamma value in 1/10th units. Use 22 for sRGB and 10 for normal linear
+     */
+    void setGamma(uint8_t gamma = 22)
+    {
+      g.setGamma(gamma);
+    }
+
+    /** \brief set the clip rectangle
+     *
+     * Default for the clip rectangle is as big as possible, output is always
+     * clipped to the target size. Defaults for this function
+     * are set in such a way that calling it without arguments clears the
+     * clip rectangle
+     *
+     * \param x x-coordinate of upper left corner
+     * \param y y-coordinate of upper left corner
+     * \param w width of the clip rectangle
+     * \param h height of clip rectangle
+     */
+    void setClipRect(uint16_t x = 0, uint16_t y = 0, uint16_t w = std::numeric_limits<uint16_t>::max(), uint16_t h = std::numeric_limits<uint16_t>::max())
+    {
+      cx = x;
+      cy = y;
+      cw = w;
+      ch = h;
+    }
+
+    /** \brief trims the font cache down to a maximal number of entries
+     *
+     * See showSDL::trimCache
+     *
+     * \param num maximal number of entries, e.g. 0 completely empties the cache
+     */
+    void trimCache(size_t num)
+    {
+      cache.trim(num);
+    }
+
+    /** \brief enable or disable span encoding of cached glyphs
+     *
+     * See showSDL::setCacheCompression
+     *
+     * \param enable true to enable span encoding
+     */
+    void setCacheCompression(bool enable)
+    {
+      cache.setCompression(enable);
+    }
+
+    /** \brief render the glyphs with the internal rasterizer instead of FreeType
+     *
+     * See showSDL::setOutlineRendering
+     *
+     * \param enable true to use the internal rasterizer
+     */
+    void setOutlineRendering(bool enable)
+    {
+      cache.setOutlineRendering(enable);
+    }
+
+    /** \brief share the glyph cache with other processes
+     *
+     * See showSDL::useSharedCache
+     *
+     * \param name name of the segment, use an empty string to stop using the shared cache
+     * \param bytes size of the segment when it needs to be created
+     * \return true, when the segment could be used
+     */
+    bool useSharedCache(const std::string & name, size_t bytes = 16*1024*1024)
+    {
+      if (name.empty())
+      {
+        cache.setShared(nullptr);
+        return true;
+      }
+
+      auto s = internal::SharedGlyphCache_c::open(name, bytes);
+      if (s) cache.setShared(s);
+      return s != nullptr;
+    }
+
+    /** \brief remove a shared glyph cache segment
+     *
+     * See showSDL::removeSharedCache
+     *
+     * \param name name of the segment as given to useSharedCache
+     * \return true, when the segment was removed
+     */
+    static bool removeSharedCache(const std::string & name)
+    {
+      return internal::SharedGlyphCache_c::remove(name);
+    }
+};
+
+}
+
+#endif
@@ -33,6 +33,13 @@
 #include "internal/gamma.h"
 #include "internal/openGL_internal.h"
 
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <limits>
+#include <mutex>
+#include <cassert>
+
 namespace STLL {
 
 /** \brief a class to output layouts using OpenGL
@@ -40,10 +47,12 @@ namespace STLL {
  * To output layouts using this class, create an object of it and then
  * use the showLayout Function to output the layout.
  *
- * The class contains a glyph cache in form of an texture atlas. Once this
- * atlas if full, things available will be output and then the atlas will be cleared
- * and repopulated for the next section of the output. This will slow down output
- * considerably, so choose the size wisely. The atlas will be destroyed once the
+ * The class contains a glyph cache in form of texture atlas pages. The first page
+ * grows until it reaches the maximal size, then more pages of that size are added. Once
+ * all pages are full, the page that was not used for the longest time is cleared
+ * and reused. When a single layout requires more than all pages together, the things available
+ * will be output and the remaining part of the layout will be drawn with the next batch. This will
+ * slow down output considerably, so choose the size wisely. The atlas will be destroyed once the
  * class is destroyed. Things to consider:
  * - using sub pixel placement triples the space requirements for the glyphs
  * - blurring adds quite some amount of space around the glyphs, but as soon as you blurr the
@@ -67,13 +76,62 @@ template <int V, class G = internal::Gamma_c<>>
 class showOpenGL : internal::openGL_internals<V>
 {
   private:
-    internal::GlyphAtlas_c cache;
+    internal::PagedGlyphAtlas_c cache;
     G g;
+    internal::VertexPreparation_c<V, G> vertices;
+
+    std::vector<GLuint> textures; // OpenGL texture ids, one for each atlas page
+
+    // protects the atlas, as layouts may be prepared on other threads
+    mutable std::mutex mutex;
+
+    // the layouts collected for the current frame
+    std::unique_ptr<typename internal::openGL_internals<V>::CreateInternal_c> frame;
+    SubPixelArrangement frameSp;
+    uint32_t framePage;
+    size_t frameCommands = 0;  // commands added to the frame, used to reserve the buffer for the next frame
+    size_t batchCommands = 0;  // commands added since the last flush
+    uint32_t frameWidth = 0;   // atlas size used for the texture coordinates of the frame
+
+    // clip rectangle for layouts added to frames
+    uint16_t cx = 0, cy = 0, cw = std::numeric_limits<uint16_t>::max(), ch = std::numeric_limits<uint16_t>::max();
+
+    // upload the changed parts of all atlas pages to the graphics memory, when the
+    // size of a page has changed, the whole texture needs to be replaced
+    void uploadPages(void)
+    {
+      for (uint32_t p = 0; p < cache.pageCount(); p++)
+      {
+        auto & page = cache.page(p);
+
+        if (p >= textures.size())
+        {
+          GLuint t;
+          glGenTextures(1, &t);
+          glBindTexture(GL_TEXTURE_2D, t);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+          glTexEnvi(GL_TEXTURE_2D, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+          textures.push_back(t);
+        }
+
+        if (page.isResized())
+        {
+          glBindTexture(GL_TEXTURE_2D, textures[p]);
+          internal::openGL_internals<V>::updateTexture(page.getData(), page.width());
+        }
+        else if (!page.getDirtyRegions().empty())
+        {
+          glBindTexture(GL_TEXTURE_2D, textures[p]);
+          for (auto & r : page.getDirtyRegions())
+            internal::openGL_internals<V>::updateTextureRegion(page.getData(), page.width(), r);
+        }
 
-    GLuint glTextureId = 0;     // OpenGL texture id
-    uint32_t uploadVersion = 0; // a counter changed each time the texture changes to know when to update
-    uint32_t atlasId = 1;
-    uint32_t cacheMax;
+        page.resetDirty();
+      }
+    }
 
   public:
 
@@ -81,7 +139,17 @@ class showOpenGL : internal::openGL_internals<V>
      * dont't need to know anything about its internals, just git a pointer to an object of
      * this class to the show function for extra speedup.
      */
-    using DrawCache_c = typename internal::openGL_internals<V>::DrawCacheInternal_c;
+    class DrawCache_c
+    {
+      private:
+        friend class showOpenGL;
+
+        typename internal::openGL_internals<V>::DrawCacheInternal_c dc;
+
+        // the atlas pages used by the cache together with the id of their content, the
+        // cache stays valid as long as none of these pages have been cleared
+        std::vector<std::pair<uint32_t, uint32_t>> pages;
+    };
 
     /** \brief constructor
      *
@@ -90,17 +158,16 @@ class showOpenGL : internal::openGL_internals<V>
      * \param cMax once the cache is full its dimensions will be doubled, quadrupling the area until
      *             it has reached at least this value (it may get bigger, depending on what values you
      *             get by doubling cStart again and again
+     * \param pages the maximal number of atlas pages of the final size, when all pages are
+     *              full, the least recently used page is cleared and reused
+     * \param fieldSize when not 0 glyphs are stored as signed distance fields rendered at this size
+     *              in pixels and scaled when drawing, so that all sizes of a font share the same images,
+     *              see \ref opengl_sec. This is only supported for OpenGL 3 and ignored otherwise
      */
-    showOpenGL(uint32_t cStart = 256, uint32_t cMax = 1024) : cache(cStart, cStart), cacheMax(cMax)
+    showOpenGL(uint32_t cStart = 256, uint32_t cMax = 1024, uint32_t pages = 4, uint32_t fieldSize = 0) :
+      cache(cStart, cMax, pages, V == 3 ? fieldSize : 0), vertices(cache, g)
     {
       glActiveTexture(GL_TEXTURE0);
-      glGenTextures(1, &glTextureId);
-      glBindTexture(GL_TEXTURE_2D, glTextureId);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexEnvi(GL_TEXTURE_2D, GL_TEXTURE_ENV_MODE, GL_REPLACE);
       g.setGamma(22);
 
       internal::openGL_internals<V>::setup();
@@ -108,7 +175,7 @@ class showOpenGL : internal::openGL_internals<V>
 
     ~showOpenGL(void)
     {
-      glDeleteTextures(1, &glTextureId);
+      glDeleteTextures(textures.size(), textures.data());
       internal::openGL_internals<V>::cleanup();
     }
 
@@ -119,6 +186,95 @@ class showOpenGL : internal::openGL_internals<V>
         virtual void draw(int32_t x, int32_t y, uint32_t w, uint32_t h, const std::string & url) = 0;
     };
 
+    /** \brief a layout that has been prepared for drawing with prepareLayout
+     *
+     * The class keeps the atlas images of the layout from being removed, until it is
+     * drawn with submitLayout or destroyed, so don't keep too many of them around. The output object
+     * that prepared the layout must exist as long as the prepared layout exists.
+     */
+    class PreparedLayout_c
+    {
+      private:
+        friend class showOpenGL;
+
+        showOpenGL * owner = nullptr;
+
+        std::unique_ptr<typename internal::openGL_internals<V>::CreateInternal_c> vb;
+        SubPixelArrangement sp;
+        uint32_t scale;                         // atlas size the texture coordinates were calculated for
+        std::vector<CommandData_c> images;      // the image commands of the layout
+        const TextLayout_c * layout = nullptr;  // the layout for immediate drawing with OpenGL 1
+
+        // the pinned atlas pages together with the id of their content
+        std::vector<std::pair<uint32_t, uint32_t>> pages;
+
+      public:
+        PreparedLayout_c(void) {}
+        PreparedLayout_c(const PreparedLayout_c &) = delete;
+        void operator=(const PreparedLayout_c &) = delete;
+
+        ~PreparedLayout_c(void)
+        {
+          if (owner) owner->release(*this);
+        }
+    };
+
+  private:
+
+    // unpin the pages of a prepared layout and remove its content
+    void release(PreparedLayout_c & p)
+    {
+      if (!p.owner) return;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto & pg : p.pages)
+          cache.unpin(pg.first, pg.second);
+      }
+
+      p.pages.clear();
+      p.vb.reset();
+      p.images.clear();
+      p.layout = nullptr;
+      p.owner = nullptr;
+    }
+
+    // the image output for the vertex preparation, draws the images with the given drawer
+    static auto drawImages(imageDrawer_c * images, int sx, int sy)
+    {
+      return [images, sx, sy](const CommandData_c & ii) {
+        if (images)
+          images->draw(ii.x+sx, ii.y+sy, ii.w, ii.h, ii.imageURL);
+      };
+    }
+
+    // draw all the layouts collected for the frame up to now
+    void drawFrame(void)
+    {
+      if (!internal::openGL_internals<V>::immediate && batchCommands > 0)
+      {
+        glActiveTexture(GL_TEXTURE0);
+        glEnable(GL_BLEND);
+        internal::openGL_internals<V>::startPreparation(0, 0);
+        internal::openGL_internals<V>::endPreparation(*frame, frameSp, 0, 0, frameWidth);
+      }
+
+      auto clip = frame->clip;
+      frame = std::make_unique<typename internal::openGL_internals<V>::CreateInternal_c>(frameCommands);
+      frame->clip = clip;
+      framePage = UINT32_MAX;
+      batchCommands = 0;
+    }
+
+    // draw the frame up to now and start a new batch so that atlas pages can be reused
+    void flushFrame(void)
+    {
+      drawFrame();
+      cache.nextBatch();
+    }
+
+  public:
 
     /** \brief paint the layout
      *
@@ -137,165 +293,324 @@ class showOpenGL : internal::openGL_internals<V>
     void showLayout(const TextLayout_c & l, int sx, int sy, SubPixelArrangement sp,
                     imageDrawer_c * images = nullptr, DrawCache_c * dc = nullptr)
     {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      // the frame needs to be drawn first, as we are going to start new batches
+      if (frame) flushFrame();
+
       glActiveTexture(GL_TEXTURE0);
-      glBindTexture( GL_TEXTURE_2D, glTextureId );
       glEnable(GL_BLEND);
 
-      if (dc && dc->atlasId == atlasId)
+      if (dc && !dc->pages.empty() &&
+          std::all_of(dc->pages.begin(), dc->pages.end(), [this](const std::pair<uint32_t, uint32_t> & p) {
+            return cache.pageId(p.first) == p.second; }))
       {
-        internal::openGL_internals<V>::drawCache(*dc, sp, sx, sy, cache.width());
+        for (auto & p : dc->pages)
+          cache.touch(p.first);
+
+        cache.nextBatch();
+
+        internal::openGL_internals<V>::drawCache(dc->dc, sp, sx, sy, cache.width());
         return;
       }
 
       const auto & dat = l.getData();
       size_t i = 0;
-      bool cleared = false;
 
       while (i < dat.size())
       {
-        size_t j = i;
-
-        // make sure that there is a small completely filled rectangle
-        // used for drawing filled rectangles
-        cache.getRect(640, 640, SUBP_NONE, 0);
-
-        while (j < dat.size())
-        {
-          auto & ii = dat[j];
+        size_t j = cache.prepare(dat, i, sp);
 
-          bool found = true;
-
-          switch (ii.command)
-          {
-            case CommandData_c::CMD_GLYPH:
-              // when subpixel placement is on we always create all 3 required images
-              found &= (bool)cache.getGlyph(ii.font, ii.glyphIndex, sp, ii.blurr);
-              break;
-            case CommandData_c::CMD_RECT:
-              if (ii.blurr > 0)
-                found &= (bool)cache.getRect(ii.w, ii.h, sp, ii.blurr);
-              break;
-
-            default:
-              break;
-          }
-
-          if (!found)
-          {
-            // glyph not found means there was no space to include it inside
-            // the current cache, so try to double its size, if the cache
-            // is already at least cacheMax size, we'll have to split the layout
-            if (cache.width() < cacheMax)
-            {
-              cache.doubleSize();
-            }
-            else
-            {
-              break;
-            }
-          }
-          else
-          {
-            j++;
-          }
-        }
-
-        // check, if the texture cache has been changed to include
-        // glyphs from this layout, if so re-upload it to the graphics memory
-        if (cache.getVersion() != uploadVersion)
+        if (j == i)
         {
-          uploadVersion = cache.getVersion();
-          internal::openGL_internals<V>::updateTexture(cache.getData(), cache.width());
+          // the image for this command doesn't even fit into an empty atlas page, skip it
+          i++;
+          continue;
         }
 
-        typename internal::openGL_internals<V>::CreateInternal_c vb(dat.size());
+        uploadPages();
 
-        size_t k = i;
+        typename internal::openGL_internals<V>::CreateInternal_c vb(j-i);
 
         // check if the user wants caching and if we are able to provide it
         // we can only use caching, if all the layout completely fits into
         // one drawing batch
-        if (dc && !cleared && j == dat.size())
+        bool caching = dc && i == 0 && j == dat.size();
+
+        if (caching)
         {
-          internal::openGL_internals<V>::startCachePreparation(*dc);
+          internal::openGL_internals<V>::startCachePreparation(dc->dc);
+          dc->pages.clear();
         }
         else
         {
           internal::openGL_internals<V>::startPreparation(sx, sy);
         }
 
-        while (k < j)
-        {
-          auto & ii = dat[k];
+        uint32_t page = UINT32_MAX;
 
-          switch (ii.command)
-          {
-            case CommandData_c::CMD_GLYPH:
-              {
-                auto pos = cache.getGlyph(ii.font, ii.glyphIndex, sp, ii.blurr).value();
-                Color_c c = g.forward(ii.c);
-
-                if ((sp == SUBP_RGB || sp == SUBP_BGR) && (ii.blurr <= cache.blurrmax))
-                {
-                  internal::openGL_internals<V>::drawSubpGlyph(vb, sp, ii, pos, c, cache.width());
-                }
-                else
-                {
-                  internal::openGL_internals<V>::drawNormalGlyph(vb, ii, pos, c, cache.width());
-                }
-              }
-              break;
-
-            case CommandData_c::CMD_RECT:
-              {
-                Color_c c = g.forward(ii.c);
-
-                if (ii.blurr == 0)
-                {
-                  auto pos = cache.getRect(640, 640, SUBP_NONE, 0).value();
-                  internal::openGL_internals<V>::drawRectangle(vb, ii, pos, c, cache.width());
-                }
-                else
-                {
-                  auto pos = cache.getRect(ii.w, ii.h, sp, ii.blurr).value();
-                  internal::openGL_internals<V>::drawSmoothRectangle(vb, ii, pos, c, cache.width());
-                }
-              }
-              break;
-
-            case CommandData_c::CMD_IMAGE:
-              if (images)
-                images->draw(ii.x+sx, ii.y+sy, ii.w, ii.h, ii.imageURL);
-              break;
-          }
-          k++;
-        }
+        vertices.addCommands(vb, dat, i, j, sp, page, &textures, caching ? &dc->pages : nullptr, drawImages(images, sx, sy));
 
         // depending on the drawing options finish the drawing either
-        // by finishing the cache, drawing and leaving the function
-        // or by just completing the drawing batch without cache
-        if (dc && !cleared && j == dat.size())
+        // by finishing the cache and drawing it or by just completing
+        // the drawing batch without cache
+        if (caching)
         {
-          internal::openGL_internals<V>::endCachePreparation(*dc, vb, sp, sx, sy, atlasId, cache.width());
+          internal::openGL_internals<V>::endCachePreparation(dc->dc, vb, sp, sx, sy, cache.width());
         }
         else
         {
           internal::openGL_internals<V>::endPreparation(vb, sp, sx, sy, cache.width());
+        }
+
+        // all pages may now be reused for the remaining part of the layout
+        cache.nextBatch();
+
+        i = j;
+      }
+    }
+
+    /** \brief prepare a layout for drawing
+     *
+     * This function does the CPU work of showLayout: it puts all the required images into the
+     * atlas and creates the vertex data. It doesn't call any OpenGL functions, so it can run on any
+     * thread, e.g. a worker thread, while the thread with the OpenGL context continues to draw. Draw the
+     * result with submitLayout.
+     *
+     * The fonts of the layout must not be used by other threads while this function runs, as FreeType
+     * doesn't allow that. OpenGL 1 draws immediately, so only the atlas work is done here and the
+     * layout must still exist when it is submitted.
+     *
+     * \param l the layout to prepare
+     * \param sp which kind of sub-pixel positioning do you want?
+     * \param p the object that receives the prepared data, old content is released
+     * \return true, when the layout was prepared, false when its images don't fit into the free
+     *         part of the atlas, use showLayout for such layouts
+     */
+    bool prepareLayout(const TextLayout_c & l, SubPixelArrangement sp, PreparedLayout_c & p)
+    {
+      if (p.owner) p.owner->release(p);
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      const auto & dat = l.getData();
+      std::vector<uint32_t> used;
+
+      if (cache.prepare(dat, 0, sp, &used) < dat.size()) return false;
 
-          if (j < dat.size())
+      p.owner = this;
+      p.sp = sp;
+      p.scale = cache.width();
+
+      for (auto u : used)
+      {
+        cache.pin(u);
+        p.pages.push_back(std::make_pair(u, cache.pageId(u)));
+      }
+
+      if (internal::openGL_internals<V>::immediate)
+      {
+        p.layout = &l;
+      }
+      else
+      {
+        p.vb = std::make_unique<typename internal::openGL_internals<V>::CreateInternal_c>(dat.size());
+
+        uint32_t page = UINT32_MAX;
+        vertices.addCommands(*p.vb, dat, 0, dat.size(), sp, page, nullptr, nullptr,
+                             [&p](const CommandData_c & ii) { p.images.push_back(ii); });
+      }
+
+      return true;
+    }
+
+    /** \brief draw a layout that was prepared with prepareLayout
+     *
+     * This function must be called on the thread with the OpenGL context. It uploads
+     * the changed parts of the atlas and draws the prepared data. Afterwards the prepared
+     * layout is empty.
+     *
+     * \param p the prepared layout
+     * \param sx x position on the target surface in 1/64th pixels
+     * \param sy y position on the target surface in 1/64th pixels
+     * \param images a pointer to an image drawer class that is used to draw the images, when you give
+     *                a nullptr here, no images will be drawn
+     * \return true, when the layout was drawn, false when it was not prepared by this object or
+     *         when the atlas has been cleared or loaded in the meantime, prepare it again then
+     */
+    bool submitLayout(PreparedLayout_c & p, int sx, int sy, imageDrawer_c * images = nullptr)
+    {
+      if (p.owner != this) return false;
+
+      bool valid;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        valid = std::all_of(p.pages.begin(), p.pages.end(), [this](const std::pair<uint32_t, uint32_t> & pg) {
+          return pg.first < cache.pageCount() && cache.pageId(pg.first) == pg.second; });
+
+        if (valid)
+        {
+          // the frame needs to be drawn first, as we are going to start a new batch
+          if (frame) flushFrame();
+
+          glActiveTexture(GL_TEXTURE0);
+          glEnable(GL_BLEND);
+
+          uploadPages();
+
+          for (auto & pg : p.pages)
+            cache.touch(pg.first);
+
+          if (internal::openGL_internals<V>::immediate)
+          {
+            const auto & dat = p.layout->getData();
+            typename internal::openGL_internals<V>::CreateInternal_c vb(dat.size());
+            uint32_t page = UINT32_MAX;
+
+            internal::openGL_internals<V>::startPreparation(sx, sy);
+            vertices.addCommands(vb, dat, 0, dat.size(), p.sp, page, &textures, nullptr, drawImages(images, sx, sy));
+            internal::openGL_internals<V>::endPreparation(vb, p.sp, sx, sy, cache.width());
+          }
+          else
           {
-            // atlas is not big enough, it needs to be cleared
-            // and will be repopulated for the next batch of the layout
-            cache.clear();
-            atlasId++;
-            cleared = true;
+            if (images)
+              for (auto & i : p.images)
+                images->draw(i.x+sx, i.y+sy, i.w, i.h, i.imageURL);
+
+            internal::openGL_internals<V>::drawPrepared(*p.vb, p.sp, sx, sy, cache.width(), p.scale, textures);
           }
+
+          cache.nextBatch();
         }
+      }
+
+      release(p);
+
+      return valid;
+    }
+
+    /** \brief start collecting layouts for one frame
+     *
+     * All layouts added with addLayout until endFrame is called are collected into one buffer
+     * and drawn together with one draw call per atlas page (OpenGL 2 and 3). This is much faster
+     * than calling showLayout for each of many small layouts. OpenGL 1 draws the layouts immediately.
+     *
+     * Only when the atlas can not hold all glyphs of the frame, the part collected up to
+     * then is drawn before continuing. Don't change the OpenGL state used for drawing (e.g. the
+     * projection) during the frame. The clip rectangle is reset.
+     *
+     * \param sp which kind of sub-pixel positioning do you want for all layouts of the frame?
+     */
+    void beginFrame(SubPixelArrangement sp)
+    {
+      frame = std::make_unique<typename internal::openGL_internals<V>::CreateInternal_c>(frameCommands);
+      frameSp = sp;
+      framePage = UINT32_MAX;
+      frameCommands = 0;
+      batchCommands = 0;
+
+      setClipRect();
+    }
 
+    /** \brief add a layout to the current frame
+     *
+     * The layout is drawn when the frame is finished, it is clipped by the current clip rectangle.
+     * Images are drawn right away, so they end up below the text of the frame and they are not
+     * clipped.
+     *
+     * \param l the layout to draw
+     * \param sx x position on the target surface in 1/64th pixels
+     * \param sy y position on the target surface in 1/64th pixels
+     * \param images a pointer to an image drawer class that is used to draw the images, when you give
+     *                a nullptr here, no images will be drawn
+     *
+     * \note only call this between beginFrame and endFrame, outside of a frame nothing is drawn
+     */
+    void addLayout(const TextLayout_c & l, int sx, int sy, imageDrawer_c * images = nullptr)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      assert(frame);
+      if (!frame) return;
+
+      const auto & dat = l.getData();
+      size_t i = 0;
+
+      internal::VertexPreparation_c<V, G>::setClip(*frame, sx, sy, cx, cy, cw, ch);
+
+      while (i < dat.size())
+      {
+        size_t j = cache.prepare(dat, i, frameSp);
+
+        if (j == i)
+        {
+          // when the frame contains something, draw that and retry with the
+          // pages available again, otherwise the image doesn't even fit into an
+          // empty atlas page, skip it
+          if (batchCommands > 0)
+            flushFrame();
+          else
+            i++;
+
+          continue;
+        }
+
+        // when the atlas has grown the texture coordinates collected up to now are
+        // wrong, so draw them while the textures still have the old size
+        if (batchCommands > 0 && cache.width() != frameWidth)
+          drawFrame();
+
+        frameWidth = cache.width();
+
+        uploadPages();
+
+        if (internal::openGL_internals<V>::immediate)
+        {
+          glActiveTexture(GL_TEXTURE0);
+          glEnable(GL_BLEND);
+          internal::openGL_internals<V>::startPreparation(0, 0);
+          framePage = UINT32_MAX;
+        }
+
+        vertices.addCommands(*frame, dat, i, j, frameSp, framePage, &textures, nullptr, drawImages(images, sx, sy));
+
+        if (internal::openGL_internals<V>::immediate)
+          internal::openGL_internals<V>::endPreparation(*frame, frameSp, 0, 0, cache.width());
+
+        frameCommands += j-i;
+        batchCommands += j-i;
         i = j;
       }
+    }
 
-      return;
+    /** \brief set the clip rectangle for the layouts added to the frame
+     *
+     * Default for the clip rectangle is as big as possible. Defaults for this function
+     * are set in such a way that calling it without arguments clears the
+     * clip rectangle
+     *
+     * \param x x-coordinate of upper left corner in pixels
+     * \param y y-coordinate of upper left corner in pixels
+     * \param w width of the clip rectangle
+     * \param h height of clip rectangle
+     */
+    void setClipRect(uint16_t x = 0, uint16_t y = 0, uint16_t w = std::numeric_limits<uint16_t>::max(), uint16_t h = std::numeric_limits<uint16_t>::max())
+    {
+      cx = x;
+      cy = y;
+      cw = w;
+      ch = h;
+    }
+
+    /** \brief draw all layouts of the frame */
+    void endFrame(void)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      flushFrame();
+      frame.reset();
     }
 
     /** \brief helper function to setup the projection matrices for
@@ -310,12 +625,17 @@ class showOpenGL : internal::openGL_internals<V>
     /** \brief get a pointer to the texture atlas with all the glyphs
      *
      * This is mainly helpful to check how full the texture atlas is
+     *
+     * \param page the atlas page to get
      */
-    const uint8_t * getData(void) const { return cache.getData(); }
+    const uint8_t * getData(uint32_t page = 0) const { return cache.page(page).getData(); }
 
     uint32_t cacheWidth(void) const { return cache.width(); }
     uint32_t cacheHeight(void) const { return cache.height(); }
 
+    /** \brief get the number of atlas pages currently in use */
+    uint32_t cachePages(void) const { return cache.pageCount(); }
+
     /** \brief update the gamma value used for output
      *
      * Default value for the class is 22, which is good for sRGB output, which
@@ -334,11 +654,48 @@ class showOpenGL : internal::openGL_internals<V>
      */
     void clear(void)
     {
+      std::lock_guard<std::mutex> lock(mutex);
+
       cache.clear();
-      atlasId++;
     }
-};
 
+    /** \brief save the glyph atlas into a file
+     *
+     * Load the file with loadAtlas at the next start of your program, so that the glyphs
+     * don't need to be rendered again, see \ref opengl_sec
+     *
+     * \param filename the file to write
+     * \return true, when the file was written
+     */
+    bool saveAtlas(const std::string & filename) const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      return cache.save(filename);
+    }
+
+    /** \brief replace the glyph atlas with the content of a file written by saveAtlas
+     *
+     * The atlas is uploaded to the graphics card right away. The file must have been written with
+     * the same distance field size and it must not contain more pages than allowed for this object.
+     * All drawing caches become invalid.
+     *
+     * \param filename the file to read
+     * \return true, when the file was loaded, when false is returned the atlas is unchanged
+     */
+    bool loadAtlas(const std::string & filename)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      // the collected part of the frame uses the old atlas
+      if (frame) flushFrame();
+
+      if (!cache.load(filename)) return false;
+
+      uploadPages();
+      return true;
+    }
+};
 }
 
 #endif
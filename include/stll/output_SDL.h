@@ -31,6 +31,7 @@
 #include "color.h"
 
 #include "internal/glyphCache.h"
+#include "internal/spriteCache.h"
 #include "internal/blitter.h"
 #include "internal/gamma.h"
 
@@ -50,7 +51,9 @@ class showSDL
 {
   private:
     G g;
+    uint8_t gamma;
     internal::GlyphCache_c cache;
+    internal::SpriteCache_c sprites;
     int cx, cy, cw, ch;
 
     // a simple get pixel function for the fallback render methods
@@ -201,11 +204,35 @@ class showSDL
       }
     }
 
+    void outputSprite(int sx, int sy, const internal::LayoutSprite_c & sprite, SDL_Surface * s)
+    {
+      // the sprite is always in rgb order, so we don't need to care about the sub pixel
+      // arrangement here only about the surface format
+      switch (getSurfaceFormat(s))
+      {
+        default:
+        case 0:
+          internal::outputSprite(
+            sx, sy, sprite, (uint8_t*)s->pixels, s->pitch, s->format->BytesPerPixel, s->w, s->h,
+            [s, this](const uint8_t * p) -> auto { return getpixel(p, s->format); },
+            [s, this](uint8_t * p, uint8_t r, uint8_t g, uint8_t b) -> void { putpixel(p, r, g, b, s->format); },
+            g, cx, cy, cw, ch);
+          break;
+        case 1:
+          internal::outputSprite(
+            sx, sy, sprite, (uint8_t*)s->pixels, s->pitch, s->format->BytesPerPixel, s->w, s->h,
+            [](const uint8_t * p) -> auto { return std::make_tuple(p[2], p[1], p[0]); },
+            [](uint8_t * p, uint8_t r, uint8_t g, uint8_t b) -> void { p[2] = r; p[1] = g; p[0] = b; },
+            g, cx, cy, cw, ch);
+          break;
+      }
+    }
+
   public:
 
-    showSDL(void) : cx(0), cy(0), cw(std::numeric_limits<int>::max()), ch(std::numeric_limits<int>::max())
+    showSDL(void) : gamma(22), cx(0), cy(0), cw(std::numeric_limits<int>::max()), ch(std::numeric_limits<int>::max())
     {
-      g.setGamma(22);
+      g.setGamma(gamma);
     }
 
     /** \brief class used to encapsulate image drawing
@@ -282,6 +309,74 @@ class showSDL
       }
     }
 
+    /** \brief display a single layout using the sprite cache
+     *
+     * This function does the same as showLayout, but the complete layout is rendered into
+     * an intermediate image (a sprite) first. This sprite is kept in a cache and when the same
+     * layout is shown again at the same sub pixel position only the sprite needs to be blended
+     * onto the surface. This is a lot faster for layouts that are drawn unchanged in every
+     * frame, e.g. labels or HUD text.
+     *
+     * The cache is keyed by the content of the layout, so you don't need to keep the layout
+     * object itself around, an identical layout will be found. The sub pixel position (sx and
+     * sy modulo 64) is part of the key, so when you move a layout around with sub pixel
+     * precision there will be many sprites for it, move it in whole pixels to avoid that.
+     *
+     * When the cache is disabled (see setSpriteCacheSize), when the layout contains images or
+     * when the sprite would be bigger than the whole cache the layout is drawn directly
+     * using showLayout.
+     *
+     * \param l layout to draw
+     * \param sx x position on the target surface in 1/64th pixels
+     * \param sy y position on the target surface in 1/64th pixels
+     * \param s target surface
+     * \param sp which kind of sub-pixel positioning do you want?
+     * \param images image drawer, only used when the layout is drawn directly, see showLayout
+     */
+    void showLayoutCached(const TextLayout_c & l, int sx, int sy, SDL_Surface * s,
+                          SubPixelArrangement sp = SUBP_NONE, ImageDrawer_c * images = 0)
+    {
+      if (sprites.getBudget() == 0)
+      {
+        showLayout(l, sx, sy, s, sp, images);
+        return;
+      }
+
+      auto k = sprites.key(l, sx, sy, sp);
+
+      if (!k)
+      {
+        showLayout(l, sx, sy, s, sp, images);
+        return;
+      }
+
+      auto spr = sprites.find(*k, l);
+
+      if (!spr)
+        spr = sprites.insert(*k, l, internal::createSprite(l, k->fx, k->fy, sp, cache, g, sprites.getBudget()));
+
+      if (!spr)
+      {
+        showLayout(l, sx, sy, s, sp, images);
+        return;
+      }
+
+      outputSprite(internal::div_inf(sx, 64)+spr->left, internal::div_inf(sy, 64)+spr->top, *spr, s);
+    }
+
+    /** \brief set the maximal memory used for the sprite cache
+     *
+     * The sprite cache used by showLayoutCached is disabled by default. Set a size
+     * here to enable it. When the cache gets full the sprites that were not used for
+     * the longest time are removed. Each pixel of a sprite takes 12 bytes.
+     *
+     * \param bytes maximal number of bytes to use for all sprites, 0 disables the cache
+     */
+    void setSpriteCacheSize(size_t bytes)
+    {
+      sprites.setBudget(bytes);
+    }
+
     /** \brief update the gamma value used for output
      *
      * Default value for the class is 22, which is good for sRGB output, which
@@ -291,6 +386,13 @@ class showSDL
      */
     void setGamma(uint8_t gamma = 22)
     {
+      // the sprites contain gamma corrected values, they need to be recreated
+      if (gamma != this->gamma)
+      {
+        sprites.clear();
+        this->gamma = gamma;
+      }
+
       g.setGamma(gamma);
     }
 
@@ -327,6 +429,84 @@ class showSDL
     {
       cache.trim(num);
     }
+
+    /** \brief enable or disable span encoding of cached glyphs
+     *
+     * Big glyph images (big fonts, blurred shadows) consist mostly of empty and fully
+     * covered areas. When span encoding is enabled (the default) those images are stored as runs
+     * of empty, full and partially covered pixels, when that saves memory. Outputting those glyphs
+     * is also faster, because empty runs are skipped and full runs are simply filled.
+     *
+     * The setting only affects glyphs that are rendered after the call.
+     *
+     * \param enable true to enable span encoding
+     */
+    void setCacheCompression(bool enable)
+    {
+      cache.setCompression(enable);
+    }
+
+    /** \brief render the glyphs with the internal rasterizer instead of FreeType
+     *
+     * The internal rasterizer keeps the outlines of the glyphs of each font file and renders them
+     * at any size from there. This is faster than FreeType, especially when the glyphs are needed in many different
+     * sizes, e.g. when you animate the zoom of your text. The glyphs are not hinted, so they look a bit softer
+     * than the ones rendered by FreeType.
+     *
+     * Changing this setting empties the glyph cache.
+     *
+     * \param enable true to use the internal rasterizer
+     */
+    void setOutlineRendering(bool enable)
+    {
+      cache.setOutlineRendering(enable);
+    }
+
+    /** \brief share the glyph cache with other processes
+     *
+     * When you run several processes that draw with the same fonts, each of them renders the same glyphs
+     * and keeps its own copy of them. With this function the rendered glyphs are placed into a POSIX
+     * shared memory segment, so that each glyph is rendered only once and all processes use the same
+     * copy. The segment is created by the first process that uses the name and all others
+     * use the existing segment. The fonts are identified by their content, so each process may load them
+     * from a different place.
+     *
+     * Glyphs are never removed from the segment. Once it is full, new glyphs are kept in the memory of the
+     * process just like without a shared cache. The segment stays until you remove it with
+     * removeSharedCache, even when all processes have exited.
+     *
+     * Calling this function empties the cache of this object.
+     *
+     * \param name name of the segment, it should start with a slash, e.g. "/myprogram-glyphs", use an empty
+     *             string to stop using the shared cache
+     * \param bytes size of the segment when it needs to be created
+     * \return true, when the segment could be used
+     */
+    bool useSharedCache(const std::string & name, size_t bytes = 16*1024*1024)
+    {
+      if (name.empty())
+      {
+        cache.setShared(nullptr);
+        return true;
+      }
+
+      auto s = internal::SharedGlyphCache_c::open(name, bytes);
+      if (s) cache.setShared(s);
+      return s != nullptr;
+    }
+
+    /** \brief remove a shared glyph cache segment
+     *
+     * Processes that currently use the segment can continue to do so, but new processes will create a new
+     * segment.
+     *
+     * \param name name of the segment as given to useSharedCache
+     * \return true, when the segment was removed
+     */
+    static bool removeSharedCache(const std::string & name)
+    {
+      return internal::SharedGlyphCache_c::remove(name);
+    }
 };
 
 }
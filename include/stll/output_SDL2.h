@@ -0,0 +1,525 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#ifndef STLL_LAYOUTER_SDL2
+#define STLL_LAYOUTER_SDL2
+
+/** \file
+ *  \brief SDL2 output driver
+ */
+
+#include "layouterFont.h"
+#include "layouter.h"
+#include "color.h"
+
+#include "internal/glyphCache.h"
+#include "internal/blitter.h"
+#include "internal/gamma.h"
+
+#include <SDL.h>
+
+#include <vector>
+#include <cstring>
+
+namespace STLL {
+
+/** \brief a class to output layouts using SDL2
+ *
+ * This is the SDL2 version of showSDL. It draws into SDL_Surfaces or into the
+ * memory of locked streaming textures. It uses the same glyph cache and blitting
+ * functions as the SDL 1.2 version.
+ *
+ * For the common 24 and 32 bit formats, where each colour channel is one byte, there
+ * are fast output functions, all other formats use a slow fallback that goes through
+ * SDL_GetRGB and SDL_MapRGB.
+ *
+ * \tparam G the gamma calculation class to use... normally you don't need to change this, keep the default
+ */
+template <class G = internal::Gamma_c<>>
+class showSDL2
+{
+  private:
+    G g;
+    internal::GlyphCache_c cache;
+    int cx, cy, cw, ch;
+
+    // a simple get pixel function for the fallback render methods
+    static std::tuple<uint8_t, uint8_t, uint8_t> getpixel(const uint8_t * p, const SDL_PixelFormat * f)
+    {
+      uint32_t val;
+
+      switch(f->BytesPerPixel) {
+        case 1: val = *p;
+        break;
+
+        case 2: val = *(Uint16 *)p;
+        break;
+
+        case 3:
+          if(SDL_BYTEORDER == SDL_BIG_ENDIAN)
+            val = p[0] << 16 | p[1] << 8 | p[2];
+          else
+            val = p[0] | p[1] << 8 | p[2] << 16;
+          break;
+
+        case 4: val = *(Uint32 *)p;
+        break;
+
+        default:
+          val = 0;       /* shouldn't happen, but avoids warnings */
+          break;
+      }
+
+      Uint8 r, g, b;
+      SDL_GetRGB(val, f, &r, &g, &b);
+
+      return std::make_tuple(r, g, b);
+    }
+
+    // a simple put pixel function for the fallback render methods
+    static void putpixel(uint8_t * p, uint8_t r, uint8_t g, uint8_t b, const SDL_PixelFormat * f)
+    {
+      uint32_t pixel = SDL_MapRGB(f, r, g, b);
+
+      switch(f->BytesPerPixel) {
+        case 1:
+          *p = pixel;
+          break;
+
+        case 2:
+          *(Uint16 *)p = pixel;
+          break;
+
+        case 3:
+          if(SDL_BYTEORDER == SDL_BIG_ENDIAN) {
+            p[0] = (pixel >> 16) & 0xff;
+            p[1] = (pixel >> 8) & 0xff;
+            p[2] = pixel & 0xff;
+          } else {
+            p[0] = pixel & 0xff;
+            p[1] = (pixel >> 8) & 0xff;
+            p[2] = (pixel >> 16) & 0xff;
+          }
+          break;
+
+        case 4:
+          *(Uint32 *)p = pixel;
+          break;
+      }
+    }
+
+    constexpr static int calcFormatID(int r, int g, int b)
+    {
+      return r*16+g*4+b;
+    }
+
+    // find the byte offsets of the 3 colour channels within a pixel, returns -1
+    // when the format has no byte aligned 8 bit channels, otherwise a format id
+    // calculated with calcFormatID
+    static int getSurfaceFormat(const SDL_PixelFormat * f)
+    {
+      if (f->BytesPerPixel != 3 && f->BytesPerPixel != 4) return -1;
+
+      auto offset = [f](uint32_t mask, int shift) -> int {
+        if (mask != (0xFFu << shift) || shift % 8 != 0) return -1;
+
+        if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
+          return f->BytesPerPixel-1-shift/8;
+        else
+          return shift/8;
+      };
+
+      int r = offset(f->Rmask, f->Rshift);
+      int g = offset(f->Gmask, f->Gshift);
+      int b = offset(f->Bmask, f->Bshift);
+
+      if (r < 0 || g < 0 || b < 0) return -1;
+
+      return calcFormatID(r, g, b);
+    }
+
+    // output a glyph with the given pixel functions, the functions always get and put
+    // rgb values, the reordering for BGR sub pixels is done here
+    template <class P1, class P2>
+    void outputGlyph(int sx, int sy, const internal::PaintData_c & img, SubPixelArrangement sp, Color_c c,
+                     uint8_t * pixels, int pitch, int bbp, int w, int h, const P1 & pxget, const P2 & pxput)
+    {
+      auto bl = [this](int a1, int a2, int b1, int b2, int c) -> auto { return internal::blend(a1, a2, b1, b2, c, g); };
+
+      switch (sp)
+      {
+        default: // use no subpixel as default... should not happen though
+        case SUBP_NONE:
+          outputGlyph_NONE(sx, sy, img, c, pixels, pitch, bbp, w, h, pxget, pxput, bl, cx, cy, cw, ch);
+          break;
+
+        case SUBP_RGB:
+          outputGlyph_HorizontalRGB(sx, sy, img, c.r(), c.g(), c.b(), c.a(), pixels, pitch, bbp, w, h,
+                                    pxget, pxput, bl, cx, cy, cw, ch);
+          break;
+
+        case SUBP_BGR:
+          outputGlyph_HorizontalRGB(sx, sy, img, c.b(), c.g(), c.r(), c.a(), pixels, pitch, bbp, w, h,
+            [&pxget](const uint8_t * p) -> auto { auto t = pxget(p); return std::make_tuple(std::get<2>(t), std::get<1>(t), std::get<0>(t)); },
+            [&pxput](uint8_t * p, uint8_t sp1, uint8_t sp2, uint8_t sp3) -> void { pxput(p, sp3, sp2, sp1); },
+            bl, cx, cy, cw, ch);
+          break;
+      }
+    }
+
+    // fill a rectangle with a colour, the coordinates are in pixels
+    template <class P2>
+    void fillRect(int x, int y, int rw, int rh, Color_c c, uint8_t * pixels, int pitch, int bbp, int w, int h,
+                  const P2 & pxput)
+    {
+      int x0 = std::max(std::max(x, cx), 0);
+      int y0 = std::max(std::max(y, cy), 0);
+      int x1 = std::min(x+rw, w);
+      int y1 = std::min(y+rh, h);
+
+      if (cw < std::numeric_limits<int>::max()-cx) x1 = std::min(x1, cx+cw);
+      if (ch < std::numeric_limits<int>::max()-cy) y1 = std::min(y1, cy+ch);
+
+      for (int yp = y0; yp < y1; yp++)
+        for (int xp = x0; xp < x1; xp++)
+          pxput(pixels + yp*pitch + xp*bbp, c.r(), c.g(), c.b());
+    }
+
+    // output the layout with the given pixel access functions, images are handed to the images function
+    template <class P1, class P2, class I>
+    void drawLayout(const TextLayout_c & l, int sx, int sy, uint8_t * pixels, int pitch, int bbp, int w, int h,
+                    SubPixelArrangement sp, const P1 & pxget, const P2 & pxput, const I & images)
+    {
+      for (auto & i : l.getData())
+      {
+        switch (i.command)
+        {
+          case CommandData_c::CMD_GLYPH:
+            outputGlyph(sx+i.x, sy+i.y, cache.getGlyph(i.font, i.glyphIndex, sp, i.blurr), sp, g.forward(i.c),
+                        pixels, pitch, bbp, w, h, pxget, pxput);
+            break;
+
+          case CommandData_c::CMD_RECT:
+            if (i.blurr == 0)
+            {
+              int x = (i.x+sx+32)/64;
+              int y = (i.y+sy+32)/64;
+              fillRect(x, y, (i.x+sx+(int)i.w+32)/64-x, (i.y+sy+(int)i.h+32)/64-y, i.c,
+                       pixels, pitch, bbp, w, h, pxput);
+            }
+            else
+            {
+              outputGlyph(sx+i.x, sy+i.y, cache.getRect(i.w, i.h, sp, i.blurr), sp, g.forward(i.c),
+                          pixels, pitch, bbp, w, h, pxget, pxput);
+            }
+            break;
+
+          case CommandData_c::CMD_IMAGE:
+            images(i);
+            break;
+        }
+      }
+    }
+
+    // output with fast pixel access for formats with one byte per channel, the template
+    // arguments are the byte offsets of the channels within the pixel
+    template <int Ro, int Go, int Bo, class I>
+    void drawLayoutBytes(const TextLayout_c & l, int sx, int sy, uint8_t * pixels, int pitch, int bbp, int w, int h,
+                         SubPixelArrangement sp, const I & images)
+    {
+      drawLayout(l, sx, sy, pixels, pitch, bbp, w, h, sp,
+        [](const uint8_t * p) -> auto { return std::make_tuple(p[Ro], p[Go], p[Bo]); },
+        [](uint8_t * p, uint8_t r, uint8_t g, uint8_t b) -> void { p[Ro] = r; p[Go] = g; p[Bo] = b; },
+        images);
+    }
+
+    // pick the pixel access functions for the format and output the layout
+    template <class I>
+    void drawLayout(const TextLayout_c & l, int sx, int sy, uint8_t * pixels, int pitch, int w, int h,
+                    const SDL_PixelFormat * f, SubPixelArrangement sp, const I & images)
+    {
+      int bbp = f->BytesPerPixel;
+
+      // hub code to decide which function to use for output, all formats with one byte per
+      // colour channel are handled by fast functions, all others use the slow fallback
+      // if you need additional fast formats add them here
+      switch (getSurfaceFormat(f))
+      {
+        case calcFormatID(2, 1, 0):  // ARGB8888, RGB888 (little endian), BGR24
+          drawLayoutBytes<2, 1, 0>(l, sx, sy, pixels, pitch, bbp, w, h, sp, images);
+          break;
+
+        case calcFormatID(0, 1, 2):  // ABGR8888, BGR888 (little endian), RGB24
+          drawLayoutBytes<0, 1, 2>(l, sx, sy, pixels, pitch, bbp, w, h, sp, images);
+          break;
+
+        case calcFormatID(3, 2, 1):  // RGBA8888 (little endian)
+          drawLayoutBytes<3, 2, 1>(l, sx, sy, pixels, pitch, bbp, w, h, sp, images);
+          break;
+
+        case calcFormatID(1, 2, 3):  // BGRA8888 (little endian), ARGB8888 (big endian)
+          drawLayoutBytes<1, 2, 3>(l, sx, sy, pixels, pitch, bbp, w, h, sp, images);
+          break;
+
+        default:
+          drawLayout(l, sx, sy, pixels, pitch, bbp, w, h, sp,
+            [f](const uint8_t * p) -> auto { return getpixel(p, f); },
+            [f](uint8_t * p, uint8_t r, uint8_t g, uint8_t b) -> void { putpixel(p, r, g, b, f); },
+            images);
+          break;
+      }
+    }
+
+  public:
+
+    showSDL2(void) : cx(0), cy(0), cw(std::numeric_limits<int>::max()), ch(std::numeric_limits<int>::max())
+    {
+      g.setGamma(22);
+    }
+
+    /** \brief class used to encapsulate image drawing
+     *
+     * When the routine showLayout needs to draw an image onto a surface it will call the draw function in this
+     * class to do the job. This allows you to do your own image loading and caching and such stuff.
+     *
+     * Derive from this function and implement the draw function to handle image drawing in your application
+     */
+    class ImageDrawer_c
+    {
+      public:
+        /** \brief function called to draw an image
+         *
+         * \param x x-position to draw the image in 1/64 pixels
+         * \param y y-position to draw the image in 1/64 pixels
+         * \param w width of the image to draw
+         * \param h height of the image to draw
+         * \param s the SDL-Surface to draw the image on
+         * \param url the url of the image to draw
+         */
+        virtual void draw(int32_t x, int32_t y, uint32_t w, uint32_t h, SDL_Surface * s, const std::string & url) = 0;
+    };
+
+    /** \brief display a single layout on a surface
+     *
+     * The surface is locked for the output, when that is necessary
+     *
+     *  \param l layout to draw
+     *  \param sx x position on the target surface in 1/64th pixels
+     *  \param sy y position on the target surface in 1/64th pixels
+     *  \param s target surface
+     *  \param sp which kind of sub-pixel positioning do you want?
+     *  \param images a pointer to an image drawer class that is used to draw the images, when you give
+     *                a nullptr here, no images will be drawn
+     */
+    void showLayout(const TextLayout_c & l, int sx, int sy, SDL_Surface * s,
+                    SubPixelArrangement sp = SUBP_NONE, ImageDrawer_c * images = 0)
+    {
+      if (SDL_MUSTLOCK(s) && SDL_LockSurface(s) != 0) return;
+
+      // images are drawn after unlocking the surface, as the image drawer will most
+      // likely blit onto the surface
+      std::vector<const CommandData_c *> img;
+
+      drawLayout(l, sx, sy, (uint8_t*)s->pixels, s->pitch, s->w, s->h, s->format, sp,
+                 [&img, images](const CommandData_c & i) -> void { if (images) img.push_back(&i); });
+
+      if (SDL_MUSTLOCK(s)) SDL_UnlockSurface(s);
+
+      for (auto i : img)
+        images->draw(i->x+sx, i->y+sy, i->w, i->h, s, i->imageURL);
+    }
+
+    /** \brief display a single layout into a memory area, e.g. a locked streaming texture
+     *
+     * Images within the layout are not drawn.
+     *
+     *  \param l layout to draw
+     *  \param sx x position on the target in 1/64th pixels
+     *  \param sy y position on the target in 1/64th pixels
+     *  \param pixels pointer to the first pixel, e.g. as returned by SDL_LockTexture
+     *  \param pitch number of bytes per row of pixels
+     *  \param w width of the target in pixels
+     *  \param h height of the target in pixels
+     *  \param format the SDL pixel format of the target, e.g. SDL_PIXELFORMAT_ARGB8888
+     *  \param sp which kind of sub-pixel positioning do you want?
+     */
+    void showLayout(const TextLayout_c & l, int sx, int sy, void * pixels, int pitch, int w, int h, Uint32 format,
+                    SubPixelArrangement sp = SUBP_NONE)
+    {
+      SDL_PixelFormat * f = SDL_AllocFormat(format);
+
+      if (!f) return;
+
+      drawLayout(l, sx, sy, (uint8_t*)pixels, pitch, w, h, f, sp, [](const CommandData_c &) -> void {});
+
+      SDL_FreeFormat(f);
+    }
+
+    /** \brief display a single layout on a streaming texture
+     *
+     * The whole texture is locked, filled with the background colour and then the layout
+     * is drawn. The background is necessary because the content of a locked texture is
+     * undefined. If you want to draw several layouts onto one texture lock it yourself
+     * and use the function drawing into memory.
+     *
+     * Images within the layout are not drawn.
+     *
+     *  \param l layout to draw
+     *  \param sx x position on the texture in 1/64th pixels
+     *  \param sy y position on the texture in 1/64th pixels
+     *  \param t target texture, it must have been created with SDL_TEXTUREACCESS_STREAMING
+     *  \param background colour to fill the texture with before drawing, the alpha value is ignored
+     *  \param sp which kind of sub-pixel positioning do you want?
+     */
+    void showLayout(const TextLayout_c & l, int sx, int sy, SDL_Texture * t, Color_c background,
+                    SubPixelArrangement sp = SUBP_NONE)
+    {
+      Uint32 format;
+      int access, w, h;
+      void * pixels;
+      int pitch;
+
+      if (SDL_QueryTexture(t, &format, &access, &w, &h) != 0) return;
+      if (access != SDL_TEXTUREACCESS_STREAMING) return;
+      if (SDL_LockTexture(t, nullptr, &pixels, &pitch) != 0) return;
+
+      SDL_PixelFormat * f = SDL_AllocFormat(format);
+
+      if (f)
+      {
+        uint32_t bg = SDL_MapRGB(f, background.r(), background.g(), background.b());
+
+        for (int y = 0; y < h; y++)
+          for (int x = 0; x < w; x++)
+            memcpy((uint8_t*)pixels + y*pitch + x*f->BytesPerPixel,
+                   (const uint8_t*)&bg + (SDL_BYTEORDER == SDL_BIG_ENDIAN ? 4-f->BytesPerPixel : 0),
+                   f->BytesPerPixel);
+
+        drawLayout(l, sx, sy, (uint8_t*)pixels, pitch, w, h, f, sp, [](const CommandData_c &) -> void {});
+
+        SDL_FreeFormat(f);
+      }
+
+      SDL_UnlockTexture(t);
+    }
+
+    /** \brief update the gamma value used for output
+     *
+     * Default value for the class is 22, which is good for sRGB output, which
+     * should be your default for high quality output. See \ref gamma_sec for details.
+     *
+     * \param gamma the new gamma value in 1/10th units. Use 22 for sRGB and 10 for normal linear
+     */
+    void setGamma(uint8_t gamma = 22)
+    {
+      g.setGamma(gamma);
+    }
+
+    /** \brief set the clip rectangle
+     *
+     * Default for the clip rectangle is as big as possible, output is always
+     * clipped to the target size. Defaults for this function
+     * are set in such a way that calling it without arguments clears the
+     * clip rectangle
+     *
+     * \param x x-coordinate of upper left corner
+     * \param y y-coordinate of upper left corner
+     * \param w width of the clip rectangle
+     * \param h height of clip rectangle
+     */
+    void setClipRect(uint16_t x = 0, uint16_t y = 0, uint16_t w = std::numeric_limits<uint16_t>::max(), uint16_t h = std::numeric_limits<uint16_t>::max())
+    {
+      cx = x;
+      cy = y;
+      cw = w;
+      ch = h;
+    }
+
+    /** \brief trims the font cache down to a maximal number of entries
+     *
+     * See showSDL::trimCache
+     *
+     * \param num maximal number of entries, e.g. 0 completely empties the cache
+     */
+    void trimCache(size_t num)
+    {
+      cache.trim(num);
+    }
+
+    /** \brief enable or disable span encoding of cached glyphs
+     *
+     * See showSDL::setCacheCompression
+     *
+     * \param enable true to enable span encoding
+     */
+    void setCacheCompression(bool enable)
+    {
+      cache.setCompression(enable);
+    }
+
+    /** \brief render the glyphs with the internal rasterizer instead of FreeType
+     *
+     * See showSDL::setOutlineRendering
+     *
+     * \param enable true to use the internal rasterizer
+     */
+    void setOutlineRendering(bool enable)
+    {
+      cache.setOutlineRendering(enable);
+    }
+
+    /** \brief share the glyph cache with other processes
+     *
+     * See showSDL::useSharedCache
+     *
+     * \param name name of the segment, use an empty string to stop using the shared cache
+     * \param bytes size of the segment when it needs to be created
+     * \return true, when the segment could be used
+     */
+    bool useSharedCache(const std::string & name, size_t bytes = 16*1024*1024)
+    {
+      if (name.empty())
+      {
+        cache.setShared(nullptr);
+        return true;
+      }
+
+      auto s = internal::SharedGlyphCache_c::open(name, bytes);
+      if (s) cache.setShared(s);
+      return s != nullptr;
+    }
+
+    /** \brief remove a shared glyph cache segment
+     *
+     * See showSDL::removeSharedCache
+     *
+     * \param name name of the segment as given to useSharedCache
+     * \return true, when the segment was removed
+     */
+    static bool removeSharedCache(const std::string & name)
+    {
+      return internal::SharedGlyphCache_c::remove(name);
+    }
+};
+
+}
+
+#endif
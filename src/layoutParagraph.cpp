@@ -307,10 +307,10 @@ static void addUnderline(runInfo & run, int32_t gx, int32_t gw, const LayoutProp
     for (size_t j = 0; j < a.shadows.size(); j++)
     {
       run.run.push_back(std::make_pair(a.shadows.size()-j,
-          CommandData_c(gx+a.shadows[j].dx, gy+a.shadows[j].dy, gw, gh, a.shadows[j].c, a.shadows[j].blurr)));
+          CommandData_c(gx+a.shadows[j].dx, gy+a.shadows[j].dy, gw, gh, a.shadows[j].c, a.shadows[j].blurr, a.span, j+1)));
     }
 
-    run.run.push_back(std::make_pair(0, CommandData_c(gx, gy, gw, gh, a.c, 0)));
+    run.run.push_back(std::make_pair(0, CommandData_c(gx, gy, gw, gh, a.c, 0, a.span)));
   }
 }
 
@@ -520,11 +520,11 @@ static runInfo createRun(const LayoutDataView & view, size_t spos, size_t runsta
       for (size_t j = 0; j < view.att(runstart).shadows.size(); j++)
       {
         run.run.push_back(std::make_pair(view.att(runstart).shadows.size()-j,
-            CommandData_c(font, gi, gx+a.shadows[j].dx, gy+a.shadows[j].dy, a.shadows[j].c, a.shadows[j].blurr)));
+            CommandData_c(font, gi, gx+a.shadows[j].dx, gy+a.shadows[j].dy, a.shadows[j].c, a.shadows[j].blurr, a.span, j+1)));
       }
 
       // output the final glyph
-      run.run.push_back(std::make_pair(0, CommandData_c(font, gi, gx, gy, a.c, 0)));
+      run.run.push_back(std::make_pair(0, CommandData_c(font, gi, gx, gy, a.c, 0, a.span)));
 
       addUnderline(run, gx, glyph_pos[j].x_advance+64, prop, a);
 
@@ -575,9 +575,8 @@ static std::vector<runInfo> createTextRuns(const LayoutDataView & view, const La
     // Find end of current run. This run continues, as long as
     while (   (spos < view.size())                                   // there is text left in our string
            && (view.emb(runstart) == view.emb(spos))                 // text direction has not changed
-           && (view.att(runstart).lang == view.att(spos).lang)       // text still has the same language
+           && (view.att(runstart).shapesLike(view.att(spos)))        // text still has the same language and baseline
            && (font == view.att(spos).font.get(view.txt(spos)))      // and the same font
-           && (view.att(runstart).baseline_shift == view.att(spos).baseline_shift)           //  and the same baseline
            && (!view.att(spos).inlay)                                // and next char is not an inlay
            && (!view.att(spos-1).inlay)                              // and we are an not inlay
            && (   (view.lnb(spos-1) == LINEBREAK_NOBREAK)            // and line-break is not requested
@@ -639,7 +638,7 @@ static void mergeLinks(TextLayout_c & txt, const std::vector<TextLayout_c::LinkI
   {
     // try to find the link to insert in the already existing links within txt
     auto i = std::find_if(txt.links.begin(), txt.links.end(),
-                          [&l] (TextLayout_c::LinkInformation_c l2) { return l.url == l2.url; }
+                          [&l] (const TextLayout_c::LinkInformation_c & l2) { return l.url == l2.url; }
                          );
 
     // when not found create it
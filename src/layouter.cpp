@@ -22,15 +22,29 @@
 
 #include <stll/layouter.h>
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
 namespace STLL {
 
 TextLayout_c::TextLayout_c(TextLayout_c&& src) :
 height(src.height), left(src.left), right(src.right), firstBaseline(src.firstBaseline),
-data(std::move(src.data)), links(std::move(src.links)) { }
+data(std::move(src.data)), linkIndex(std::move(src.linkIndex)), spanIndex(std::move(src.spanIndex)),
+version(src.version), links(std::move(src.links))
+{
+  // the source is empty now, so it must not keep the version or the indices of its old commands
+  src.data.clear();
+  src.links.clear();
+  src.linkIndex = LinkIndex_c();
+  src.spanIndex.clear();
+  src.version = 0;
+}
 
 TextLayout_c::TextLayout_c(const TextLayout_c& src):
 height(src.height), left(src.left), right(src.right), firstBaseline(src.firstBaseline),
-data(src.data), links(src.links) { }
+data(src.data), linkIndex(src.linkIndex), spanIndex(src.spanIndex), version(src.version),
+links(src.links) { }
 
 TextLayout_c::TextLayout_c(void): height(0), left(0), right(0), firstBaseline(0) { }
 
@@ -59,6 +73,10 @@ void TextLayout_c::append(const TextLayout_c & l, int dx, int dy)
   height = std::max(height, l.height);
   left = std::min(left, l.left);
   right = std::max(right, l.right);
+
+  linkIndex = LinkIndex_c();
+  spanIndex.clear();
+  version = 0;
 }
 
 void TextLayout_c::shift(int32_t dx, int32_t dy)
@@ -75,6 +93,218 @@ void TextLayout_c::shift(int32_t dx, int32_t dy)
       a.x += dx;
       a.y += dy;
     }
+
+  linkIndex.dx += dx;
+  linkIndex.dy += dy;
+
+  version = 0;
+}
+
+uint64_t TextLayout_c::getVersion(void) const
+{
+  // versions are handed out lazily, so that adding commands stays cheap
+  static std::atomic<uint64_t> counter(0);
+
+  if (version == 0)
+    version = ++counter;
+
+  return version;
+}
+
+void TextLayout_c::buildLinkIndex(void)
+{
+  linkIndex = LinkIndex_c();
+
+  // the bands are between all upper and lower edges of the areas
+  for (const auto & l : links)
+    for (const auto & a : l.areas)
+      if (a.w > 0 && a.h > 0)
+      {
+        linkIndex.bands.push_back(a.y);
+        linkIndex.bands.push_back(a.y+a.h);
+      }
+
+  std::sort(linkIndex.bands.begin(), linkIndex.bands.end());
+  linkIndex.bands.erase(std::unique(linkIndex.bands.begin(), linkIndex.bands.end()), linkIndex.bands.end());
+
+  // add each area to all the bands that it covers
+  std::vector<std::vector<LinkIndex_c::Area_c>> bandAreas(linkIndex.bands.size());
+
+  for (size_t i = 0; i < links.size(); i++)
+    for (const auto & a : links[i].areas)
+      if (a.w > 0 && a.h > 0)
+      {
+        auto b = std::lower_bound(linkIndex.bands.begin(), linkIndex.bands.end(), a.y) - linkIndex.bands.begin();
+
+        for (; linkIndex.bands[b] < a.y+a.h; b++)
+          bandAreas[b].push_back(LinkIndex_c::Area_c { a.x, a.x+a.w, 0, (uint32_t)i });
+      }
+
+  for (auto & b : bandAreas)
+  {
+    std::sort(b.begin(), b.end(), [](const LinkIndex_c::Area_c & a, const LinkIndex_c::Area_c & b) { return a.x0 < b.x0; });
+
+    linkIndex.start.push_back(linkIndex.areas.size());
+
+    int32_t maxX1 = std::numeric_limits<int32_t>::min();
+
+    for (auto a : b)
+    {
+      maxX1 = std::max(maxX1, a.x1);
+      a.maxX1 = maxX1;
+      linkIndex.areas.push_back(a);
+    }
+  }
+
+  linkIndex.start.push_back(linkIndex.areas.size());
+  linkIndex.valid = true;
+}
+
+int TextLayout_c::linkAt(int32_t x, int32_t y) const
+{
+  if (!linkIndex.valid)
+  {
+    for (size_t i = 0; i < links.size(); i++)
+      for (const auto & a : links[i].areas)
+        if (x >= a.x && x < a.x+a.w && y >= a.y && y < a.y+a.h)
+          return i;
+
+    return -1;
+  }
+
+  x -= linkIndex.dx;
+  y -= linkIndex.dy;
+
+  // find the band containing y, the last entry is the end of the last band
+  auto b = std::upper_bound(linkIndex.bands.begin(), linkIndex.bands.end(), y);
+
+  if (b == linkIndex.bands.begin() || b == linkIndex.bands.end()) return -1;
+
+  size_t band = b - linkIndex.bands.begin() - 1;
+
+  auto first = linkIndex.areas.begin() + linkIndex.start[band];
+  auto a = std::upper_bound(first, linkIndex.areas.begin() + linkIndex.start[band+1], x,
+                            [](int32_t x, const LinkIndex_c::Area_c & a) { return x < a.x0; });
+
+  // go back through the areas that start left of x, until none of the remaining ones reaches x
+  while (a != first)
+  {
+    a--;
+
+    if (a->maxX1 <= x) break;
+    if (a->x1 > x) return a->link;
+  }
+
+  return -1;
+}
+
+std::vector<size_t> TextLayout_c::linksInRect(int32_t x, int32_t y, int32_t w, int32_t h) const
+{
+  std::vector<size_t> res;
+
+  if (w <= 0 || h <= 0) return res;
+
+  if (!linkIndex.valid)
+  {
+    for (size_t i = 0; i < links.size(); i++)
+      for (const auto & a : links[i].areas)
+        if (a.w > 0 && a.h > 0 && a.x < x+w && a.x+a.w > x && a.y < y+h && a.y+a.h > y)
+        {
+          res.push_back(i);
+          break;
+        }
+
+    return res;
+  }
+
+  x -= linkIndex.dx;
+  y -= linkIndex.dy;
+
+  // start with the band containing y or the first band below it
+  auto b = std::upper_bound(linkIndex.bands.begin(), linkIndex.bands.end(), y);
+  size_t band = (b == linkIndex.bands.begin()) ? 0 : b - linkIndex.bands.begin() - 1;
+
+  for (; band+1 < linkIndex.bands.size() && linkIndex.bands[band] < y+h; band++)
+  {
+    auto first = linkIndex.areas.begin() + linkIndex.start[band];
+    auto a = std::upper_bound(first, linkIndex.areas.begin() + linkIndex.start[band+1], x+w-1,
+                              [](int32_t x, const LinkIndex_c::Area_c & a) { return x < a.x0; });
+
+    while (a != first)
+    {
+      a--;
+
+      if (a->maxX1 <= x) break;
+      if (a->x1 > x) res.push_back(a->link);
+    }
+  }
+
+  std::sort(res.begin(), res.end());
+  res.erase(std::unique(res.begin(), res.end()), res.end());
+
+  return res;
+}
+
+void TextLayout_c::buildSpanIndex(void)
+{
+  spanIndex.clear();
+  spanIndex.reserve(data.size());
+
+  for (size_t i = 0; i < data.size(); i++)
+    spanIndex.emplace_back(data[i].span, i);
+
+  std::sort(spanIndex.begin(), spanIndex.end());
+}
+
+// call f for all commands of the given span and shadow, returns the number of commands
+// span 0 means no span, so those commands are never handed out
+template <class F>
+size_t TextLayout_c::forEachSpanCommand(uint32_t span, uint16_t shadow, F f)
+{
+  size_t res = 0;
+
+  if (span == 0) return res;
+
+  if (spanIndex.empty())
+  {
+    for (auto & d : data)
+      if (d.span == span && d.shadow == shadow && d.command != CommandData_c::CMD_IMAGE)
+      {
+        f(d);
+        res++;
+      }
+  }
+  else
+  {
+    auto i = std::lower_bound(spanIndex.begin(), spanIndex.end(), std::make_pair(span, (uint32_t)0));
+
+    while (i != spanIndex.end() && i->first == span)
+    {
+      auto & d = data[i->second];
+
+      if (d.shadow == shadow && d.command != CommandData_c::CMD_IMAGE)
+      {
+        f(d);
+        res++;
+      }
+
+      i++;
+    }
+  }
+
+  if (res) version = 0;
+
+  return res;
+}
+
+size_t TextLayout_c::recolor(uint32_t span, Color_c c, uint16_t shadow)
+{
+  return forEachSpanCommand(span, shadow, [c](CommandData_c & d) { d.c = c; });
+}
+
+size_t TextLayout_c::moveShadow(uint32_t span, uint16_t shadow, int32_t dx, int32_t dy)
+{
+  return forEachSpanCommand(span, shadow+1, [dx, dy](CommandData_c & d) { d.x += dx; d.y += dy; });
 }
 
 }
@@ -477,4 +477,12 @@ TextStyleSheet_c::TextStyleSheet_c(std::shared_ptr< FontCache_c > c)
   }
 }
 
+TextStyleSheet_c::TextStyleSheet_c(const TextStyleSheet_c & s, std::shared_ptr<FontCache_c> c) :
+  rules(s.rules), cache(c ? c : std::make_shared<FontCache_c>()),
+  useOptimizingLayouter(s.useOptimizingLayouter), hyphenate(s.hyphenate)
+{
+  for (const auto & f : s.families)
+    families[f.first] = std::make_shared<FontFamily_c>(*f.second, cache);
+}
+
 }
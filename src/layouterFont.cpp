@@ -20,6 +20,7 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  */
 #include <stll/layouterFont.h>
+#include <stll/internal/outlineCache.h>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -32,6 +33,7 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <fstream>
 
 #include <cassert>
 
@@ -47,10 +49,14 @@ FontFace_c::GlyphSlot_c::GlyphSlot_c(const FT_GlyphSlotRec_* ft) :
   data((uint8_t*)ft->bitmap.buffer)
   {}
 
-FontFace_c::FontFace_c(std::shared_ptr<FreeTypeLibrary_c> l, const internal::FontFileResource_c & r, uint32_t s) :
-                lib(l), rec(r), size(s)
+FontFace_c::FontFace_c(std::shared_ptr<FreeTypeLibrary_c> l, const internal::FontFileResource_c & r, uint32_t s,
+                       std::shared_ptr<internal::OutlineCache_c> o, std::shared_ptr<uint64_t> h) :
+                lib(l), rec(r), size(s), outlines(o), contentHash(h)
 {
   f = lib->newFace(r, s);
+
+  if (!outlines) outlines = std::make_shared<internal::OutlineCache_c>();
+  if (!contentHash) contentHash = std::make_shared<uint64_t>(0);
 }
 
 FontFace_c::~FontFace_c()
@@ -58,6 +64,41 @@ FontFace_c::~FontFace_c()
   lib->doneFace(f);
 }
 
+uint64_t FontFace_c::getContentHash(void) const
+{
+  if (*contentHash == 0)
+  {
+    // 64 bit FNV-1a
+    uint64_t h = 14695981039346656037ull;
+
+    auto add = [&h](const uint8_t * d, size_t s) {
+      for (size_t i = 0; i < s; i++)
+        h = (h ^ d[i]) * 1099511628211ull;
+    };
+
+    if (rec.getDatasize() == 0)
+    {
+      std::ifstream in(rec.getDescription(), std::ios::binary);
+      std::vector<uint8_t> buf(64*1024);
+
+      while (in)
+      {
+        in.read((char*)buf.data(), buf.size());
+        add(buf.data(), in.gcount());
+      }
+    }
+    else
+    {
+      add(rec.getData().get(), rec.getDatasize());
+    }
+
+    // 0 is used to mark the hash as not yet calculated
+    *contentHash = h ? h : 1;
+  }
+
+  return *contentHash;
+}
+
 uint32_t FontFace_c::getHeight(void) const
 {
   return f->size->metrics.height;
@@ -98,7 +139,18 @@ std::shared_ptr<FontFace_c> FontCache_c::getFont(const internal::FontFileResourc
 
   // TODO... race maybe someone else opens a font here?
 
-  auto a = std::make_shared<FontFace_c>(lib, res, size);
+  // all sizes of a font file share their outlines and the hash of the file
+  std::shared_ptr<internal::OutlineCache_c> o;
+  std::shared_ptr<uint64_t> h;
+  auto j = fonts.lower_bound(FontFaceParameter_c(res, 0));
+
+  if (j != fonts.end() && !(res < j->first.res) && j->second)
+  {
+    o = j->second->getOutlines();
+    h = j->second->contentHash;
+  }
+
+  auto a = std::make_shared<FontFace_c>(lib, res, size, o, h);
 
   fonts.insert(std::make_pair(ffp, a));
 
@@ -151,6 +203,18 @@ FontFace_c::GlyphSlot_c FontFace_c::renderGlyph(glyphIndex_t glyphIndex, SubPixe
   return GlyphSlot_c(f->glyph);
 }
 
+FontFace_c::GlyphSlot_c FontFace_c::renderOutline(glyphIndex_t glyphIndex, SubPixelArrangement sp, uint32_t s, int32_t dx)
+{
+  // glyphs without outline (e.g. from bitmap fonts) and vertical sub-pixel output are left to FreeType
+  if (sp == SUBP_RGB_V || sp == SUBP_BGR_V || !outlines->getOutline(f, glyphIndex).valid)
+    return renderGlyph(glyphIndex, sp);
+
+  // the face uses whole pixel sizes, so do the same to get the same glyphs
+  if (s == 0) s = (size+32) & ~63;
+
+  return outlines->render(f, glyphIndex, s, sp, dx);
+}
+
 bool FontFace_c::containsGlyph(char32_t ch)
 {
   return FT_Get_Char_Index(f, ch) != 0;
@@ -24,8 +24,18 @@
 
 namespace STLL {
 
+template class IncrementalXMLLayout_c<const xmlNode *>;
+template class XHTMLTemplate_c<const xmlNode *>;
+
 TextLayout_c layoutXML(const xmlNode * txt, const TextStyleSheet_c & rules, const Shape_c & shape)
 {
+  // the attribute values assembled while layouting are not needed afterwards
+  class releasePool_c
+  {
+    public:
+      ~releasePool_c(void) { internal::xml_attributePool().release(); }
+  } release;
+
   return internal::layoutXML_int(txt, rules, shape);
 }
 
@@ -49,4 +59,53 @@ TextLayout_c layoutXHTMLLibXML2(const std::string & txt, const TextStyleSheet_c
   return layoutXML(internal::xml_getHeadNode(std::get<0>(res)), rules, shape);
 }
 
-};
\ No newline at end of file
+TextLayout_c layoutXHTMLBufferLibXML2(char * txt, size_t length, const TextStyleSheet_c & rules, const Shape_c & shape)
+{
+  auto res = internal::xml_parseBufferLibXML2(txt, length);
+
+  if (std::get<1>(res) != "")
+  {
+    throw XhtmlException_c(std::get<1>(res));
+  }
+
+  return layoutXML(internal::xml_getHeadNode(std::get<0>(res)), rules, shape);
+}
+
+TextLayout_c layoutXHTMLFileLibXML2(const std::string & filename, const TextStyleSheet_c & rules, const Shape_c & shape)
+{
+  auto res = internal::xml_parseFileLibXML2(filename);
+
+  if (std::get<1>(res) != "")
+  {
+    throw XhtmlException_c(std::get<1>(res));
+  }
+
+  return layoutXML(internal::xml_getHeadNode(std::get<0>(res)), rules, shape);
+}
+
+std::vector<TextLayout_c> layoutXHTMLBatchLibXML2(const std::vector<std::string> & txt, const TextStyleSheet_c & rules,
+                                                  const Shape_c & shape, unsigned int threads)
+{
+  // initialize the library before the threads start using it
+  LIBXML_TEST_VERSION
+
+  return internal::layoutBatch(txt, rules, shape, threads, layoutXHTMLLibXML2);
+}
+
+XHTMLTemplate_c<const xmlNode *> compileXHTMLLibXML2(const std::string & txt)
+{
+  auto res = internal::xml_parseStringLibXML2(txt);
+
+  if (std::get<1>(res) != "")
+  {
+    throw XhtmlException_c(std::get<1>(res));
+  }
+
+  auto head = internal::xml_getHeadNode(std::get<0>(res));
+  std::shared_ptr<xmlDoc> doc(std::get<0>(res).doc, xmlFreeDoc);
+  std::get<0>(res).doc = nullptr;
+
+  return XHTMLTemplate_c<const xmlNode *>(doc, head);
+}
+
+};
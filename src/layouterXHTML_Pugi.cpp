@@ -24,6 +24,9 @@
 
 namespace STLL {
 
+template class IncrementalXMLLayout_c<pugi::xml_node>;
+template class XHTMLTemplate_c<pugi::xml_node>;
+
 TextLayout_c layoutXML(pugi::xml_node txt, const TextStyleSheet_c & rules, const Shape_c & shape)
 {
   return internal::layoutXML_int(txt, rules, shape);
@@ -49,4 +52,49 @@ TextLayout_c layoutXHTMLPugi(const std::string & txt, const TextStyleSheet_c & r
   return layoutXML(internal::xml_getHeadNode(std::get<0>(res)), rules, shape);
 }
 
-};
\ No newline at end of file
+TextLayout_c layoutXHTMLBufferPugi(char * txt, size_t length, const TextStyleSheet_c & rules, const Shape_c & shape)
+{
+  auto res = internal::xml_parseBufferPugi(txt, length);
+
+  if (std::get<1>(res) != "")
+  {
+    throw XhtmlException_c(std::get<1>(res));
+  }
+
+  return layoutXML(internal::xml_getHeadNode(std::get<0>(res)), rules, shape);
+}
+
+TextLayout_c layoutXHTMLFilePugi(const std::string & filename, const TextStyleSheet_c & rules, const Shape_c & shape)
+{
+  auto res = internal::xml_parseFilePugi(filename);
+
+  if (std::get<1>(res) != "")
+  {
+    throw XhtmlException_c(std::get<1>(res));
+  }
+
+  return layoutXML(internal::xml_getHeadNode(std::get<0>(res)), rules, shape);
+}
+
+std::vector<TextLayout_c> layoutXHTMLBatchPugi(const std::vector<std::string> & txt, const TextStyleSheet_c & rules,
+                                               const Shape_c & shape, unsigned int threads)
+{
+  return internal::layoutBatch(txt, rules, shape, threads, layoutXHTMLPugi);
+}
+
+XHTMLTemplate_c<pugi::xml_node> compileXHTMLPugi(const std::string & txt)
+{
+  auto res = internal::xml_parseStringPugi(txt);
+
+  if (std::get<1>(res) != "")
+  {
+    throw XhtmlException_c(std::get<1>(res));
+  }
+
+  auto head = internal::xml_getHeadNode(std::get<0>(res));
+  std::shared_ptr<pugi::xml_document> doc = std::move(std::get<0>(res));
+
+  return XHTMLTemplate_c<pugi::xml_node>(doc, head);
+}
+
+};
@@ -28,11 +28,18 @@
 
 #include <stll/layouterCSS.h>
 #include <stll/layouter.h>
+#include <stll/layouterXHTML.h>
 
 #include <stll/internal/xmllibraries.h>
 #include <stll/utf-8.h>
 
 #include <string>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <cstdlib>
 
 namespace STLL {
 
@@ -247,7 +254,7 @@ const char * getHTMLAttribute(X xml, const std::string attr)
 
     if (res && *res) return res;
 
-    if ("lang" == attr)
+    if ("lang" == attr || "data-span" == attr)
     {
       xml = xml_getParent(xml);
 
@@ -263,6 +270,14 @@ const char * getHTMLAttribute(X xml, const std::string attr)
   }
 }
 
+// the span of the text within a node, given with the data-span attribute of the node or
+// one of its parents, 0 when there is none
+template <class X>
+uint32_t getSpanForNode(X xml)
+{
+  return std::strtoul(getHTMLAttribute(xml, "data-span"), nullptr, 10);
+}
+
 
 
 template <class X>
@@ -270,12 +285,12 @@ using ParseFunction = TextLayout_c (*)(X & xml, const TextStyleSheet_c & rules,
                                       const Shape_c & shape, int32_t ystart);
 
 // handles padding, margin and border, all in one, it takes the text returned from the
-// ParseFunction and boxes it
-template <class X>
-TextLayout_c boxIt(X & xml, X & xml2, const TextStyleSheet_c & rules,
-                          const Shape_c & shape, int32_t ystart, ParseFunction<X> fkt,
-                          X above, X left,
-                          bool collapseBorder = false, uint32_t minHeight = 0)
+// function fkt(shape, ystart) and boxes it
+template <class X, class F>
+TextLayout_c boxIt_int(X & xml, const TextStyleSheet_c & rules,
+                       const Shape_c & shape, int32_t ystart, F fkt,
+                       X above, X left,
+                       bool collapseBorder = false, uint32_t minHeight = 0)
 {
   int32_t padding_left = 0;
   int32_t padding_right = 0;
@@ -355,8 +370,7 @@ TextLayout_c boxIt(X & xml, X & xml2, const TextStyleSheet_c & rules,
     borderwidth_left = std::max(borderElementLeft, borderwidth_left)-borderElementLeft;
   }
 
-  auto l2 = fkt(xml2, rules,
-                indentShape_c(shape, padding_left+borderwidth_left+margin_left, padding_right+borderwidth_right+margin_right),
+  auto l2 = fkt(indentShape_c(shape, padding_left+borderwidth_left+margin_left, padding_right+borderwidth_right+margin_right),
                 ystart+padding_top+borderwidth_top+margin_top);
 
   int space = minHeight - (l2.getHeight()+padding_bottom+borderwidth_bottom+margin_bottom);
@@ -472,6 +486,18 @@ TextLayout_c boxIt(X & xml, X & xml2, const TextStyleSheet_c & rules,
   return l2;
 }
 
+// boxes the layout that the ParseFunction creates for xml2
+template <class X>
+TextLayout_c boxIt(X & xml, X & xml2, const TextStyleSheet_c & rules,
+                          const Shape_c & shape, int32_t ystart, ParseFunction<X> fkt,
+                          X above, X left,
+                          bool collapseBorder = false, uint32_t minHeight = 0)
+{
+  return boxIt_int(xml, rules, shape, ystart,
+                   [&xml2, &rules, fkt](const Shape_c & s, int32_t y) { return fkt(xml2, rules, s, y); },
+                   above, left, collapseBorder, minHeight);
+}
+
 
 
 template <class X>
@@ -528,6 +554,7 @@ X layoutXML_text(X xml, const TextStyleSheet_c & rules,
       a.c = evalColor(rules.getValue(xml_getParent(xml), "color"));
       a.font = getFontForNode(xml_getParent(xml), rules);
       a.lang = getHTMLAttribute(xml_getParent(xml), "lang");
+      a.span = getSpanForNode(xml_getParent(xml));
       a.flags = 0;
       if (rules.getValue(xml_getParent(xml), "text-decoration") == "underline")
       {
@@ -607,6 +634,7 @@ X layoutXML_text(X xml, const TextStyleSheet_c & rules,
                                                      layoutXML_IMG, X(), X()));
       a.baseline_shift = 0;
       a.shadows = evalShadows(rules.getValue(xml_getParent(xml), "text-shadow"));
+      a.span = getSpanForNode(xml_getParent(xml));
 
       // if we want underlines, we add the font so that the layouter
       // can find the position of the underline
@@ -708,7 +736,13 @@ TextLayout_c layoutXML_UL(X & xml, const TextStyleSheet_c & rules, const Shape_c
 {
   TextLayout_c l;
   l.setHeight(ystart);
-  xml_forEachChild(xml, [xml, &rules, &l, &shape, ystart](X i) -> bool {
+
+  // the bullets of all items with the same attributes are identical, they only differ in
+  // their position, so each kind of bullet is laid out only once at position 0, 0 and
+  // then moved to the place of the item
+  std::vector<std::pair<CodepointAttributes_c, TextLayout_c>> bullets;
+
+  xml_forEachChild(xml, [xml, &rules, &l, &shape, ystart, &bullets](X i) -> bool {
     if (xml_isElementNode(i) && (std::string("li") == xml_getName(i)))
     {
       auto j = xml;
@@ -750,7 +784,28 @@ TextLayout_c layoutXML_UL(X & xml, const TextStyleSheet_c & rules, const Shape_c
 
       indentShape_c textshape(shape, direction == "ltr" ? listIndent : 0, direction == "ltr" ? 0: listIndent);
 
-      TextLayout_c bullet = layoutParagraph(U"\u2022", AttributeIndex_c(a), *bulletshape.get(), prop, y+padding);
+      auto b = std::find_if(bullets.begin(), bullets.end(), [&a](const std::pair<CodepointAttributes_c, TextLayout_c> & b) {
+        return b.first.font == a.font && b.first.c == a.c && b.first.shadows == a.shadows;
+      });
+
+      if (b == bullets.end())
+      {
+        // the strip for the bullet always has the width of the list indent
+        bullets.emplace_back(a, layoutParagraph(U"\u2022", AttributeIndex_c(a), RectangleShape_c(listIndent), prop, 0));
+        b = bullets.end()-1;
+      }
+
+      // place the bullet the same way as the paragraph layouter would do it at this position
+      int32_t bulletTop = y+padding;
+      int32_t bulletBottom = bulletTop+b->second.getHeight();
+
+      TextLayout_c bullet(b->second);
+      bullet.shift(bulletshape->getLeft(bulletTop, bulletBottom), bulletTop);
+      bullet.setHeight(bulletBottom);
+      bullet.setFirstBaseline(bulletTop+b->second.getFirstBaseline());
+      bullet.setLeft(bulletshape->getLeft2(bulletTop, bulletBottom));
+      bullet.setRight(bulletshape->getRight2(bulletTop, bulletBottom));
+
       TextLayout_c text = boxIt(i, i, rules, textshape, y, layoutXML_Flow, xml_getPreviousSibling(i), X());
 
       // append the bullet first and then the text, adjusting the bullet so that its baseline
@@ -1062,6 +1117,82 @@ TextLayout_c layoutXML_TABLE(X & xml, const TextStyleSheet_c & rules, const Shap
   return l;
 }
 
+// layout one block of a flow environment starting at node i, that is either a single
+// element or a run of nodes that make up a phrasing context, i is advanced to the
+// first node after the block
+template <class X>
+TextLayout_c layoutXML_FlowBlock(X & i, const TextStyleSheet_c & rules, const Shape_c & shape, int32_t ystart)
+{
+  if (   (xml_isElementNode(i))
+      && (   (std::string("p") ==  xml_getName(i))
+          || (std::string("h1") == xml_getName(i))
+          || (std::string("h2") == xml_getName(i))
+          || (std::string("h3") == xml_getName(i))
+          || (std::string("h4") == xml_getName(i))
+          || (std::string("h5") == xml_getName(i))
+          || (std::string("h6") == xml_getName(i))
+         )
+     )
+  {
+    // these element start a phrasing context
+    auto j = xml_getFirstChild(i);
+    auto l = boxIt(i, j, rules, shape, ystart, layoutXML_Phrasing, xml_getPreviousSibling(i), X());
+    if (!xml_isEmpty(j))
+    {
+      throw XhtmlException_c("There was an unexpected tag within a phrasing context (" + getNodePath(i) + ")");
+    }
+    i = xml_getNextSibling(i);
+    return l;
+  }
+  else if (  (xml_isDataNode(i))
+           ||(  (xml_isElementNode(i))
+              &&(  (std::string("span") == xml_getName(i))
+                 ||(std::string("b") == xml_getName(i))
+                 ||(std::string("br") == xml_getName(i))
+                 ||(std::string("code") == xml_getName(i))
+                 ||(std::string("em") == xml_getName(i))
+                 ||(std::string("q") == xml_getName(i))
+                 ||(std::string("small") == xml_getName(i))
+                 ||(std::string("strong") == xml_getName(i))
+                 ||(std::string("sub") == xml_getName(i))
+                 ||(std::string("sup") == xml_getName(i))
+                 ||(std::string("img") == xml_getName(i))
+                 ||(std::string("a") == xml_getName(i))
+                )
+             )
+          )
+  {
+    // these elements make the current node into a phrasing node
+    // after parsing, we assume right now, i will be changed to point to the next node
+    // not taken up by the Phrasing environment, so we don't want
+    // i to be set to the next sibling as in all other cases
+    return layoutXML_Phrasing(i, rules, shape, ystart);
+  }
+  else if (xml_isElementNode(i) && std::string("table") == xml_getName(i))
+  {
+    auto l = boxIt(i, i, rules, shape, ystart, layoutXML_TABLE, xml_getPreviousSibling(i), X());
+    i = xml_getNextSibling(i);
+    return l;
+  }
+  else if (xml_isElementNode(i) && std::string("ul") == xml_getName(i))
+  {
+    auto l = boxIt(i, i, rules, shape, ystart, layoutXML_UL, xml_getPreviousSibling(i), X());
+    i = xml_getNextSibling(i);
+    return l;
+  }
+  else if (xml_isElementNode(i) && std::string("div") == xml_getName(i))
+  {
+    auto l = boxIt(i, i, rules, shape, ystart, layoutXML_Flow, xml_getPreviousSibling(i), X());
+    i = xml_getNextSibling(i);
+    return l;
+  }
+  else
+  {
+    throw XhtmlException_c("Only 'p', 'h1'-'h6', 'ul' and 'table' tag and prasing context is "
+                           "is allowed within flow environment (" + getNodePath(i) + ")");
+  }
+}
+
 template <class X>
 TextLayout_c layoutXML_Flow(X & txt, const TextStyleSheet_c & rules, const Shape_c & shape, int32_t ystart)
 {
@@ -1071,72 +1202,7 @@ TextLayout_c layoutXML_Flow(X & txt, const TextStyleSheet_c & rules, const Shape
   auto i = xml_getFirstChild(txt);
 
   while (!xml_isEmpty(i))
-  {
-    if (   (xml_isElementNode(i))
-        && (   (std::string("p") ==  xml_getName(i))
-            || (std::string("h1") == xml_getName(i))
-            || (std::string("h2") == xml_getName(i))
-            || (std::string("h3") == xml_getName(i))
-            || (std::string("h4") == xml_getName(i))
-            || (std::string("h5") == xml_getName(i))
-            || (std::string("h6") == xml_getName(i))
-           )
-       )
-    {
-      // these element start a phrasing context
-      auto j = xml_getFirstChild(i);
-      l.append(boxIt(i, j, rules, shape, l.getHeight(), layoutXML_Phrasing, xml_getPreviousSibling(i), X()));
-      if (!xml_isEmpty(j))
-      {
-        throw XhtmlException_c("There was an unexpected tag within a phrasing context (" + getNodePath(i) + ")");
-      }
-      i = xml_getNextSibling(i);
-    }
-    else if (  (xml_isDataNode(i))
-             ||(  (xml_isElementNode(i))
-                &&(  (std::string("span") == xml_getName(i))
-                   ||(std::string("b") == xml_getName(i))
-                   ||(std::string("br") == xml_getName(i))
-                   ||(std::string("code") == xml_getName(i))
-                   ||(std::string("em") == xml_getName(i))
-                   ||(std::string("q") == xml_getName(i))
-                   ||(std::string("small") == xml_getName(i))
-                   ||(std::string("strong") == xml_getName(i))
-                   ||(std::string("sub") == xml_getName(i))
-                   ||(std::string("sup") == xml_getName(i))
-                   ||(std::string("img") == xml_getName(i))
-                   ||(std::string("a") == xml_getName(i))
-                  )
-               )
-            )
-    {
-      // these elements make the current node into a phrasing node
-      // after parsing, we assume right now, i will be changed to point to the next node
-      // not taken up by the Phrasing environment, so we don't want
-      // i to be set to the next sibling as in all other cases
-      l.append(layoutXML_Phrasing(i, rules, shape, l.getHeight()));
-    }
-    else if (xml_isElementNode(i) && std::string("table") == xml_getName(i))
-    {
-      l.append(boxIt(i, i, rules, shape, l.getHeight(), layoutXML_TABLE, xml_getPreviousSibling(i), X()));
-      i = xml_getNextSibling(i);
-    }
-    else if (xml_isElementNode(i) && std::string("ul") == xml_getName(i))
-    {
-      l.append(boxIt(i, i, rules, shape, l.getHeight(), layoutXML_UL, xml_getPreviousSibling(i), X()));
-      i = xml_getNextSibling(i);
-    }
-    else if (xml_isElementNode(i) && std::string("div") == xml_getName(i))
-    {
-      l.append(boxIt(i, i, rules, shape, l.getHeight(), layoutXML_Flow, xml_getPreviousSibling(i), X()));
-      i = xml_getNextSibling(i);
-    }
-    else
-    {
-      throw XhtmlException_c("Only 'p', 'h1'-'h6', 'ul' and 'table' tag and prasing context is "
-                             "is allowed within flow environment (" + getNodePath(i) + ")");
-    }
-  }
+    l.append(layoutXML_FlowBlock(i, rules, shape, l.getHeight()));
 
   l.setLeft(shape.getLeft(ystart, l.getHeight()));
   l.setRight(shape.getRight(ystart, l.getHeight()));
@@ -1144,23 +1210,22 @@ TextLayout_c layoutXML_Flow(X & txt, const TextStyleSheet_c & rules, const Shape
   return l;
 }
 
+// check the content of the html tag and return the body, or an empty node, when
+// there is no body
 template <class X>
-TextLayout_c layoutXML_HTML(X & txt, const TextStyleSheet_c & rules, const Shape_c & shape)
+X getBodyNode(X & txt)
 {
-  TextLayout_c l;
-
   bool headfound = false;
-  bool bodyfound = false;
+  X body = X();
 
-  xml_forEachChild(txt, [&headfound, &bodyfound, &rules, &shape, &l](X i) -> bool {
+  xml_forEachChild(txt, [&headfound, &body](X i) -> bool {
     if (xml_isElementNode(i) && std::string("head") == xml_getName(i) && !headfound)
     {
       headfound = true;
     }
-    else if (xml_isElementNode(i) && std::string("body") == xml_getName(i) && !bodyfound)
+    else if (xml_isElementNode(i) && std::string("body") == xml_getName(i) && xml_isEmpty(body))
     {
-      bodyfound = true;
-      l = boxIt(i, i, rules, shape, 0, layoutXML_Flow, xml_getPreviousSibling(i), X());
+      body = i;
     }
     else
     {
@@ -1170,10 +1235,74 @@ TextLayout_c layoutXML_HTML(X & txt, const TextStyleSheet_c & rules, const Shape
     return false;
   });
 
+  return body;
+}
+
+template <class X>
+TextLayout_c layoutXML_HTML(X & txt, const TextStyleSheet_c & rules, const Shape_c & shape)
+{
+  TextLayout_c l;
+
+  auto body = getBodyNode(txt);
+
+  if (!xml_isEmpty(body))
+    l = boxIt(body, body, rules, shape, 0, layoutXML_Flow, xml_getPreviousSibling(body), X());
+
   return l;
 }
 
 
+// layout many documents on several threads, f is the function that does the layout
+// of one document. The calling thread uses the given style sheet, all other
+// threads use a copy with their own font cache, so each thread opens each font
+// only once for all the documents it handles. One shared cache is not possible as
+// FreeType faces are not thread safe, the threads only live for this call
+template <class F>
+std::vector<TextLayout_c> layoutBatch(const std::vector<std::string> & txt, const TextStyleSheet_c & rules,
+                                      const Shape_c & shape, unsigned int threads, F f)
+{
+  std::vector<TextLayout_c> res(txt.size());
+  std::vector<std::exception_ptr> errors(txt.size());
+  std::atomic<size_t> next(0);
+
+  auto work = [&txt, &shape, &f, &res, &errors, &next](const TextStyleSheet_c & r)
+  {
+    size_t i;
+
+    while ((i = next++) < txt.size())
+    {
+      try
+      {
+        res[i] = f(txt[i], r, shape);
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min<size_t>(threads, txt.size());
+
+  std::vector<std::thread> pool;
+
+  for (unsigned int t = 1; t < threads; t++)
+    pool.emplace_back([&rules, &work](void) { work(TextStyleSheet_c(rules, nullptr)); });
+
+  work(rules);
+
+  for (auto & t : pool)
+    t.join();
+
+  // report the error of the first faulty document
+  for (auto & e : errors)
+    if (e)
+      std::rethrow_exception(e);
+
+  return res;
+}
+
 /** \brief layout the given preparsed XML tree as an HTML dom tree
  *  \param xml the xml tree to layout
  *  \param rules the stylesheet to use for layouting
@@ -1199,6 +1328,210 @@ TextLayout_c layoutXML_int(X txt, const TextStyleSheet_c & rules, const Shape_c
 
 };
 
+template <class X>
+const TextLayout_c & IncrementalXMLLayout_c<X>::layout(const TextStyleSheet_c & rules, const Shape_c & shape)
+{
+  if (valid && !changed) return result;
+
+  bool restart;
+
+  do
+  {
+    restart = false;
+    bool update = valid;
+    valid = false;
+
+    TextLayout_c l;
+
+    if (!internal::xml_isEmpty(root))
+    {
+      if (!internal::xml_isElementNode(root) || std::string("html") != internal::xml_getName(root))
+        throw XhtmlException_c("Top level tag must be the html tag (" + internal::getNodePath(root) + ")");
+
+      auto body = internal::getBodyNode(root);
+
+      if (!internal::xml_isEmpty(body))
+      {
+        // this is layoutXML_Flow for the body, it keeps the blocks and only does
+        // the dirty blocks again, when updating
+        auto flow = [this, &rules, &body, update, &restart](const Shape_c & s, int32_t ystart) -> TextLayout_c
+        {
+          TextLayout_c l;
+          l.setHeight(ystart);
+
+          if (!update)
+          {
+            blocks.clear();
+            nodes.clear();
+
+            auto i = internal::xml_getFirstChild(body);
+
+            while (!internal::xml_isEmpty(i))
+            {
+              Block_c b;
+              b.first = i;
+              b.ystart = l.getHeight();
+              b.l = internal::layoutXML_FlowBlock(i, rules, s, b.ystart);
+              b.next = i;
+              b.dirty = false;
+
+              for (auto j = b.first; j != b.next; j = internal::xml_getNextSibling(j))
+                nodes[j] = blocks.size();
+
+              l.append(b.l);
+              blocks.push_back(std::move(b));
+            }
+          }
+          else
+          {
+            for (auto & b : blocks)
+            {
+              int32_t y = l.getHeight();
+
+              if (b.dirty)
+              {
+                auto i = b.first;
+                b.l = internal::layoutXML_FlowBlock(i, rules, s, y);
+                b.dirty = false;
+
+                // the block now covers different nodes, so the tree was changed in a way
+                // that we can not follow, start again from scratch
+                if (i != b.next)
+                {
+                  restart = true;
+                  return l;
+                }
+              }
+              else if (y != b.ystart)
+              {
+                b.l.shift(0, y-b.ystart);
+                b.l.setHeight(b.l.getHeight()+y-b.ystart);
+                b.l.setFirstBaseline(b.l.getFirstBaseline()+y-b.ystart);
+              }
+
+              b.ystart = y;
+              l.append(b.l);
+            }
+          }
+
+          l.setLeft(s.getLeft(ystart, l.getHeight()));
+          l.setRight(s.getRight(ystart, l.getHeight()));
+
+          return l;
+        };
+
+        l = internal::boxIt_int(body, rules, shape, 0, flow, internal::xml_getPreviousSibling(body), X());
+      }
+      else
+      {
+        blocks.clear();
+        nodes.clear();
+      }
+
+      internal::xml_releaseAttributeValues(root);
+    }
+
+    if (!restart)
+    {
+      result = std::move(l);
+      valid = true;
+      changed = false;
+    }
+
+  } while (restart);
+
+  return result;
+}
+
+template <class X>
+void IncrementalXMLLayout_c<X>::markDirty(X node)
+{
+  changed = true;
+
+  // go up until we find the node directly within the body
+  while (!internal::xml_isEmpty(node))
+  {
+    auto n = nodes.find(node);
+
+    if (n != nodes.end())
+    {
+      blocks[n->second].dirty = true;
+
+      // the margins and borders of the following block depend on this one
+      if (n->second+1 < blocks.size())
+        blocks[n->second+1].dirty = true;
+
+      return;
+    }
+
+    node = internal::xml_getParent(node);
+  }
+
+  // the node is not part of any block, e.g. it is the body itself or a new node
+  valid = false;
+}
+
+template <class X>
+XHTMLTemplate_c<X>::XHTMLTemplate_c(std::shared_ptr<void> d, X txt) : doc(std::move(d)), inc(txt)
+{
+  // collect the slots in document order
+  std::vector<X> stack;
+
+  if (!internal::xml_isEmpty(txt)) stack.push_back(txt);
+
+  while (!stack.empty())
+  {
+    auto n = stack.back();
+    stack.pop_back();
+
+    if (internal::xml_isElementNode(n))
+    {
+      auto a = internal::xml_getAttribute(n, "data-slot");
+
+      if (a)
+        slots.push_back(Slot_c { a, n, "", false });
+
+      std::vector<X> c;
+      internal::xml_forEachChild(n, [&c](X i) -> bool { c.push_back(i); return false; });
+      stack.insert(stack.end(), c.rbegin(), c.rend());
+    }
+  }
+
+  if (!internal::xml_isEmpty(txt))
+    internal::xml_releaseAttributeValues(txt);
+}
+
+template <class X>
+const TextLayout_c & XHTMLTemplate_c<X>::instantiate(const std::map<std::string, std::string> & values,
+                                                     const TextStyleSheet_c & rules, const Shape_c & shape)
+{
+  for (auto & s : slots)
+  {
+    auto v = values.find(s.name);
+
+    if (v != values.end() && (!s.set || v->second != s.value))
+    {
+      internal::xml_setText(s.node, v->second);
+      s.value = v->second;
+      s.set = true;
+      inc.markDirty(s.node);
+    }
+  }
+
+  return inc.layout(rules, shape);
+}
+
+template <class X>
+std::vector<std::string> XHTMLTemplate_c<X>::getSlots(void) const
+{
+  std::vector<std::string> res;
+
+  for (const auto & s : slots)
+    res.push_back(s.name);
+
+  return res;
+}
+
 };
 
 #endif
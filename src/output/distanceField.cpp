@@ -0,0 +1,131 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#include <stll/internal/distanceField.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace STLL { namespace internal {
+
+static const double inf = 1e20;
+
+// one dimensional squared distance transform (Felzenszwalb and Huttenlocher) of the
+// n values starting at grid with the given stride, f, v and z are work arrays
+static void edt1d(double * grid, int n, int stride, std::vector<double> & f, std::vector<int> & v, std::vector<double> & z)
+{
+  f[0] = grid[0];
+  v[0] = 0;
+  z[0] = -inf;
+  z[1] = inf;
+
+  for (int q = 1, k = 0; q < n; q++)
+  {
+    f[q] = grid[q*stride];
+
+    double s;
+
+    // find the lower envelope of the parabolas
+    do
+    {
+      int r = v[k];
+      s = (f[q] - f[r] + q*q - r*r) / (q-r) / 2;
+    } while (s <= z[k] && --k > -1);
+
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k+1] = inf;
+  }
+
+  for (int q = 0, k = 0; q < n; q++)
+  {
+    while (z[k+1] < q) k++;
+
+    int r = v[k];
+    grid[q*stride] = f[r] + (q-r)*(q-r);
+  }
+}
+
+static void edt(std::vector<double> & grid, int w, int h)
+{
+  int n = std::max(w, h);
+
+  std::vector<double> f(n);
+  std::vector<int> v(n);
+  std::vector<double> z(n+1);
+
+  for (int x = 0; x < w; x++) edt1d(grid.data()+x, h, w, f, v, z);
+  for (int y = 0; y < h; y++) edt1d(grid.data()+y*w, w, 1, f, v, z);
+}
+
+void distanceField(const uint8_t * s, int pitch, int w, int h, uint8_t * d, int dpitch, int spread)
+{
+  int fw = w+2*spread;
+  int fh = h+2*spread;
+
+  // outer gets the squared distance to the inside of the shape, inner
+  // the squared distance to the outside. Anti aliased pixels are treated as if the
+  // outline goes through the pixel with the distance given by the coverage
+  std::vector<double> outer(fw*fh, inf);
+  std::vector<double> inner(fw*fh, 0);
+
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+    {
+      uint8_t a = s[y*pitch+x];
+      size_t i = (y+spread)*fw+x+spread;
+
+      if (a == 255)
+      {
+        outer[i] = 0;
+        inner[i] = inf;
+      }
+      else if (a > 0)
+      {
+        double c = a/255.0;
+        outer[i] = std::pow(std::max(0.0, 0.5-c), 2);
+        inner[i] = std::pow(std::max(0.0, c-0.5), 2);
+      }
+    }
+
+  edt(outer, fw, fh);
+  edt(inner, fw, fh);
+
+  for (int y = 0; y < fh; y++)
+    for (int x = 0; x < fw; x++)
+    {
+      size_t i = y*fw+x;
+      double dist = std::sqrt(inner[i]) - std::sqrt(outer[i]);
+
+      d[y*dpitch+x] = std::max(0.0, std::min(255.0, std::round(distanceFieldEdge + dist*127/spread)));
+    }
+}
+
+uint8_t distanceFieldCoverage(uint8_t v, int spread, double scale, double ramp)
+{
+  double dist = (v - distanceFieldEdge) * spread / 127.0 * scale;
+
+  return std::max(0.0, std::min(255.0, std::round(255*(dist/ramp + 0.5))));
+}
+
+} }
@@ -0,0 +1,246 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#include <stll/internal/glyphAtlas.h>
+#include <stll/internal/binaryIO.h>
+
+#include <fstream>
+#include <cstring>
+
+namespace STLL { namespace internal {
+
+static const char atlasMagic[8] = { 'S', 'T', 'L', 'L', 'A', 'T', 'L', 'S' };
+static const uint32_t atlasVersion = 1;
+
+// font index used in the file for rectangles
+static const uint32_t rectangleFont = UINT32_MAX;
+
+void PagedGlyphAtlas_c::addFont(const std::shared_ptr<FontFace_c> & f)
+{
+  auto & w = fonts[(intptr_t)f.get()];
+
+  if (w.lock() == f) return;
+
+  w = f;
+
+  // check if there are glyphs of this font in a loaded file
+  auto s = std::find_if(savedFonts.begin(), savedFonts.end(), [&f](const SavedFont_c & s) {
+    return s.size == f->getSize() && s.hash == f->getContentHash();
+  });
+
+  if (s != savedFonts.end())
+  {
+    intptr_t from = (intptr_t)s->tag.get();
+    intptr_t to = (intptr_t)f.get();
+
+    for (auto & p : pages)
+      p.atlas->changeKeys([from, to](GlyphKey_c k) {
+        if (k.font == from) k.font = to;
+        return k;
+      });
+
+    savedFonts.erase(s);
+  }
+}
+
+bool PagedGlyphAtlas_c::save(const std::string & filename) const
+{
+  // create the table of all fonts used within the keys, glyphs of fonts
+  // that have been destroyed in the meantime are not saved
+  const uint32_t unknownFont = UINT32_MAX-1;
+
+  std::vector<std::pair<uint64_t, uint32_t>> table;
+  std::unordered_map<intptr_t, uint32_t> index;
+
+  auto fontIndex = [&](intptr_t font) -> uint32_t {
+    if (font == 0) return rectangleFont;
+
+    auto i = index.find(font);
+    if (i != index.end()) return i->second;
+
+    uint32_t res = unknownFont;
+
+    auto f = fonts.find(font);
+    std::shared_ptr<FontFace_c> face;
+
+    if (f != fonts.end() && (face = f->second.lock()))
+    {
+      res = table.size();
+      table.emplace_back(face->getContentHash(), face->getSize());
+    }
+    else
+    {
+      for (auto & s : savedFonts)
+        if ((intptr_t)s.tag.get() == font)
+        {
+          res = table.size();
+          table.emplace_back(s.hash, s.size);
+        }
+    }
+
+    index[font] = res;
+    return res;
+  };
+
+  std::vector<uint32_t> counts;
+
+  for (auto & p : pages)
+  {
+    uint32_t c = 0;
+
+    for (auto & e : p.atlas->elements())
+      if (fontIndex(e.first.font) != unknownFont)
+        c++;
+
+    counts.push_back(c);
+  }
+
+  std::ofstream out(filename, std::ios::binary);
+
+  out.write(atlasMagic, sizeof(atlasMagic));
+  writeBinary(out, atlasVersion);
+  writeBinary(out, fieldSize);
+  writeBinary(out, spread);
+
+  writeBinary(out, (uint32_t)table.size());
+
+  for (auto & f : table)
+  {
+    writeBinary(out, f.first);
+    writeBinary(out, f.second);
+  }
+
+  writeBinary(out, (uint32_t)pages.size());
+  writeBinary(out, width());
+  writeBinary(out, height());
+
+  for (size_t p = 0; p < pages.size(); p++)
+  {
+    pages[p].atlas->save(out);
+
+    writeBinary(out, counts[p]);
+
+    for (auto & e : pages[p].atlas->elements())
+    {
+      uint32_t f = fontIndex(e.first.font);
+
+      if (f == unknownFont) continue;
+
+      writeBinary(out, f);
+      writeBinary(out, (uint32_t)e.first.glyphIndex);
+      writeBinary(out, (uint8_t)e.first.sp);
+      writeBinary(out, e.first.blurr);
+      writeBinary(out, e.first.w);
+      writeBinary(out, e.first.h);
+
+      writeBinary(out, e.second.pos_x);
+      writeBinary(out, e.second.pos_y);
+      writeBinary(out, e.second.rows);
+      writeBinary(out, e.second.width);
+      writeBinary(out, e.second.left);
+      writeBinary(out, e.second.top);
+    }
+  }
+
+  return (bool)out;
+}
+
+bool PagedGlyphAtlas_c::load(const std::string & filename)
+{
+  std::ifstream in(filename, std::ios::binary);
+
+  char magic[sizeof(atlasMagic)];
+  uint32_t version, fsize;
+  uint16_t fspread;
+
+  if (!in.read(magic, sizeof(magic)) || memcmp(magic, atlasMagic, sizeof(magic)) != 0) return false;
+  if (!readBinary(in, version) || version != atlasVersion) return false;
+  if (!readBinary(in, fsize) || !readBinary(in, fspread)) return false;
+
+  // the images are only useful, when they have been created with the same settings
+  if (fsize != fieldSize || fspread != spread) return false;
+
+  uint32_t fontCount;
+  if (!readBinary(in, fontCount) || fontCount > 1000000) return false;
+
+  std::vector<SavedFont_c> sf(fontCount);
+
+  for (auto & f : sf)
+  {
+    if (!readBinary(in, f.hash) || !readBinary(in, f.size)) return false;
+    f.tag = std::make_unique<uint8_t>();
+  }
+
+  uint32_t pageCount, w, h;
+
+  if (!readBinary(in, pageCount) || !readBinary(in, w) || !readBinary(in, h)) return false;
+  if (pageCount < 1 || pageCount > maxPages) return false;
+  if (w == 0 || w != h || w > std::max(maxSize, width())) return false;
+
+  std::vector<Page_c> np;
+
+  for (uint32_t p = 0; p < pageCount; p++)
+  {
+    auto a = std::make_unique<GlyphAtlas_c>(w, h, spread);
+
+    uint32_t count;
+
+    if (!a->load(in) || !readBinary(in, count)) return false;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+      uint32_t font, glyph;
+      uint8_t sp;
+      GlyphKey_c k(0, 0, SUBP_NONE, 0);
+      FontAtlasData_c d;
+
+      if (   !readBinary(in, font) || !readBinary(in, glyph) || !readBinary(in, sp)
+          || !readBinary(in, k.blurr) || !readBinary(in, k.w) || !readBinary(in, k.h)
+          || !readBinary(in, d.pos_x) || !readBinary(in, d.pos_y) || !readBinary(in, d.rows)
+          || !readBinary(in, d.width) || !readBinary(in, d.left) || !readBinary(in, d.top))
+        return false;
+
+      if (font != rectangleFont && font >= sf.size()) return false;
+      if (sp > SUBP_BGR_V) return false;
+      if (d.pos_x > w || d.width > w-d.pos_x || d.pos_y > h || d.rows > h-d.pos_y) return false;
+
+      k.font = font == rectangleFont ? 0 : (intptr_t)sf[font].tag.get();
+      k.glyphIndex = glyph;
+      k.sp = (SubPixelArrangement)sp;
+
+      a->restore(k, d);
+    }
+
+    np.push_back(Page_c { std::move(a), 0, nextId++, 0 });
+  }
+
+  pages.swap(np);
+  current = pages.size()-1;
+  savedFonts.swap(sf);
+
+  // fonts have to register again so that the glyphs of the file can be assigned to them
+  fonts.clear();
+  lastFont.reset();
+
+  return true;
+}
+
+} }
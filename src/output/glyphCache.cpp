@@ -35,29 +35,163 @@
 
 #include <unordered_map>
 #include <algorithm>
+#include <cstring>
 
 // TODO properly handle it, when FreeType returns an bitmap format that is not supported
 
 namespace STLL { namespace internal {
 
+// images smaller than this are never span encoded, it doesn't save much
+// and the bytemap blitters are faster on small images
+static const int minSpanImage = 1024;
+
+// number of equal values that are worth a run of their own, shorter
+// sequences are included in the surrounding literal run
+static const int minSpanRun = 4;
+
+// span encode one row of an image, when out is nullptr only the size is calculated
+static size_t encodeRow(const uint8_t * in, int len, uint8_t * out)
+{
+  size_t size = 0;
+
+  auto header = [&size, &out](int kind, int l) -> void {
+    if (out)
+    {
+      out[size] = l & 0xFF;
+      out[size+1] = (kind << 6) | (l >> 8);
+    }
+    size += 2;
+  };
+
+  // length of the run of equal values starting at position i
+  auto runLength = [in, len](int i) -> int {
+    int j = i+1;
+    while (j < len && j-i < SPAN_MAXLEN && in[j] == in[i]) j++;
+    return j-i;
+  };
+
+  int i = 0;
+
+  while (i < len)
+  {
+    int l = runLength(i);
+
+    if ((in[i] == 0 || in[i] == 255) && l >= minSpanRun)
+    {
+      header(in[i] == 0 ? SPAN_EMPTY : SPAN_FULL, l);
+      i += l;
+    }
+    else
+    {
+      // literal run up to the next run of 0 or 255 values that is long enough
+      int j = i;
+
+      while (j < len && j-i < SPAN_MAXLEN)
+      {
+        int k = runLength(j);
+
+        if ((in[j] == 0 || in[j] == 255) && k >= minSpanRun) break;
+
+        j += std::min(k, SPAN_MAXLEN-(j-i));
+      }
+
+      header(SPAN_LITERAL, j-i);
+      if (out) memcpy(out+size, in+i, j-i);
+      size += j-i;
+      i = j;
+    }
+  }
+
+  return size;
+}
+
+void PaintData_c::store(const uint8_t * img, SlabAllocator_c & mem)
+{
+  size_t size = rows*sizeof(uint32_t);
+
+  for (int y = 0; y < rows; y++)
+    size += encodeRow(img+y*pitch, pitch, nullptr);
+
+  // only use the spans when we save at least a quarter of the memory
+  if (4*size > (size_t)(3*pitch*rows))
+  {
+    std::tie(buffer, slab) = mem.allocate(pitch*rows);
+    memcpy(buffer, img, pitch*rows);
+    return;
+  }
+
+  std::tie(buffer, slab) = mem.allocate(size);
+
+  size_t pos = rows*sizeof(uint32_t);
+
+  for (int y = 0; y < rows; y++)
+  {
+    uint32_t p = pos;
+    memcpy(buffer+y*sizeof(uint32_t), &p, sizeof(uint32_t));
+    pos += encodeRow(img+y*pitch, pitch, buffer+pos);
+  }
+
+  spans = true;
+}
+
 // create from glyph data
-PaintData_c::PaintData_c(const FontFace_c::GlyphSlot_c & ft, uint16_t blurr, SubPixelArrangement sp)
+PaintData_c::PaintData_c(const FontFace_c::GlyphSlot_c & ft, uint16_t blurr, SubPixelArrangement sp, SlabAllocator_c & mem,
+                         std::vector<uint8_t> * scratch) : spans(false)
 {
+  // images that might get span encoded are first created in the scratch buffer
   std::tie(left, top, width, pitch, rows) = glyphPrepare(ft, blurr, sp, 0,
-    [this](int w, int h, int, int) -> auto {
-      buffer = std::make_unique<uint8_t[]>(w*h);
-      return std::make_tuple(buffer.get(), w);});
+    [this, &mem, scratch](int w, int h, int, int) -> auto {
+      if (scratch && w*h >= minSpanImage)
+      {
+        scratch->assign(w*h, 0);
+        return std::make_tuple(scratch->data(), w);
+      }
+      std::tie(buffer, slab) = mem.allocate(w*h);
+      return std::make_tuple(buffer, w);});
+
+  if (scratch && pitch*rows >= minSpanImage) store(scratch->data(), mem);
 }
 
 // create rectangle data
-PaintData_c::PaintData_c(uint16_t _pitch, uint16_t _rows, uint16_t blurr, SubPixelArrangement sp)
+PaintData_c::PaintData_c(uint16_t _pitch, uint16_t _rows, uint16_t blurr, SubPixelArrangement sp, SlabAllocator_c & mem,
+                         std::vector<uint8_t> * scratch) : spans(false)
 {
   FontFace_c::GlyphSlot_c ft(_pitch, _rows);
 
   std::tie(left, top, width, pitch, rows) = glyphPrepare(ft, blurr, sp, 0,
-    [this](int w, int h, int, int) -> auto {
-      buffer = std::make_unique<uint8_t[]>(w*h);
-      return std::make_tuple(buffer.get(), w);});
+    [this, &mem, scratch](int w, int h, int, int) -> auto {
+      if (scratch && w*h >= minSpanImage)
+      {
+        scratch->assign(w*h, 0);
+        return std::make_tuple(scratch->data(), w);
+      }
+      std::tie(buffer, slab) = mem.allocate(w*h);
+      return std::make_tuple(buffer, w);});
+
+  if (scratch && pitch*rows >= minSpanImage) store(scratch->data(), mem);
+}
+
+template <class K, class F>
+PaintData_c & GlyphCache_c::add(const GlyphKey_c & k, K key, F create)
+{
+  if (!shared)
+    return glyphCache.insert(std::make_pair(k, create())).first->second;
+
+  auto sk = key();
+  PaintData_c d;
+
+  if (!shared->find(sk, d))
+  {
+    d = create();
+
+    // when the image is now in the shared memory, we don't need our copy any more
+    uint8_t * b = d.buffer;
+    uint32_t s = d.slab;
+
+    if (shared->insert(sk, d)) memory.free(b, s);
+  }
+
+  return glyphCache.insert(std::make_pair(k, d)).first->second;
 }
 
 // get the glyph from the cache, or render new using FreeType
@@ -67,17 +201,15 @@ PaintData_c & GlyphCache_c::getGlyph(std::shared_ptr<FontFace_c> face, glyphInde
 
   auto i = glyphCache.find(k);
 
-  if (i == glyphCache.end())
-  {
-    auto g = face->renderGlyph(glyph, sp);
+  PaintData_c & d = (i != glyphCache.end()) ? i->second :
+    add(k, [&]() { return SharedGlyphKey_c(face, glyph, sp, blurr, outlines); },
+           [&]() { return PaintData_c(outlines ? face->renderOutline(glyph, sp) : face->renderGlyph(glyph, sp),
+                                      blurr, sp, memory, compress ? &scratch : nullptr); });
 
-    i = glyphCache.insert(std::make_pair(k, std::move(PaintData_c(g, blurr, sp)))).first;
-  }
-
-  i->second.lastUse = useCounter;
+  d.lastUse = useCounter;
   useCounter++;
 
-  return i->second;
+  return d;
 }
 
 PaintData_c & GlyphCache_c::getRect(int w, int h, SubPixelArrangement sp, uint16_t blurr)
@@ -86,12 +218,25 @@ PaintData_c & GlyphCache_c::getRect(int w, int h, SubPixelArrangement sp, uint16
 
   auto i = glyphCache.find(k);
 
-  if (i == glyphCache.end())
+  if (i != glyphCache.end()) return i->second;
+
+  return add(k, [&]() { return SharedGlyphKey_c(k.w, k.h, k.sp, k.blurr); },
+                [&]() { return PaintData_c(k.w, k.h, k.blurr, k.sp, memory, compress ? &scratch : nullptr); });
+}
+
+void GlyphCache_c::setShared(std::shared_ptr<SharedGlyphCache_c> s)
+{
+  trim(0);
+  shared = s;
+}
+
+void GlyphCache_c::setOutlineRendering(bool o)
+{
+  if (o != outlines)
   {
-    i = glyphCache.insert(std::make_pair(k, std::move(PaintData_c(k.w, k.h, k.blurr, k.sp)))).first;
+    trim(0);
+    outlines = o;
   }
-
-  return i->second;
 }
 
 void GlyphCache_c::trim(size_t num)
@@ -99,6 +244,7 @@ void GlyphCache_c::trim(size_t num)
   if (num == 0)
   {
     glyphCache.clear();
+    memory.clear();
   }
   else if (num < glyphCache.size())
   {
@@ -117,7 +263,12 @@ void GlyphCache_c::trim(size_t num)
     size_t toDel = glyphCache.size() - num;
 
     for (size_t i = 0; i < toDel; i++)
+    {
+      // images in the shared cache stay there
+      if (!shared || !shared->contains(entries[i]->second.buffer))
+        memory.free(entries[i]->second.buffer, entries[i]->second.slab);
       glyphCache.erase(entries[i]);
+    }
   }
 }
 
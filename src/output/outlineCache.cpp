@@ -0,0 +1,367 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stll/internal/outlineCache.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+
+#include <algorithm>
+#include <initializer_list>
+#include <cmath>
+#include <cstdlib>
+
+namespace STLL { namespace internal {
+
+void CoverageRasterizer_c::reset(int width, int height)
+{
+  w = width;
+  h = height;
+
+  // the lines may touch the pixel right of the last one, this is added to the start
+  // of the next row, which doesn't matter, as every row adds up to zero
+  acc.assign(w*h+4, 0);
+}
+
+void CoverageRasterizer_c::line(float x0, float y0, float x1, float y1)
+{
+  if (y0 == y1) return;
+
+  float dir = 1;
+
+  if (y0 > y1)
+  {
+    dir = -1;
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+
+  float dxdy = (x1-x0)/(y1-y0);
+  float x = x0;
+
+  if (y0 < 0)
+  {
+    x -= y0*dxdy;
+    y0 = 0;
+  }
+
+  int yend = std::min(h, (int)std::ceil(y1));
+
+  for (int y = (int)y0; y < yend; y++)
+  {
+    float * row = acc.data() + y*w;
+    float dy = std::min((float)(y+1), y1) - std::max((float)y, y0);
+    float xnext = x + dxdy*dy;
+    float d = dy*dir;
+
+    float xa = std::min(std::max(std::min(x, xnext), 0.0f), (float)w);
+    float xb = std::min(std::max(std::max(x, xnext), 0.0f), (float)w);
+
+    float xafloor = std::floor(xa);
+    int xai = (int)xafloor;
+    float xbceil = std::ceil(xb);
+    int xbi = (int)xbceil;
+
+    if (xbi <= xai+1)
+    {
+      // the line is within one pixel column
+      float xmf = 0.5f*(xa+xb) - xafloor;
+      row[xai] += d - d*xmf;
+      row[xai+1] += d*xmf;
+    }
+    else
+    {
+      // the line crosses several columns, the first and last get a triangle, the ones
+      // in between trapezoids of the same size
+      float s = 1.0f/(xb-xa);
+      float xaf = xa - xafloor;
+      float a0 = 0.5f*s*(1-xaf)*(1-xaf);
+      float xbf = xb - xbceil + 1;
+      float am = 0.5f*s*xbf*xbf;
+
+      row[xai] += d*a0;
+
+      if (xbi == xai+2)
+      {
+        row[xai+1] += d*(1-a0-am);
+      }
+      else
+      {
+        float a1 = s*(1.5f-xaf);
+        row[xai+1] += d*(a1-a0);
+
+        for (int xi = xai+2; xi < xbi-1; xi++)
+          row[xi] += d*s;
+
+        float a2 = a1 + (xbi-xai-3)*s;
+        row[xbi-1] += d*(1-a2-am);
+      }
+
+      row[xbi] += d*am;
+    }
+
+    x = xnext;
+  }
+}
+
+void CoverageRasterizer_c::finish(uint8_t * out, int pitch)
+{
+  float sum = 0;
+
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+    {
+      sum += acc[y*w+x];
+
+      // overlapping contours add up to more than 1
+      float c = std::min(std::fabs(sum), 1.0f);
+      out[y*pitch+x] = (uint8_t)(c*255 + 0.5f);
+    }
+}
+
+// add a command of a decomposed FreeType outline
+static int addCommand(void * u, uint8_t cmd, std::initializer_list<const FT_Vector *> p)
+{
+  GlyphOutline_c * o = static_cast<GlyphOutline_c*>(u);
+
+  o->commands.push_back(cmd);
+
+  for (auto v : p)
+  {
+    o->points.push_back(v->x);
+    o->points.push_back(v->y);
+  }
+
+  return 0;
+}
+
+const GlyphOutline_c & OutlineCache_c::getOutline(FT_FaceRec_ * face, glyphIndex_t glyphIndex)
+{
+  auto i = outlines.find(glyphIndex);
+
+  if (i != outlines.end()) return i->second;
+
+  GlyphOutline_c & o = outlines[glyphIndex];
+
+  if (   FT_Load_Glyph(face, glyphIndex, FT_LOAD_NO_SCALE | FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP)
+      || face->glyph->format != FT_GLYPH_FORMAT_OUTLINE)
+  {
+    return o;
+  }
+
+  FT_Outline_Funcs funcs;
+
+  funcs.move_to = [](const FT_Vector * to, void * u) -> int {
+    return addCommand(u, GlyphOutline_c::OUTLINE_MOVE, { to });
+  };
+  funcs.line_to = [](const FT_Vector * to, void * u) -> int {
+    return addCommand(u, GlyphOutline_c::OUTLINE_LINE, { to });
+  };
+  funcs.conic_to = [](const FT_Vector * c, const FT_Vector * to, void * u) -> int {
+    return addCommand(u, GlyphOutline_c::OUTLINE_CONIC, { c, to });
+  };
+  funcs.cubic_to = [](const FT_Vector * c1, const FT_Vector * c2, const FT_Vector * to, void * u) -> int {
+    return addCommand(u, GlyphOutline_c::OUTLINE_CUBIC, { c1, c2, to });
+  };
+  funcs.shift = 0;
+  funcs.delta = 0;
+
+  if (FT_Outline_Decompose(&face->glyph->outline, &funcs, &o))
+  {
+    o.commands.clear();
+    o.points.clear();
+    return o;
+  }
+
+  FT_BBox box;
+  FT_Outline_Get_CBox(&face->glyph->outline, &box);
+
+  o.xmin = box.xMin;
+  o.ymin = box.yMin;
+  o.xmax = box.xMax;
+  o.ymax = box.yMax;
+  o.valid = true;
+
+  return o;
+}
+
+FontFace_c::GlyphSlot_c OutlineCache_c::render(FT_FaceRec_ * face, glyphIndex_t glyphIndex, uint32_t ppem,
+                                               SubPixelArrangement sp, int32_t dx)
+{
+  const GlyphOutline_c & o = getOutline(face, glyphIndex);
+
+  FontFace_c::GlyphSlot_c res(0, 0);
+
+  if (!o.valid || o.commands.empty()) return res;
+
+  bool lcd = sp == SUBP_RGB || sp == SUBP_BGR;
+
+  // scale from font units into 1/64 pixels, this is done with the same 16.16 fixed point
+  // calculation as within FreeType, that way the bounding boxes are the same
+  int64_t scale = (((int64_t)ppem << 16) + face->units_per_EM/2) / face->units_per_EM;
+  int hs = lcd ? 3 : 1;
+
+  auto mul = [scale](int32_t v) -> int32_t {
+    int64_t r = (std::abs((int64_t)v)*scale + 0x8000) >> 16;
+    return (int32_t)(v < 0 ? -r : r);
+  };
+
+  auto sx = [&mul, dx](int32_t x) -> int32_t { return mul(x) + dx; };
+  auto sy = [&mul](int32_t y) -> int32_t { return mul(y); };
+
+  // the filter for sub-pixel output spreads each value to 2 neighbours on each side, so
+  // the image gets 2/3 pixel wider on each side
+  int32_t pad = lcd ? 43 : 0;
+
+  int32_t left = ((sx(o.xmin) - pad) & ~63) / 64;
+  int32_t right = ((sx(o.xmax) + pad + 63) & ~63) / 64;
+  int32_t bottom = (sy(o.ymin) & ~63) / 64;
+  int32_t top = ((sy(o.ymax) + 63) & ~63) / 64;
+
+  int w = (right-left)*hs;
+  int h = top-bottom;
+
+  if (w <= 0 || h <= 0) return res;
+
+  rasterizer.reset(w, h);
+
+  // position of a point within the image in pixels
+  auto px = [&](int32_t x) -> float { return (sx(x) - left*64) * hs / 64.0f; };
+  auto py = [&](int32_t y) -> float { return (top*64 - sy(y)) / 64.0f; };
+
+  // curves are split into lines, a curve with the second difference d deviates at most d/4 from
+  // its chord, with n lines it is d/(4*n*n), keep that below 1/16th of a pixel
+  auto segments = [](float dd) -> int {
+    return std::min(100, 1 + (int)std::sqrt(4*std::sqrt(dd)));
+  };
+
+  float x0 = 0, y0 = 0, xs = 0, ys = 0;
+  size_t p = 0;
+
+  for (auto c : o.commands)
+  {
+    switch (c)
+    {
+      case GlyphOutline_c::OUTLINE_MOVE:
+        rasterizer.line(x0, y0, xs, ys);
+        xs = x0 = px(o.points[p]);
+        ys = y0 = py(o.points[p+1]);
+        p += 2;
+        break;
+
+      case GlyphOutline_c::OUTLINE_LINE:
+        {
+          float x1 = px(o.points[p]);
+          float y1 = py(o.points[p+1]);
+          rasterizer.line(x0, y0, x1, y1);
+          x0 = x1;
+          y0 = y1;
+          p += 2;
+        }
+        break;
+
+      case GlyphOutline_c::OUTLINE_CONIC:
+        {
+          float cx = px(o.points[p]), cy = py(o.points[p+1]);
+          float x2 = px(o.points[p+2]), y2 = py(o.points[p+3]);
+          float ddx = x0 - 2*cx + x2, ddy = y0 - 2*cy + y2;
+          int n = segments(ddx*ddx + ddy*ddy);
+          float xa = x0, ya = y0;
+
+          for (int i = 1; i <= n; i++)
+          {
+            float t = (float)i/n, u = 1-t;
+            float x1 = u*u*xa + 2*u*t*cx + t*t*x2;
+            float y1 = u*u*ya + 2*u*t*cy + t*t*y2;
+            rasterizer.line(x0, y0, x1, y1);
+            x0 = x1;
+            y0 = y1;
+          }
+          p += 4;
+        }
+        break;
+
+      case GlyphOutline_c::OUTLINE_CUBIC:
+        {
+          float c1x = px(o.points[p]), c1y = py(o.points[p+1]);
+          float c2x = px(o.points[p+2]), c2y = py(o.points[p+3]);
+          float x3 = px(o.points[p+4]), y3 = py(o.points[p+5]);
+          float ddx = std::max(std::fabs(x0 - 2*c1x + c2x), std::fabs(c1x - 2*c2x + x3));
+          float ddy = std::max(std::fabs(y0 - 2*c1y + c2y), std::fabs(c1y - 2*c2y + y3));
+          int n = segments(2.25f*(ddx*ddx + ddy*ddy));
+          float xa = x0, ya = y0;
+
+          for (int i = 1; i <= n; i++)
+          {
+            float t = (float)i/n, u = 1-t;
+            float x1 = u*u*u*xa + 3*u*u*t*c1x + 3*u*t*t*c2x + t*t*t*x3;
+            float y1 = u*u*u*ya + 3*u*u*t*c1y + 3*u*t*t*c2y + t*t*t*y3;
+            rasterizer.line(x0, y0, x1, y1);
+            x0 = x1;
+            y0 = y1;
+          }
+          p += 6;
+        }
+        break;
+    }
+  }
+
+  // close the last contour
+  rasterizer.line(x0, y0, xs, ys);
+
+  bitmap.resize(w*h);
+  rasterizer.finish(bitmap.data(), w);
+
+  if (lcd)
+  {
+    // the default FreeType LCD filter
+    static const int weights[5] = { 0x08, 0x4D, 0x56, 0x4D, 0x08 };
+
+    filtered.assign(w*h, 0);
+
+    for (int y = 0; y < h; y++)
+      for (int x = 0; x < w; x++)
+      {
+        int sum = 0;
+
+        for (int k = 0; k < 5; k++)
+          if (x+k-2 >= 0 && x+k-2 < w)
+            sum += weights[k]*bitmap[y*w+x+k-2];
+
+        filtered[y*w+x] = std::min(255, sum >> 8);
+      }
+
+    bitmap.swap(filtered);
+  }
+
+  res.w = w;
+  res.h = h;
+  res.left = left;
+  res.top = top;
+  res.pitch = w;
+  res.data = bitmap.data();
+
+  return res;
+}
+
+} }
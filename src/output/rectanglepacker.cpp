@@ -20,6 +20,9 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  */
 #include <stll/internal/rectanglePacker.h>
+#include <stll/internal/binaryIO.h>
+
+#include <algorithm>
 
 namespace STLL { namespace internal {
 
@@ -132,4 +135,271 @@ void RectanglePacker_c::doubleSize(void)
   skylines.push_back(skyline {width_-1, height_});
 }
 
+void RectanglePacker_c::save(std::ostream & out) const
+{
+  writeBinary(out, (int32_t)width_);
+  writeBinary(out, (int32_t)height_);
+  writeBinary(out, (uint32_t)skylines.size());
+
+  for (auto & s : skylines)
+  {
+    writeBinary(out, (int32_t)s.x);
+    writeBinary(out, (int32_t)s.y);
+  }
+}
+
+bool RectanglePacker_c::load(std::istream & in)
+{
+  int32_t w, h;
+  uint32_t n;
+
+  if (!readBinary(in, w) || !readBinary(in, h) || !readBinary(in, n)) return false;
+  if (w <= 0 || h <= 0 || n < 2 || n > (uint32_t)w+1) return false;
+
+  std::vector<skyline> s(n);
+
+  for (uint32_t i = 0; i < n; i++)
+  {
+    int32_t x, y;
+    if (!readBinary(in, x) || !readBinary(in, y)) return false;
+
+    // the sections must be sorted and inside of the area
+    if (x < 0 || x >= w || y < 0 || y > h) return false;
+    if (i > 0 && x <= s[i-1].x) return false;
+
+    s[i].x = x;
+    s[i].y = y;
+  }
+
+  width_ = w;
+  height_ = h;
+  skylines.swap(s);
+
+  return true;
+}
+
+// round up the height so that at most 1/8th of it is wasted
+uint32_t ShelfPacker_c::heightClass(uint32_t h)
+{
+  uint32_t step = 1;
+  while (step*16 <= h) step *= 2;
+
+  return (h+step-1) / step * step;
+}
+
+ShelfPacker_c::ShelfPacker_c(int width, int height) : width_(width), height_(height)
+{
+  clear();
+}
+
+void ShelfPacker_c::clear(void)
+{
+  shelves.clear();
+  classes.clear();
+  empty.clear();
+  top = 1;
+}
+
+ShelfPacker_c::Shelf_c & ShelfPacker_c::newShelf(uint32_t y, uint32_t h)
+{
+  auto & s = shelves[y];
+  s = Shelf_c { h, (uint32_t)width_-2, (uint32_t)width_-2, { Span_c { 1, (uint32_t)width_-2 } } };
+  return s;
+}
+
+// recalculate the widest free span of a shelf and move the shelf to the right place
+// within its class, this must be called whenever the free spans of a used shelf change
+void ShelfPacker_c::updateClass(uint32_t y, Shelf_c & s)
+{
+  auto & c = classes[s.h];
+  c.erase(std::make_pair(s.maxSpan, y));
+
+  s.maxSpan = 0;
+  for (auto & i : s.spans)
+    s.maxSpan = std::max(s.maxSpan, i.w);
+
+  if (s.maxSpan > 0) c.emplace(s.maxSpan, y);
+}
+
+// place the rectangle in the first free span that is wide enough, the caller
+// has to make sure that there is one
+std::array<uint32_t, 2> ShelfPacker_c::allocateOnShelf(uint32_t y, Shelf_c & s, uint32_t w)
+{
+  auto i = std::find_if(s.spans.begin(), s.spans.end(), [w](const Span_c & a) { return a.w >= w; });
+  uint32_t x = i->x;
+
+  i->x += w;
+  i->w -= w;
+
+  if (i->w == 0) s.spans.erase(i);
+
+  s.freeWidth -= w;
+  updateClass(y, s);
+
+  return std::array<uint32_t, 2>{x, y};
+}
+
+// use the shelf of the class with the narrowest free span that is still wide enough
+std::experimental::optional<std::array<uint32_t, 2>> ShelfPacker_c::allocateInClass(uint32_t hc, uint32_t w)
+{
+  auto c = classes.find(hc);
+  if (c == classes.end()) return std::experimental::optional<std::array<uint32_t, 2>>();
+
+  auto i = c->second.lower_bound(std::make_pair(w, (uint32_t)0));
+  if (i == c->second.end()) return std::experimental::optional<std::array<uint32_t, 2>>();
+
+  uint32_t y = i->second;
+  return allocateOnShelf(y, shelves[y], w);
+}
+
+std::experimental::optional<std::array<uint32_t, 2>> ShelfPacker_c::allocate(uint32_t w, uint32_t h)
+{
+  // empty rectangles don't occupy anything
+  if (w == 0 || h == 0) return std::array<uint32_t, 2>{1, 1};
+
+  if (w+2 > (uint32_t)width_) return std::experimental::optional<std::array<uint32_t, 2>>();
+
+  uint32_t hc = heightClass(h);
+
+  // first try the shelves of the height class
+  auto r = allocateInClass(hc, w);
+  if (r) return r;
+
+  // then the smallest empty shelf that is high enough, the remainder of that
+  // shelf stays an empty shelf
+  auto e = empty.lower_bound(std::make_pair(hc, (uint32_t)0));
+
+  if (e != empty.end())
+  {
+    uint32_t y = e->second;
+    empty.erase(e);
+
+    auto & s = shelves[y];
+
+    if (s.h > hc)
+    {
+      empty.emplace(s.h-hc, y+hc);
+      newShelf(y+hc, s.h-hc);
+      s.h = hc;
+    }
+
+    return allocateOnShelf(y, s, w);
+  }
+
+  // then a new shelf in the unused area, the last shelf may be lower than the height
+  // class as long as the rectangle fits
+  if (top+h+1 < (uint32_t)height_)
+  {
+    uint32_t sh = std::min(hc, height_-2-top);
+    uint32_t y = top;
+
+    top += sh;
+
+    return allocateOnShelf(y, newShelf(y, sh), w);
+  }
+
+  // finally try shelves of higher classes, wasting some space
+  for (auto c = classes.upper_bound(hc); c != classes.end() && c->first <= 2*hc; ++c)
+  {
+    r = allocateInClass(c->first, w);
+    if (r) return r;
+  }
+
+  return std::experimental::optional<std::array<uint32_t, 2>>();
+}
+
+void ShelfPacker_c::deallocate(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+  if (w == 0 || h == 0) return;
+
+  auto it = shelves.find(y);
+  if (it == shelves.end()) return;
+
+  auto & s = it->second;
+
+  // put the span back into the free list and merge it with its neighbours
+  auto i = std::lower_bound(s.spans.begin(), s.spans.end(), x, [](const Span_c & a, uint32_t b) { return a.x < b; });
+  i = s.spans.insert(i, Span_c { x, w });
+
+  if (i+1 != s.spans.end() && i->x+i->w == (i+1)->x)
+  {
+    i->w += (i+1)->w;
+    s.spans.erase(i+1);
+  }
+
+  if (i != s.spans.begin() && (i-1)->x+(i-1)->w == i->x)
+  {
+    (i-1)->w += i->w;
+    s.spans.erase(i);
+  }
+
+  s.freeWidth += w;
+  updateClass(y, s);
+
+  if (s.freeWidth < (uint32_t)width_-2) return;
+
+  // the shelf is completely free, it leaves its class and is combined with the
+  // neighbouring free shelves
+  classes[s.h].erase(std::make_pair(s.maxSpan, y));
+
+  auto next = shelves.find(y+s.h);
+
+  if (next != shelves.end() && empty.erase(std::make_pair(next->second.h, next->first)))
+  {
+    s.h += next->second.h;
+    shelves.erase(next);
+  }
+
+  if (it != shelves.begin())
+  {
+    auto prev = std::prev(it);
+
+    if (empty.erase(std::make_pair(prev->second.h, prev->first)))
+    {
+      prev->second.h += s.h;
+      shelves.erase(it);
+      it = prev;
+    }
+  }
+
+  // when the shelf is the last one, we give the space back to the unused area
+  if (it->first+it->second.h == top)
+  {
+    top = it->first;
+    shelves.erase(it);
+  }
+  else
+  {
+    empty.emplace(it->second.h, it->first);
+  }
+}
+
+void ShelfPacker_c::doubleSize(void)
+{
+  uint32_t oldW = width_-2;
+
+  width_ *= 2;
+  height_ *= 2;
+
+  uint32_t add = width_-2-oldW;
+
+  // the area right of the old border becomes free on all shelves
+  for (auto & i : shelves)
+  {
+    auto & sh = i.second;
+
+    if (!sh.spans.empty() && sh.spans.back().x+sh.spans.back().w == oldW+1)
+      sh.spans.back().w += add;
+    else
+      sh.spans.push_back(Span_c { oldW+1, add });
+
+    sh.freeWidth += add;
+
+    if (empty.count(std::make_pair(sh.h, i.first)))
+      sh.maxSpan = width_-2;
+    else
+      updateClass(i.first, sh);
+  }
+}
+
 } }
@@ -0,0 +1,371 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stll/internal/sharedGlyphCache.h>
+#include <stll/internal/glyphCache.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <new>
+
+namespace STLL { namespace internal {
+
+// the atomics are used by several processes, so they must not use a lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared glyph cache requires lock free atomics");
+
+static const uint64_t sharedMagic = 0x53544c4c474c5948ull;  // "STLLGLYH"
+static const uint32_t sharedVersion = 1;
+
+// maximal number of slots that are checked for a key, when the table is that full
+// around a key the image is not cached in the segment
+static const uint32_t maxProbe = 64;
+
+// number of times to yield to other threads while waiting for a process that writes an entry,
+// if that process died we need to give up at some point
+static const int maxWait = 10000;
+
+// the states of a slot, the state is only valid when the tag is not 0
+enum
+{
+  SLOT_WRITING = 0,
+  SLOT_READY = 1,
+  SLOT_FAILED = 2
+};
+
+class SharedGlyphCache_c::Header_c
+{
+  public:
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint64_t arenaSize;
+    std::atomic<uint64_t> arenaUsed;
+    std::atomic<uint32_t> ready;
+};
+
+class SharedGlyphCache_c::Slot_c
+{
+  public:
+    std::atomic<uint64_t> tag;      // hash of the key, 0 marks an empty slot
+    std::atomic<uint32_t> state;
+
+    // the key
+    glyphIndex_t glyphIndex;
+    uint64_t font;
+    uint32_t size;
+    uint16_t blurr, w, h;
+    uint8_t sp;
+    uint8_t outline;
+
+    // the image, the data is at offset within the arena
+    uint8_t spans;
+    int32_t left, top, rows, width, pitch;
+    uint64_t offset;
+};
+
+static size_t align8(size_t s) { return (s + 7) & ~(size_t)7; }
+
+uint64_t SharedGlyphKey_c::hash(void) const
+{
+  // 64 bit FNV-1a over the fields
+  uint64_t r = 14695981039346656037ull;
+
+  auto add = [&r](uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++)
+      r = (r ^ ((v >> (8*i)) & 0xFF)) * 1099511628211ull;
+  };
+
+  add(font, 8);
+  add(size, 4);
+  add(glyphIndex, 4);
+  add(sp, 1);
+  add(blurr, 2);
+  add(w, 2);
+  add(h, 2);
+  add(outline, 1);
+
+  // 0 marks empty slots
+  return r ? r : 1;
+}
+
+// number of bytes of the image data
+static size_t imageSize(const PaintData_c & p)
+{
+  if (!p.spans) return p.pitch*p.rows;
+
+  // span encoded images end with the runs of the last row, they cover the whole pitch
+  const uint8_t * r = p.getSpans(p.rows-1);
+  int covered = 0;
+
+  while (covered < p.pitch)
+  {
+    int kind = r[1] >> 6;
+    int len = ((r[1] & 0x3F) << 8) | r[0];
+
+    r += 2;
+    if (kind == SPAN_LITERAL) r += len;
+    covered += len;
+  }
+
+  return r - p.buffer;
+}
+
+SharedGlyphCache_c::SharedGlyphCache_c(int f, uint8_t * b, size_t m) : fd(f), base(b), mapped(m)
+{
+  header = reinterpret_cast<Header_c*>(base);
+  slots = reinterpret_cast<Slot_c*>(base + align8(sizeof(Header_c)));
+  arena = reinterpret_cast<uint8_t*>(slots + header->slots);
+}
+
+SharedGlyphCache_c::~SharedGlyphCache_c(void)
+{
+  munmap(base, mapped);
+  close(fd);
+}
+
+std::shared_ptr<SharedGlyphCache_c> SharedGlyphCache_c::open(const std::string & name, size_t bytes)
+{
+  // roughly one slot for each 2KB of images
+  uint32_t n = std::max<size_t>(64, bytes/2048);
+  size_t table = align8(sizeof(Header_c)) + n*sizeof(Slot_c);
+
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  bool create = fd >= 0;
+
+  if (!create)
+  {
+    if (errno != EEXIST) return nullptr;
+
+    fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) return nullptr;
+  }
+  else if (bytes <= table || ftruncate(fd, bytes) != 0)
+  {
+    close(fd);
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+
+  // when another process created the segment, wait until it has the final size
+  struct stat st;
+
+  for (int i = 0; ; i++)
+  {
+    if (fstat(fd, &st) != 0 || i == maxWait)
+    {
+      close(fd);
+      return nullptr;
+    }
+
+    if ((size_t)st.st_size >= sizeof(Header_c)) break;
+
+    std::this_thread::yield();
+  }
+
+  size_t mapped = st.st_size;
+  void * m = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (m == MAP_FAILED)
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  uint8_t * base = static_cast<uint8_t*>(m);
+  Header_c * h = reinterpret_cast<Header_c*>(base);
+
+  if (create)
+  {
+    // the new segment is filled with zeros, so all slots are empty
+    new (h) Header_c;
+    h->magic = sharedMagic;
+    h->version = sharedVersion;
+    h->slots = n;
+    h->arenaSize = bytes - table;
+    h->arenaUsed.store(0);
+
+    Slot_c * s = reinterpret_cast<Slot_c*>(base + align8(sizeof(Header_c)));
+    for (uint32_t i = 0; i < n; i++)
+      new (s+i) Slot_c;
+
+    h->ready.store(1, std::memory_order_release);
+  }
+  else
+  {
+    int i = 0;
+    while (h->ready.load(std::memory_order_acquire) == 0 && i < maxWait)
+    {
+      std::this_thread::yield();
+      i++;
+    }
+
+    if (   h->ready.load(std::memory_order_acquire) == 0
+        || h->magic != sharedMagic
+        || h->version != sharedVersion
+        || align8(sizeof(Header_c)) + (size_t)h->slots*sizeof(Slot_c) + h->arenaSize > mapped)
+    {
+      munmap(m, mapped);
+      close(fd);
+      return nullptr;
+    }
+  }
+
+  return std::shared_ptr<SharedGlyphCache_c>(new SharedGlyphCache_c(fd, base, mapped));
+}
+
+bool SharedGlyphCache_c::remove(const std::string & name)
+{
+  return shm_unlink(name.c_str()) == 0;
+}
+
+SharedGlyphCache_c::Slot_c * SharedGlyphCache_c::findSlot(const SharedGlyphKey_c & k, bool insert, bool & claimed) const
+{
+  uint64_t h = k.hash();
+  uint32_t n = header->slots;
+
+  claimed = false;
+
+  for (uint32_t i = 0; i < std::min(n, maxProbe); i++)
+  {
+    Slot_c & s = slots[(h+i) % n];
+    uint64_t t = s.tag.load(std::memory_order_acquire);
+
+    if (t == 0)
+    {
+      if (!insert) return nullptr;
+
+      if (s.tag.compare_exchange_strong(t, h, std::memory_order_acq_rel))
+      {
+        claimed = true;
+        return &s;
+      }
+
+      // somebody else claimed the slot in between, t now contains its tag
+    }
+
+    if (t != h) continue;
+
+    // the key is only valid once the entry is completely written
+    int w = 0;
+    while (s.state.load(std::memory_order_acquire) == SLOT_WRITING)
+    {
+      if (++w == maxWait) return nullptr;
+      std::this_thread::yield();
+    }
+
+    if (   s.font == k.font && s.size == k.size && s.glyphIndex == k.glyphIndex
+        && s.sp == k.sp && s.blurr == k.blurr && s.w == k.w && s.h == k.h && s.outline == k.outline)
+    {
+      return &s;
+    }
+  }
+
+  return nullptr;
+}
+
+void SharedGlyphCache_c::toPaintData(const Slot_c & s, PaintData_c & p) const
+{
+  p.left = s.left;
+  p.top = s.top;
+  p.rows = s.rows;
+  p.width = s.width;
+  p.pitch = s.pitch;
+  p.spans = s.spans;
+  p.buffer = arena + s.offset;
+  p.slab = 0;
+}
+
+bool SharedGlyphCache_c::find(const SharedGlyphKey_c & k, PaintData_c & p) const
+{
+  bool claimed;
+  const Slot_c * s = findSlot(k, false, claimed);
+
+  if (!s || s->state.load(std::memory_order_acquire) != SLOT_READY) return false;
+
+  toPaintData(*s, p);
+  return true;
+}
+
+bool SharedGlyphCache_c::insert(const SharedGlyphKey_c & k, PaintData_c & p)
+{
+  bool claimed;
+  Slot_c * s = findSlot(k, true, claimed);
+
+  if (!s) return false;
+
+  if (!claimed)
+  {
+    // somebody else was faster
+    if (s->state.load(std::memory_order_acquire) != SLOT_READY) return false;
+
+    toPaintData(*s, p);
+    return true;
+  }
+
+  s->font = k.font;
+  s->size = k.size;
+  s->glyphIndex = k.glyphIndex;
+  s->sp = k.sp;
+  s->blurr = k.blurr;
+  s->w = k.w;
+  s->h = k.h;
+  s->outline = k.outline;
+
+  size_t size = imageSize(p);
+  uint64_t offset = header->arenaUsed.fetch_add(align8(size));
+
+  if (offset + size > header->arenaSize)
+  {
+    s->state.store(SLOT_FAILED, std::memory_order_release);
+    return false;
+  }
+
+  if (size) memcpy(arena + offset, p.buffer, size);
+
+  s->left = p.left;
+  s->top = p.top;
+  s->rows = p.rows;
+  s->width = p.width;
+  s->pitch = p.pitch;
+  s->spans = p.spans;
+  s->offset = offset;
+
+  s->state.store(SLOT_READY, std::memory_order_release);
+
+  toPaintData(*s, p);
+  return true;
+}
+
+size_t SharedGlyphCache_c::getMemory(void) const
+{
+  return std::min(header->arenaUsed.load(), header->arenaSize);
+}
+
+} }
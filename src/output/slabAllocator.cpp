@@ -0,0 +1,201 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#include <stll/internal/slabAllocator.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace STLL { namespace internal {
+
+// size classes: 0 is 64 bytes, then 80, 96, 112, 128, 160, 192, 224, 256, ...
+uint32_t SlabAllocator_c::sizeClass(size_t size)
+{
+  if (size <= 64) return 0;
+
+  // find the power of 2 just below size
+  size_t s = size-1;
+  uint32_t bits = 0;
+  while ((s >> bits) > 1) bits++;
+
+  // and the quarter step within that power of 2
+  size_t base = (size_t)1 << bits;
+  uint32_t step = (size-1-base) / (base/4);
+
+  return 4*(bits-6) + step + 1;
+}
+
+size_t SlabAllocator_c::classSize(uint32_t sc)
+{
+  if (sc == 0) return 64;
+
+  sc--;
+  size_t base = (size_t)64 << (sc/4);
+
+  return base + (base/4)*(sc%4+1);
+}
+
+uint32_t SlabAllocator_c::newSlab(uint32_t sc, size_t size)
+{
+  uint32_t idx;
+
+  if (freeSlabs.empty())
+  {
+    idx = slabs.size();
+    slabs.emplace_back();
+  }
+  else
+  {
+    idx = freeSlabs.back();
+    freeSlabs.pop_back();
+  }
+
+  Slab_c & s = slabs[idx];
+
+  s.slotSize = classSize(sc);
+
+  // slots that don't fit into the normal slab size get a slab of their own
+  // and that slab is only as big as necessary
+  if (s.slotSize*4 > slabSize)
+  {
+    s.slotSize = size;
+    s.slots = 1;
+  }
+  else
+  {
+    s.slots = slabSize / s.slotSize;
+  }
+
+  s.memory = std::make_unique<uint8_t[]>(s.slots*s.slotSize);
+  s.used = 0;
+  s.unused = 0;
+  s.freeList = none;
+  s.sizeClass = sc;
+
+  return idx;
+}
+
+void SlabAllocator_c::releaseSlab(uint32_t slab)
+{
+  slabs[slab].memory.reset();
+  freeSlabs.push_back(slab);
+}
+
+std::pair<uint8_t *, uint32_t> SlabAllocator_c::allocate(size_t size)
+{
+  // e.g. the images of spaces, no need to waste a slot on them
+  if (size == 0) return std::make_pair(nullptr, none);
+
+  uint32_t sc = sizeClass(size);
+
+  if (sc >= partial.size()) partial.resize(sc+1);
+
+  auto & p = partial[sc];
+
+  if (p.empty())
+    p.push_back(newSlab(sc, size));
+
+  uint32_t idx = p.back();
+  Slab_c & s = slabs[idx];
+
+  uint32_t slot;
+
+  if (s.freeList != none)
+  {
+    slot = s.freeList;
+    memcpy(&s.freeList, s.memory.get() + slot*s.slotSize, sizeof(uint32_t));
+  }
+  else
+  {
+    slot = s.unused;
+    s.unused++;
+  }
+
+  s.used++;
+
+  if (s.used == s.slots)
+    p.pop_back();
+
+  uint8_t * res = s.memory.get() + slot*s.slotSize;
+  memset(res, 0, size);
+
+  return std::make_pair(res, idx);
+}
+
+void SlabAllocator_c::free(uint8_t * p, uint32_t slab)
+{
+  if (!p || slab >= slabs.size()) return;
+
+  Slab_c & s = slabs[slab];
+  auto & part = partial[s.sizeClass];
+
+  uint32_t slot = (p - s.memory.get()) / s.slotSize;
+
+  // when the slab was full it now has a free slot again
+  if (s.used == s.slots)
+    part.push_back(slab);
+
+  memcpy(p, &s.freeList, sizeof(uint32_t));
+  s.freeList = slot;
+  s.used--;
+
+  if (s.used == 0)
+  {
+    // keep one empty slab for each size class as a spare, release all others
+    // the spare is kept at the front of the partial list, new blocks are taken
+    // from the back, so the other slabs are filled first
+    bool spare = std::any_of(part.begin(), part.end(),
+                             [this, slab](uint32_t i) { return i != slab && slabs[i].used == 0; });
+
+    part.erase(std::find(part.begin(), part.end(), slab));
+
+    if (spare || s.slots == 1)
+    {
+      releaseSlab(slab);
+    }
+    else
+    {
+      s.unused = 0;
+      s.freeList = none;
+      part.insert(part.begin(), slab);
+    }
+  }
+}
+
+void SlabAllocator_c::clear(void)
+{
+  slabs.clear();
+  freeSlabs.clear();
+  partial.clear();
+}
+
+size_t SlabAllocator_c::capacity(void) const
+{
+  size_t res = 0;
+
+  for (auto & s : slabs)
+    if (s.memory)
+      res += s.slots*s.slotSize;
+
+  return res;
+}
+
+} }
@@ -0,0 +1,187 @@
+/*
+ * STLL Simple Text Layouting Library
+ *
+ * STLL is the legal property of its developers, whose
+ * names are listed in the COPYRIGHT file, which is included
+ * within the source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stll/internal/spriteCache.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace STLL { namespace internal {
+
+// FNV-1a over the relevant fields of all commands
+static void hashValue(uint64_t & h, uint64_t v)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    h ^= v & 0xFF;
+    h *= 0x100000001b3ULL;
+    v >>= 8;
+  }
+}
+
+std::experimental::optional<SpriteKey_c> SpriteCache_c::key(const TextLayout_c & l, int sx, int sy, SubPixelArrangement sp)
+{
+  auto j = hashes.find(l.getVersion());
+
+  if (j == hashes.end())
+  {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (auto & i : l.getData())
+    {
+      // images are drawn by the user, so we can not put them into the sprite
+      if (i.command == CommandData_c::CMD_IMAGE)
+      {
+        h = 0;
+        break;
+      }
+
+      SpriteCommand_c c(i);
+
+      hashValue(h, c.command);
+      hashValue(h, (uint32_t)c.x);
+      hashValue(h, (uint32_t)c.y);
+      hashValue(h, c.glyphIndex);
+      hashValue(h, c.font);
+      hashValue(h, c.fontSize);
+      hashValue(h, c.w);
+      hashValue(h, c.h);
+      hashValue(h, c.c);
+      hashValue(h, c.blurr);
+    }
+
+    // the versions of layouts that have been changed or destroyed are never seen
+    // again, so simply start over once there are too many of them
+    if (hashes.size() > 4096) hashes.clear();
+
+    j = hashes.emplace(l.getVersion(), h).first;
+  }
+
+  if (j->second == 0)
+    return std::experimental::optional<SpriteKey_c>();
+
+  SpriteKey_c k;
+
+  k.hash = j->second;
+  k.commands = l.getData().size();
+  k.sp = sp;
+  k.fx = mod_inf(sx, 64);
+  k.fy = mod_inf(sy, 64);
+
+  return k;
+}
+
+const LayoutSprite_c * SpriteCache_c::find(const SpriteKey_c & k, const TextLayout_c & l)
+{
+  auto i = sprites.find(k);
+
+  if (i == sprites.end()) return nullptr;
+
+  // the hash may collide, so make sure that the sprite really shows this layout
+  if (i->second.version != l.getVersion())
+  {
+    auto & d = l.getData();
+
+    if (d.size() != i->second.commands.size() ||
+        !std::equal(d.begin(), d.end(), i->second.commands.begin(),
+                    [](const CommandData_c & a, const SpriteCommand_c & b) { return SpriteCommand_c(a) == b; }))
+      return nullptr;
+
+    i->second.version = l.getVersion();
+  }
+
+  i->second.lastUse = useCounter;
+  useCounter++;
+
+  return &i->second;
+}
+
+const LayoutSprite_c * SpriteCache_c::insert(const SpriteKey_c & k, const TextLayout_c & l, LayoutSprite_c && s)
+{
+  if (s.width == 0 || s.rows == 0) return nullptr;
+
+  s.commands.assign(l.getData().begin(), l.getData().end());
+  s.version = l.getVersion();
+
+  size_t size = s.bytes();
+
+  if (size > budget) return nullptr;
+
+  // remove a sprite with the same key, it belongs to a different layout with a colliding hash
+  auto o = sprites.find(k);
+
+  if (o != sprites.end())
+  {
+    used -= o->second.bytes();
+    sprites.erase(o);
+  }
+
+  makeRoom(size);
+
+  auto i = sprites.insert(std::make_pair(k, std::move(s))).first;
+
+  used += size;
+  i->second.lastUse = useCounter;
+  useCounter++;
+
+  return &i->second;
+}
+
+void SpriteCache_c::makeRoom(size_t size)
+{
+  if (used + size <= budget) return;
+
+  // sort all sprites by their age and remove the oldest ones
+  std::vector<std::unordered_map<SpriteKey_c, LayoutSprite_c>::iterator> entries;
+
+  for (auto i = sprites.begin(); i != sprites.end(); ++i)
+    entries.push_back(i);
+
+  std::sort(entries.begin(), entries.end(),
+            [] (const std::unordered_map<SpriteKey_c, LayoutSprite_c>::iterator & a,
+                const std::unordered_map<SpriteKey_c, LayoutSprite_c>::iterator & b) {
+    return a->second.lastUse < b->second.lastUse;
+  });
+
+  for (auto & e : entries)
+  {
+    if (used + size <= budget) break;
+
+    used -= e->second.bytes();
+    sprites.erase(e);
+  }
+}
+
+void SpriteCache_c::setBudget(size_t bytes)
+{
+  budget = bytes;
+  makeRoom(0);
+}
+
+void SpriteCache_c::clear(void)
+{
+  sprites.clear();
+  hashes.clear();
+  used = 0;
+}
+
+} }